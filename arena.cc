@@ -0,0 +1,48 @@
+/* File: arena.cc
+ * --------------
+ * Implementation of the Arena class.
+ */
+
+#include "arena.h"
+#include "utility.h"
+#include <stdlib.h>
+
+Arena Arena::ast("ast");
+Arena Arena::ir("ir");
+Arena Arena::types("types");
+
+/* Method: NewBlock
+ * ----------------
+ * Starts a new block with room for at least size bytes. What was left
+ * of the old one is not used any more; a request bigger than a block
+ * gets a block of its own.
+ */
+void Arena::NewBlock(size_t size) {
+    size_t header = (sizeof(Block) + Align - 1) & ~(Align - 1);
+    size_t room = size > BlockSize - header ? size : BlockSize - header;
+    Block *b = (Block *) malloc(header + room);
+    if (b == NULL)
+        Failure("Out of memory in the %s arena", name);
+    b->prev = blocks;
+    b->size = header + room;
+    blocks = b;
+    next = (char *) b + header;
+    left = room;
+    numBlocks++;
+}
+
+void Arena::Release() {
+    size_t reserved = 0;
+    for (Block *b = blocks; b; b = b->prev)
+        reserved += b->size;
+    PrintDebug("arena", "%s: %zu bytes used, %zu in %d blocks", name, used,
+               reserved, numBlocks);
+    while (blocks) {
+        Block *prev = blocks->prev;
+        free(blocks);
+        blocks = prev;
+    }
+    next = NULL;
+    left = used = 0;
+    numBlocks = 0;
+}
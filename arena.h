@@ -0,0 +1,67 @@
+/* File: arena.h
+ * -------------
+ * An Arena hands out memory by bumping a pointer through large blocks
+ * and gives it all back at once with Release. Objects of one phase
+ * share an arena instead of each being a small heap allocation of its
+ * own that is never freed: the ast nodes and their locations go in
+ * Arena::ast, the Tac instructions and their operand Locations in
+ * Arena::ir. The classes allocate from their arena in their own
+ * operator new, so constructing them looks the same as before; they
+ * must never be deleted one by one. The built-in and canonical types
+ * are nodes that outlive the tree, so they are placed in Arena::types,
+ * which is never released.
+ *
+ * Release does not run destructors, an object is just forgotten along
+ * with its block. With -d arena each arena reports what it used when it
+ * is released.
+ */
+
+#ifndef _H_arena
+#define _H_arena
+
+#include <stddef.h>
+
+class Arena {
+  public:
+    // Constant-initialized, so the arenas can be used during static
+    // initialization (Type::intType and friends) whatever the link order.
+    constexpr Arena(const char *name)
+        : name(name), blocks(NULL), next(NULL), left(0), used(0), numBlocks(0) {}
+
+    // Returns size bytes, aligned for any type, valid until Release.
+    void *Alloc(size_t size) {
+        size = (size + Align - 1) & ~(Align - 1);
+        if (size > left)
+            NewBlock(size);
+        void *p = next;
+        next += size;
+        left -= size;
+        used += size;
+        return p;
+    }
+
+    // Frees every block at once; everything allocated is gone.
+    void Release();
+
+    size_t BytesUsed() const { return used; }
+
+    static Arena ast, ir, types;
+
+  private:
+    static const size_t Align = 16, BlockSize = 64 * 1024;
+    struct Block {
+        Block *prev;
+        size_t size;
+    };
+
+    const char *name;
+    Block *blocks;  // the newest block, linked to the older ones
+    char *next;     // where the next allocation goes
+    size_t left;    // bytes after next in the newest block
+    size_t used;
+    int numBlocks;
+
+    void NewBlock(size_t size);
+};
+
+#endif
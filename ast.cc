@@ -5,20 +5,36 @@
 #include "ast.h"
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "codegen.h"
+#include "scanner.h" // for GetLineOf
 #include <string.h> // strdup
 #include <stdio.h>  // printf
 
 Node::Node(yyltype loc) {
-    location = new yyltype(loc);
+    location = loc;
     parent = NULL;
 }
 
 Node::Node() {
-    location = NULL;
+    location.first = location.last = NoOffset;
     parent = NULL;
 }
 
-#define REC_DEFINE_NO_CTX(NAME) void Node::NAME() {for(auto& i:children()){if (i) i->NAME();}}
+void Node::MarkSourceLine() {
+    if (location.first != NoOffset)
+        CodeGenerator::instance->SetSourceLine(GetLineOf(location.first));
+}
+
+bool Node::Assigns(VarDecl *a, VarDecl *b) {
+    bool assigns = false;
+    ForEachChild([&](Node *i) {
+        if (i && !assigns && i->Assigns(a, b))
+            assigns = true;
+    });
+    return assigns;
+}
+
+#define REC_DEFINE_NO_CTX(NAME) void Node::NAME() {ForEachChild([](Node *i){if (i) i->NAME();});}
 REC_DEFINE_NO_CTX(AddGlobal);
 REC_DEFINE_NO_CTX(CheckType);
 #undef REC_DEFINE_NO_CTX
@@ -28,27 +44,24 @@ void Node::ResolveConflict(set<Node*>* visited) {
 	if (parent) {
 		scope = parent->scope;
 	}
-	for(auto& i:children()){
+	ForEachChild([&](Node *i){
 		if (i) i->ResolveConflict(visited);
-	}
+	});
 }
 
-//recursive
-#define REC_DEFINE(NAME) void Node::NAME(Context ctx) {for(auto& i:children()){if(i) i->NAME(ctx);}}
-REC_DEFINE(resolve_conflict_decl)
-REC_DEFINE(resolve_identifier_type)
-REC_DEFINE(resolve_class_fields)
-REC_DEFINE(resolve_self_access)
-REC_DEFINE(resolve_field_access)
-REC_DEFINE(resolve_array_type)
-REC_DEFINE(resolve_compound_expr_type)
-REC_DEFINE(resolve_call_args)
-REC_DEFINE(resolve_improper_statement)
-REC_DEFINE(Check)
-#undef REC_DEFINE
+void Node::Check(Context ctx) {
+    ForEachChild([&](Node *i) {
+        if (i) {
+            // a child shares its parent's scope unless it has its own
+            if (!i->scope)
+                i->scope = scope;
+            i->Check(ctx);
+        }
+    });
+}
 	 
 Identifier::Identifier(yyltype loc, const char *n) : Node(loc) {
-    name = strdup(n);
+    name = Intern(n);
 }
 
 
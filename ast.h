@@ -6,9 +6,10 @@
  * more correctly, of instances of concrete subclassses such as VarDecl,
  * ForStmt, and AssignExpr).
  * 
- * Location: Each node maintains its lexical location (line and columns in 
- * file), that location can be NULL for those nodes that don't care/use 
- * locations. The location is typcially set by the node constructor.  The 
+ * Location: Each node maintains its lexical location (its span of the
+ * file, see location.h), that location can be NoOffset for those nodes
+ * that don't care/use locations. The location is typcially set by the
+ * node constructor.  The 
  * location is used to provide the context when reporting semantic errors.
  *
  * Parent: Each node has a pointer to its parent. For a Program node, the 
@@ -35,59 +36,101 @@
 #include <set>
 #include <stdlib.h> // for NULL
 
+#include "arena.h"
 #include "codegen.h"
+#include "intern.h"
 #include <string>
 #include <vector>
 using std::set;
 using std::string;
 
 using std::vector;
+class Decl;
+class VarDecl;
+class Node;
+
+// Is handed the children of a node one at a time, see Node::ForEachChild.
+class ChildVisitor {
+public:
+    virtual void Visit(Node *child) = 0;
+    template <class L> void VisitAll(L *list) {
+        for (auto &child : list->elems)
+            Visit(child);
+    }
+};
+
 class Node {
 protected:
-    yyltype *location;
+    yyltype location; // first is NoOffset if the node has none
     Node *parent;
-    virtual vector<Node *> children() {
-        vector<Node *> result;
-        return result;
-    }
+    // Hands each child to v in turn; a subclass visits its base class's
+    // children first, then its own.
+    virtual void VisitChildren(ChildVisitor *v) {}
 
 public:
     Node(yyltype loc);
     Node();
 
+    // Nodes live in Arena::ast, which goes when the program is compiled,
+    // unless placed in another arena with new (arena)
+    static void *operator new(size_t size) { return Arena::ast.Alloc(size); }
+    static void *operator new(size_t size, Arena &arena) { return arena.Alloc(size); }
+    static void operator delete(void *) {}
+    static void operator delete(void *, Arena &) {}
+
+    // Calls f on each child (possibly NULL) in order. The children are
+    // walked where they are, nothing is allocated.
+    template <class F> void ForEachChild(F f) {
+        struct Caller : ChildVisitor {
+            F &f;
+            Caller(F &f) : f(f) {}
+            void Visit(Node *child) { f(child); }
+        } caller(f);
+        VisitChildren(&caller);
+    }
+
     StackNode *scope = NULL;
-    yyltype *GetLocation() { return location; }
+    yyltype *GetLocation() { return &location; }
     void SetParent(Node *p) { parent = p; }
     Node *GetParent() { return parent; }
 
+    // The semantic analysis (see Program::Check). AddGlobal, CheckType
+    // and ResolveConflict only go as far as the declarations; function
+    // bodies are left to Check, which gives each node its scope and
+    // resolves the types declared in it as it gets there.
     virtual void AddGlobal();
     virtual void CheckType();
     virtual void ResolveConflict(set<Node *> *visited);
-    virtual void resolve_conflict_decl(Context ctx);
-    virtual void resolve_identifier_type(Context ctx);
-    virtual void resolve_class_fields(Context ctx);
-    virtual void resolve_self_access(Context ctx);
-    virtual void resolve_field_access(Context ctx);
-    virtual void resolve_array_type(Context ctx);
-    virtual void resolve_compound_expr_type(Context ctx);
-    virtual void resolve_call_args(Context ctx);
-    virtual void resolve_improper_statement(Context ctx);
     virtual void Check() {  }
     virtual void Check(Context ctx);
 
     virtual void Emit() {return;}
+
+    // Tags the Tac generated from here on with this node's source line,
+    // if it has a location
+    void MarkSourceLine();
+
+    // Whether anything in this subtree assigns to the local variable a
+    // or b (either may be NULL)
+    virtual bool Assigns(VarDecl *a, VarDecl *b);
 };
 
 class Identifier : public Node {
 protected:
-    char *name;
+    const char *name; // interned
+    Decl *decl = NULL; // what the name resolved to
 
 public:
     Identifier(yyltype loc, const char *name);
     friend std::ostream &operator<<(std::ostream &out, Identifier *id) {
         return out << id->name;
     }
-    char *GetName() { return name; }
+    const char *GetName() { return name; }
+
+    // Check records the declaration the name refers to, so the later
+    // phases don't have to look it up again.
+    void SetDecl(Decl *d) { decl = d; }
+    Decl *GetDecl() { return decl; }
 };
 
 // This node class is designed to represent a portion of the tree that
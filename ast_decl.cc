@@ -59,8 +59,10 @@ bool VarDecl::CheckDeclMatch(Decl *decl) {
 }
 
 void VarDecl::Emit() {
-    // only funtion local var locations
-    Assert(location == NULL);
+    // only funtion local var locations; an unrolled loop emits its body
+    // more than once, but the variables keep the slots they got first
+    if (location)
+        return;
     int offSet = CodeGenerator::OffsetToFirstLocal -
                  CodeGenerator::instance->localVarNum * 4;
     CodeGenerator::instance->localVarNum++;
@@ -93,37 +95,126 @@ void ClassDecl::AddGlobal() {
     return;
 }
 
-Decl *ClassDecl::GetFieldsHelper(set<ClassDecl *> *visited,
-                                 const char *symbol) {
-    if (visited->count(this))
-        return NULL;
-    Decl *rv = scope->symbols->Lookup(symbol);
-    if (rv != NULL)
-        return rv;
-    visited->insert(this);
-    if (extendClass) {
-        return extendClass->GetFieldsHelper(visited, symbol);
+Decl *ClassDecl::GetFields(const char *symbol) {
+    if (memberTable)
+        return memberTable->Lookup(symbol);
+    // not flattened (yet): walk up the extends chain, chainLength stops
+    // the walk before it goes round a cycle again
+    ClassDecl *c = this;
+    for (int i = 0; i < chainLength && c; i++, c = c->extendClass) {
+        Decl *rv = c->scope->symbols->Lookup(symbol);
+        if (rv != NULL)
+            return rv;
     }
     return NULL;
 }
 
-bool ClassDecl::IfImplementOrExtendHelper(set<ClassDecl *> *visited,
-                                          Decl *other) {
-    if (visited->count(this))
+bool ClassDecl::IfImplementOrExtend(Decl *other) {
+    if (InterfaceDecl *i = dynamic_cast<InterfaceDecl *>(other))
+        return i->interfaceId >= 0 && interfaceSet[i->interfaceId];
+    ClassDecl *c = dynamic_cast<ClassDecl *>(other);
+    // a class only extends itself by going round a cycle
+    if (!c || (c == this && !inCycle))
         return false;
-    visited->insert(this);
-    for (int i = 0; i < implementInterfaces->NumElements(); i++) {
-        InterfaceDecl *decl = implementInterfaces->Nth(i);
-        // decl is NULL for undeclared interface
-        if (decl && decl == other)
-            return true;
+    return c->preorder <= preorder && postorder <= c->postorder;
+}
+
+/* ClassDecl::NumberHierarchy
+ * --------------------------
+ * Numbers the extends tree depth first, so that a class is below
+ * another exactly when its number falls within the other's interval,
+ * and gives each class the set of interfaces it implements itself or
+ * inherits. Classes whose extends chain comes back round (which has
+ * been reported already) are numbered as the one class of their cycle.
+ */
+void ClassDecl::NumberHierarchy(List<Decl *> *decls) {
+    vector<ClassDecl *> classes;
+    int numInterfaces = 0;
+    for (int i = 0; i < decls->NumElements(); i++) {
+        if (ClassDecl *c = dynamic_cast<ClassDecl *>(decls->Nth(i)))
+            classes.push_back(c);
+        else if (InterfaceDecl *d = dynamic_cast<InterfaceDecl *>(decls->Nth(i)))
+            d->interfaceId = numInterfaces++;
     }
-    if (extendClass) {
-        if (extendClass == other)
-            return true;
-        return extendClass->IfImplementOrExtendHelper(visited, other);
+
+    // find the cycles: follow each chain until it reaches a class seen
+    // before; if that was on this chain, the rest of the chain is a cycle
+    std::map<ClassDecl *, int> state; // 1 on the current chain, 2 done
+    std::map<ClassDecl *, ClassDecl *> cycleOf;
+    std::map<ClassDecl *, vector<ClassDecl *> > cycles;
+    for (size_t i = 0; i < classes.size(); i++) {
+        vector<ClassDecl *> chain;
+        ClassDecl *c = classes[i];
+        for (; c && state[c] == 0; c = c->extendClass) {
+            state[c] = 1;
+            chain.push_back(c);
+        }
+        if (c && state[c] == 1) {
+            size_t k = 0;
+            while (chain[k] != c) k++;
+            for (; k < chain.size(); k++) {
+                chain[k]->inCycle = true;
+                cycleOf[chain[k]] = c;
+                cycles[c].push_back(chain[k]);
+            }
+        }
+        for (size_t k = 0; k < chain.size(); k++) state[chain[k]] = 2;
+    }
+
+    std::map<ClassDecl *, vector<ClassDecl *> > subclasses;
+    vector<ClassDecl *> roots;
+    for (size_t i = 0; i < classes.size(); i++) {
+        ClassDecl *c = classes[i];
+        if (c->inCycle) {
+            if (cycleOf[c] == c)
+                roots.push_back(c);
+        } else if (!c->extendClass) {
+            roots.push_back(c);
+        } else {
+            ClassDecl *p = c->extendClass;
+            subclasses[p->inCycle ? cycleOf[p] : p].push_back(c);
+        }
+    }
+    int counter = 0;
+    for (size_t i = 0; i < roots.size(); i++) {
+        roots[i]->interfaceSet.assign(numInterfaces, false);
+        roots[i]->chainLength = 0;
+        roots[i]->NumberSubtree(&counter, roots[i]->inCycle ? &cycles[roots[i]] : NULL,
+                                &subclasses);
+    }
+}
+
+// Numbers this class, or the cycle it stands for, and the classes
+// below it. The interface set and chain length start out as those of
+// the class above.
+void ClassDecl::NumberSubtree(int *counter, vector<ClassDecl *> *cycle,
+                              std::map<ClassDecl *, vector<ClassDecl *> > *subclasses) {
+    vector<ClassDecl *> self(1, this);
+    if (!cycle)
+        cycle = &self;
+    preorder = (*counter)++;
+    chainLength += cycle->size();
+    for (size_t m = 0; m < cycle->size(); m++) {
+        List<InterfaceDecl *> *impl = (*cycle)[m]->implementInterfaces;
+        for (int i = 0; i < impl->NumElements(); i++)
+            // NULL for an undeclared interface
+            if (impl->Nth(i) && impl->Nth(i)->interfaceId >= 0)
+                interfaceSet[impl->Nth(i)->interfaceId] = true;
+    }
+    vector<ClassDecl *> &below = (*subclasses)[this];
+    for (size_t i = 0; i < below.size(); i++) {
+        below[i]->interfaceSet = interfaceSet;
+        below[i]->chainLength = chainLength;
+        below[i]->NumberSubtree(counter, NULL, subclasses);
+    }
+    postorder = *counter - 1;
+    for (size_t m = 0; m < cycle->size(); m++) {
+        ClassDecl *c = (*cycle)[m];
+        c->preorder = preorder;
+        c->postorder = postorder;
+        c->chainLength = chainLength;
+        c->interfaceSet = interfaceSet;
     }
-    return false;
 }
 
 void ClassDecl::CheckType() {
@@ -202,6 +293,28 @@ void ClassDecl::ResolveConflict(set<Node *> *visited) {
         }
         // var resolveconflict will do nothing
     }
+    FlattenMembers();
+}
+
+/* ClassDecl::FlattenMembers
+ * -------------------------
+ * Starts from a copy of the superclass's table and enters the class's
+ * own members over it, so that a lookup is a single probe. A class in
+ * a cycle of extends, or below one, isn't flattened and GetFields walks
+ * the chain instead.
+ */
+void ClassDecl::FlattenMembers() {
+    if (inCycle || (extendClass && !extendClass->memberTable))
+        return;
+    memberTable = new Hashtable<Decl *>;
+    if (extendClass) {
+        Iterator<Decl *> iter = extendClass->memberTable->GetIterator();
+        while (Decl *d = iter.GetNextValue())
+            memberTable->Enter(d->GetName(), d);
+    }
+    Iterator<Decl *> iter = scope->GetSymbolTable()->GetIterator();
+    while (Decl *d = iter.GetNextValue())
+        memberTable->Enter(d->GetName(), d);
 }
 
 void ClassDecl::Check(Context ctx) {
@@ -247,7 +360,6 @@ void ClassDecl::generateLocations() {
     if (methodLabels)
         return;
     methodLabels = new List<const char *>;
-    methodTable = new Hashtable<FnDecl *>;
     methodNames = new List<const char *>;
     if (extendClass) {
         extendClass->generateLocations();
@@ -260,9 +372,6 @@ void ClassDecl::generateLocations() {
             char *methodDup = strdup(methodLabel);
             methodLabels->Append(methodDup);
             methodNames->Append(name);
-            FnDecl *parentMethod = extendClass->methodTable->Lookup(name);
-            Assert(parentMethod);
-            methodTable->Enter(name, parentMethod);
         }
     }
 
@@ -280,7 +389,10 @@ void ClassDecl::generateLocations() {
             const char *methodName = fnDecl->GetName();
             char *methodLabel = getMethodLabel(GetName(), methodName);
             fnDecl->label = methodLabel;
-            FnDecl *parentMethod = methodTable->Lookup(methodName);
+            FnDecl *parentMethod = NULL;
+            if (extendClass)
+                parentMethod = dynamic_cast<FnDecl *>(
+                    extendClass->GetFields(methodName));
             int newOffSet = 0;
             if (parentMethod) {
                 // insert the new overload method label at the original index
@@ -290,14 +402,12 @@ void ClassDecl::generateLocations() {
                 int index = newOffSet / CodeGenerator::VarSize;
                 methodLabels->RemoveAt(index);
                 methodLabels->InsertAt(methodLabel, index);
-                methodTable->Enter(methodName, fnDecl);
                 // dont need to update methodName cuz the same
             } else {
                 newOffSet =
                     methodLabels->NumElements() * CodeGenerator::VarSize;
                 methodLabels->Append(methodLabel);
                 methodNames->Append(methodName);
-                methodTable->Enter(methodName, fnDecl);
             }
             Assert(fnDecl->offset == -1);
             fnDecl->offset = newOffSet;
@@ -354,8 +464,9 @@ void FnDecl::SetFunctionBody(Stmt *b) {
 }
 
 void FnDecl::CheckType() {
-    Node::CheckType();
-    // parent method will not check returnType
+    // the signature only, the body's types are resolved as it is checked
+    for (int i = 0; i < formals->NumElements(); i++)
+        formals->Nth(i)->CheckType();
     if (returnType) {
         returnType = returnType->CheckTypeHelper(LookingForType);
     }
@@ -364,13 +475,15 @@ void FnDecl::CheckType() {
 // helper for check decl match
 bool typeMatch(Type *l, Type *r) {
     // check l and r are exactly the same
-    if (l == Type::errorType || r == Type::errorType ||
-        isErrorTypeName(l->GetName()) || isErrorTypeName(r->GetName()))
+    if (l->IsError() || r->IsError())
         return true;
-    return (strcmp(l->GetName(), r->GetName()) == 0);
+    return l->IsEquivalentTo(r);
 }
 
 Decl *getTypeDecl(Type *t) {
+    // only classes and interfaces are declared
+    if (!dynamic_cast<NamedType *>(t))
+        return NULL;
     Decl *rv = StackNode::namedTypeTable->GetSymbol(t->GetName());
     return rv;
 }
@@ -384,9 +497,9 @@ bool typeMatchParent(Type *children, Type *parent) {
     //not likelyto happen
 
     //std::cout<<children->GetName()<<parent->GetName()<<std::endl;
-    if ((string) parent->GetName() == "null")
+    if (parent->IsEquivalentTo(Type::nullType))
         return false;
-    if ((string) children->GetName() == "null" &&
+    if (children->IsEquivalentTo(Type::nullType) &&
         dynamic_cast<NamedType *>(parent))
         return true;
 
@@ -448,17 +561,14 @@ void FnDecl::ResolveConflict(set<Node *> *visited) {
             scope->AddSymbol(decl->GetName(), decl);
         }
     }
-    if (body)
-        body->ResolveConflict(visited);
+    // the body gets its scopes as it is checked
 }
 
-vector<Node *> FnDecl::children() {
-    vector<Node *> result = Decl::children();
-    result.insert(result.end(), formals->elems.begin(), formals->elems.end());
-    result.push_back(returnType);
-    result.push_back(body);
-
-    return result;
+void FnDecl::VisitChildren(ChildVisitor *v) {
+    Decl::VisitChildren(v);
+    v->VisitAll(formals);
+    v->Visit(returnType);
+    v->Visit(body);
 }
 void PrintLocation(VarDecl *var) {
     printf("%s: loc:%d ", var->GetName(), var->location->GetOffset());
@@ -498,6 +608,7 @@ void FnDecl::Emit() {
         Assert(label);
         CodeGenerator::instance->GenLabel(label);
     }
+    MarkSourceLine();
     BeginFunc *beginFunc = CodeGenerator::instance->GenBeginFunc();
     // CodeGenerator::instance->localVarNum = cnt;
     // printf("%d\n", cnt);
@@ -17,6 +17,7 @@
 #include "ast_stmt.h"
 #include "ast_type.h"
 #include "list.h"
+#include <map>
 
 class Identifier;
 class Stmt;
@@ -25,10 +26,9 @@ class Decl : public Node {
 protected:
     Identifier *id;
 
-    vector<Node *> children() {
-        vector<Node *> result = Node::children();
-        result.push_back(id);
-        return result;
+    void VisitChildren(ChildVisitor *v) {
+        Node::VisitChildren(v);
+        v->Visit(id);
     }
 
 public:
@@ -36,7 +36,7 @@ public:
     friend std::ostream &operator<<(std::ostream &out, Decl *d) {
         return out << d->id;
     }
-    char *GetName() { return id->GetName(); }
+    const char *GetName() { return id->GetName(); }
     virtual void AddGlobal();
     virtual bool CheckDeclMatch(Decl *decl) { return true; }
     // only for funDecl and VarDecl
@@ -51,10 +51,9 @@ class VarDecl : public Decl {
 protected:
     Type *type;
 
-    vector<Node *> children() {
-        vector<Node *> result = Decl::children();
-        result.push_back((Node *) (type));
-        return result;
+    void VisitChildren(ChildVisitor *v) {
+        Decl::VisitChildren(v);
+        v->Visit(type);
     }
 
 public:
@@ -80,20 +79,29 @@ protected:
     ClassDecl *extendClass = NULL;
     List<InterfaceDecl *> *implementInterfaces;
 
-    Decl *GetFieldsHelper(set<ClassDecl *> *visited, const char *symbol);
-    bool IfImplementOrExtendHelper(set<ClassDecl *> *visited, Decl *other);
-
-    vector<Node *> children() {
-        vector<Node *> result = Decl::children();
-        result.insert(result.end(), members->elems.begin(),
-                      members->elems.end());
+    // set by NumberHierarchy: the classes under this one in the extends
+    // tree are numbered preorder+1 .. postorder. A cycle of extends
+    // counts as one class, whose members share its numbers.
+    int preorder = -1, postorder = -1;
+    bool inCycle = false;
+    int chainLength = 1;       // distinct classes on the extends chain
+    vector<bool> interfaceSet; // by interfaceId, implemented or inherited
+
+    // own and inherited members by name, the nearest declaration of each;
+    // made at the end of ResolveConflict
+    Hashtable<Decl *> *memberTable = NULL;
+    void FlattenMembers();
+
+    void NumberSubtree(int *counter, vector<ClassDecl *> *cycle,
+                       std::map<ClassDecl *, vector<ClassDecl *> > *subclasses);
+
+    void VisitChildren(ChildVisitor *v) {
+        Decl::VisitChildren(v);
+        v->VisitAll(members);
         if (extends != NULL) {
-            result.push_back((Node *) (extends));
+            v->Visit(extends);
         }
-        result.insert(result.end(), implements->elems.begin(),
-                      implements->elems.end());
-
-        return result;
+        v->VisitAll(implements);
     }
 
     void Check(Context ctx);
@@ -106,14 +114,13 @@ public:
     /* virtual bool IsCompatible(ClassDecl *other) {return true;} */
     ClassDecl *GetExtends() { return extendClass; }
     void AddGlobal();
-    Decl *GetFields(const char *symbol) {
-        set<ClassDecl *> visited;
-        return GetFieldsHelper(&visited, symbol);
-    }
-    bool IfImplementOrExtend(Decl *parent) {
-        set<ClassDecl *> visited;
-        return IfImplementOrExtendHelper(&visited, parent);
-    }
+    // Both go by what NumberHierarchy worked out, so they can't be
+    // used before it has run.
+    Decl *GetFields(const char *symbol);
+    bool IfImplementOrExtend(Decl *parent);
+    // Numbers the classes and interfaces among decls, once their
+    // extends and implements have been looked up (CheckType).
+    static void NumberHierarchy(List<Decl *> *decls);
     static ClassDecl *GetClass(const char *symbol) {
         // utility function to get classdecl associated with symbol
         Decl *decl = StackNode::namedTypeTable->GetSymbol(symbol);
@@ -127,8 +134,6 @@ public:
     // for IR
     List<const char *> *methodLabels = NULL;
     List<const char *> *methodNames = NULL;
-    // index for methods
-    Hashtable<FnDecl*> *methodTable = NULL;
     // numVar for variableOffsets of children
     int numVar = 0;
     void generateLocations();
@@ -141,14 +146,13 @@ class InterfaceDecl : public Decl {
 
 protected:
     List<Decl *> *members;
-    vector<Node *> children() {
-        vector<Node *> result = Decl::children();
-        result.insert(result.end(), members->elems.begin(),
-                      members->elems.end());
-        return result;
+    void VisitChildren(ChildVisitor *v) {
+        Decl::VisitChildren(v);
+        v->VisitAll(members);
     }
 
 public:
+    int interfaceId = -1; // set by ClassDecl::NumberHierarchy
     InterfaceDecl(Identifier *name, List<Decl *> *members);
     void AddGlobal();
     Decl *GetFields(const char *symbol) {
@@ -171,7 +175,7 @@ protected:
     List<VarDecl *> *formals;
     Type *returnType;
     Stmt *body;
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     void Check(Context ctx) {
@@ -7,6 +7,7 @@
 #include "ast_expr.h"
 #include "ast_type.h"
 #include "errors.h"
+#include <limits.h>
 #include <string.h>
 
 IntConstant::IntConstant(yyltype loc, int val) : Expr(loc) {
@@ -47,12 +48,11 @@ CompoundExpr::CompoundExpr(Operator *o, Expr *r)
     (right = r)->SetParent(this);
 }
 
-vector<Node *> CompoundExpr::children() {
-    vector<Node *> result = Expr::children();
-    result.push_back(op);
-    result.push_back(left);
-    result.push_back(right);
-    return result;
+void CompoundExpr::VisitChildren(ChildVisitor *v) {
+    Expr::VisitChildren(v);
+    v->Visit(op);
+    v->Visit(left);
+    v->Visit(right);
 }
 
 Location *genLessOrEqual(Location *l, Location *r) {
@@ -62,7 +62,40 @@ Location *genLessOrEqual(Location *l, Location *r) {
     return rv;
 }
 
+bool CompoundExpr::isCommutative() {
+    const char *opStr = op->getToken();
+    return strcmp(opStr, "+") == 0 || strcmp(opStr, "*") == 0 ||
+           strcmp(opStr, "&&") == 0 || strcmp(opStr, "||") == 0;
+}
+
+// x <= c is x < c+1 and x >= c is x > c-1, so with a constant on
+// either side every comparison becomes a single immediate "<" or ">"
+static Location *genCompareConstant(const char *opStr, Location *l, int c) {
+    if (strcmp(opStr, "<=") == 0) {
+        if (c == INT_MAX)
+            return CodeGenerator::instance->GenLoadConstant(1);
+        return CodeGenerator::instance->GenBinaryOp("<", l, c + 1);
+    } else if (strcmp(opStr, ">=") == 0) {
+        if (c == INT_MIN)
+            return CodeGenerator::instance->GenLoadConstant(1);
+        return CodeGenerator::instance->GenBinaryOp(">", l, c - 1);
+    }
+    return CodeGenerator::instance->GenBinaryOp(opStr, l, c);
+}
+
 Location *RelationalExpr::cgen() {
+    int value;
+    if (right->getConstant(value))
+        return genCompareConstant(op->getToken(), left->cgen(), value);
+    if (left->getConstant(value)) {
+        // c op x is x op' c with the comparison mirrored
+        const char *opStr = op->getToken();
+        const char *mirrored = strcmp(opStr, "<") == 0    ? ">"
+                               : strcmp(opStr, ">") == 0  ? "<"
+                               : strcmp(opStr, "<=") == 0 ? ">="
+                                                          : "<=";
+        return genCompareConstant(mirrored, right->cgen(), value);
+    }
     Location *l = left->cgen();
     Location *r = right->cgen();
     char *opStr = op->getToken();
@@ -79,11 +112,10 @@ ArrayAccess::ArrayAccess(yyltype loc, Expr *b, Expr *s) : LValue(loc) {
     (subscript = s)->SetParent(this);
 }
 
-vector<Node *> ArrayAccess::children() {
-    vector<Node *> result = LValue::children();
-    result.push_back(base);
-    result.push_back(subscript);
-    return result;
+void ArrayAccess::VisitChildren(ChildVisitor *v) {
+    LValue::VisitChildren(v);
+    v->Visit(base);
+    v->Visit(subscript);
 }
 
 FieldAccess::FieldAccess(Expr *b, Identifier *f)
@@ -95,11 +127,10 @@ FieldAccess::FieldAccess(Expr *b, Identifier *f)
     (field = f)->SetParent(this);
 }
 
-vector<Node *> FieldAccess::children() {
-    vector<Node *> result = LValue::children();
-    result.push_back(base);
-    result.push_back(field);
-    return result;
+void FieldAccess::VisitChildren(ChildVisitor *v) {
+    LValue::VisitChildren(v);
+    v->Visit(base);
+    v->Visit(field);
 }
 
 Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr *> *a) : Expr(loc) {
@@ -112,12 +143,11 @@ Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr *> *a) : Expr(loc) {
     (actuals = a)->SetParentAll(this);
 }
 
-vector<Node *> Call::children() {
-    vector<Node *> result = Expr::children();
-    result.push_back(base);
-    result.push_back(field);
-    result.insert(result.end(), actuals->elems.begin(), actuals->elems.end());
-    return result;
+void Call::VisitChildren(ChildVisitor *v) {
+    Expr::VisitChildren(v);
+    v->Visit(base);
+    v->Visit(field);
+    v->VisitAll(actuals);
 }
 
 NewExpr::NewExpr(yyltype loc, NamedType *c) : Expr(loc) {
@@ -125,10 +155,9 @@ NewExpr::NewExpr(yyltype loc, NamedType *c) : Expr(loc) {
     (cType = c)->SetParent(this);
 }
 
-vector<Node *> NewExpr::children() {
-    vector<Node *> result = Expr::children();
-    result.push_back(cType);
-    return result;
+void NewExpr::VisitChildren(ChildVisitor *v) {
+    Expr::VisitChildren(v);
+    v->Visit(cType);
 }
 
 void NewExpr::CheckType() {
@@ -153,11 +182,10 @@ NewArrayExpr::NewArrayExpr(yyltype loc, Expr *sz, Type *et) : Expr(loc) {
     (elemType = et)->SetParent(this);
 }
 
-vector<Node *> NewArrayExpr::children() {
-    vector<Node *> result = Expr::children();
-    result.push_back(size);
-    result.push_back(elemType);
-    return result;
+void NewArrayExpr::VisitChildren(ChildVisitor *v) {
+    Expr::VisitChildren(v);
+    v->Visit(size);
+    v->Visit(elemType);
 }
 
 void NewArrayExpr::CheckType() {
@@ -170,23 +198,16 @@ Location *NewArrayExpr::cgen() {
     // printf("%s\n",size->cachedType->GetName());
     // Assert(intConstant);
     Location *numElement = size->cgen();
-    // check size ifz numElement < 1 goto label
-    Location *one1 = CodeGenerator::instance->GenLoadConstant(1);
+    // branch to the shared error stub if numElement < 1
     Location *szLessOrEqualZero =
-        CodeGenerator::instance->GenBinaryOp("<", numElement, one1);
-    const char *label = CodeGenerator::instance->NewLabel();
-    CodeGenerator::instance->GenIfZ(szLessOrEqualZero, label);
-    CodeGenerator::instance->GenError(ArraySizeNeg);
-    // correct label below
-    CodeGenerator::instance->GenLabel(label);
-    Location *one = CodeGenerator::instance->GenLoadConstant(1);
+        CodeGenerator::instance->GenBinaryOp("<", numElement, 1);
+    CodeGenerator::instance->GenError(ArraySizeNeg, szLessOrEqualZero);
     Location *totalSz =
-        CodeGenerator::instance->GenBinaryOp("+", one, numElement);
-    Location *four = CodeGenerator::instance->GenLoadConstant(4);
-    totalSz = CodeGenerator::instance->GenBinaryOp("*", totalSz, four);
+        CodeGenerator::instance->GenBinaryOp("+", numElement, 1);
+    totalSz = CodeGenerator::instance->GenBinaryOp("*", totalSz, 4);
     Location *alloc = CodeGenerator::instance->GenBuiltInCall(Alloc, totalSz);
     CodeGenerator::instance->GenStore(alloc, numElement, 0);
-    Location *rv = CodeGenerator::instance->GenBinaryOp("+", alloc, four);
+    Location *rv = CodeGenerator::instance->GenBinaryOp("+", alloc, 4);
     return rv;
 }
 
@@ -198,10 +219,9 @@ void AssignExpr::Emit() {
 }
 
 void FieldAccess::genBaseAndOffSet() {
-    VarDecl *fieldDecl = NULL;
+    VarDecl *fieldDecl = dynamic_cast<VarDecl *>(field->GetDecl());
+    Assert(fieldDecl);
     if (base == NULL) {
-        fieldDecl = dynamic_cast<VarDecl *>(scope->GetSymbol(field->GetName()));
-        Assert(fieldDecl);
         if (fieldDecl->location) {
             // local
             baseLocation = fieldDecl->location;
@@ -212,14 +232,6 @@ void FieldAccess::genBaseAndOffSet() {
             offSet = fieldDecl->offset;
         }
     } else {
-        Decl *baseDeclNode =
-            StackNode::namedTypeTable->GetSymbol(base->cachedType->GetName());
-        Assert(baseDeclNode);
-        ClassDecl *baseDecl = dynamic_cast<ClassDecl *>(baseDeclNode);
-        Assert(baseDecl);
-        fieldDecl =
-            dynamic_cast<VarDecl *>(baseDecl->GetFields(field->GetName()));
-        Assert(fieldDecl);
         Assert(fieldDecl->offset);
         Assert(fieldDecl->location == NULL);
         baseLocation = base->cgen();
@@ -228,46 +240,61 @@ void FieldAccess::genBaseAndOffSet() {
 }
 
 Location *FieldAccess::cgen() {
-    // load from baseLocation & offSet
+    // load from baseLocation & offSet, then clear them: loop tests and
+    // unrolled bodies are generated more than once
     Assert(baseLocation == NULL && offSet == 0);
     genBaseAndOffSet();
-    if (offSet == -1)
-        return baseLocation;
-    return CodeGenerator::instance->GenLoad(baseLocation, offSet);
+    Location *result = baseLocation;
+    if (offSet != -1)
+        result = CodeGenerator::instance->GenLoad(baseLocation, offSet);
+    baseLocation = NULL;
+    offSet = 0;
+    return result;
+}
+
+bool AssignExpr::Assigns(VarDecl *a, VarDecl *b) {
+    FieldAccess *access = dynamic_cast<FieldAccess *>(left);
+    VarDecl *var = access ? access->GetLocal() : NULL;
+    return (var && (var == a || var == b)) || Node::Assigns(a, b);
+}
+
+VarDecl *FieldAccess::GetLocal() {
+    if (base)
+        return NULL;
+    VarDecl *decl = dynamic_cast<VarDecl *>(field->GetDecl());
+    if (decl == NULL || decl->location == NULL ||
+        decl->location->GetSegment() != fpRelative)
+        return NULL;
+    return decl;
 }
 
 void FieldAccess::getAssign(Expr *expr) {
     Assert(baseLocation == NULL && offSet == 0);
     Location *rhs = expr->cgen();
     genBaseAndOffSet();
-    if (offSet == -1) {
+    if (offSet == -1)
         CodeGenerator::instance->GenAssign(baseLocation, rhs);
-        return;
-    }
-    CodeGenerator::instance->GenStore(baseLocation, rhs, offSet);
+    else
+        CodeGenerator::instance->GenStore(baseLocation, rhs, offSet);
+    baseLocation = NULL;
+    offSet = 0;
 }
 
 void ArrayAccess::genFinalLocation() {
     Location *baseLocation = base->cgen();
     Location *sub = subscript->cgen();
-    Location *zero = CodeGenerator::instance->GenLoadConstant(0);
-    Location *lessZero = CodeGenerator::instance->GenBinaryOp("<", sub, zero);
+    Location *lessZero = CodeGenerator::instance->GenBinaryOp("<", sub, 0);
     Location *arrayLength = CodeGenerator::instance->GenLoad(baseLocation, -4);
     Location *lessLength =
         CodeGenerator::instance->GenBinaryOp("<", sub, arrayLength);
     Location *greaterOrEqualLength = CodeGenerator::instance->GenBinaryOp(
-        "==", lessLength, zero); // lessLength == 0
+        "==", lessLength, 0); // lessLength == 0
     Location *outOfBoundTest = CodeGenerator::instance->GenBinaryOp(
         "||", lessZero, greaterOrEqualLength);
-    const char *correctLabel = CodeGenerator::instance->NewLabel();
-    CodeGenerator::instance->GenIfZ(outOfBoundTest, correctLabel);
-    CodeGenerator::instance->GenError(ArrayOutOfBound);
-    CodeGenerator::instance->GenLabel(correctLabel);
+    CodeGenerator::instance->GenError(ArrayOutOfBound, outOfBoundTest);
 
     // get index offSet and generate finalLocation
-    Location *four = CodeGenerator::instance->GenLoadConstant(4);
-    Location *totalOffSet =
-        CodeGenerator::instance->GenBinaryOp("*", four, sub);
+    Location *totalOffSet = CodeGenerator::instance->GenBinaryOp("*", sub, 4);
     finalLocation =
         CodeGenerator::instance->GenBinaryOp("+", baseLocation, totalOffSet);
 }
@@ -293,22 +320,27 @@ void Call::genPopParams() {
     CodeGenerator::instance->GenPopParams(numParams * CodeGenerator::VarSize);
 }
 
+Expr *Call::GetLengthBase() {
+    if (base && dynamic_cast<ArrayType *>(base->cachedType))
+        return base;
+    return NULL;
+}
+
 Location *Call::cgen() {
     if (base && dynamic_cast<ArrayType *>(base->cachedType)) {
         // length
-        Assert((string) field->GetName() == "length");
+        Assert(field->GetName() == Intern("length"));
         Location *baseLocation = base->cgen();
         return CodeGenerator::instance->GenLoad(baseLocation, -4);
     }
 
-    FnDecl *fnDecl = NULL;
+    FnDecl *fnDecl = dynamic_cast<FnDecl *>(field->GetDecl());
+    Assert(fnDecl);
     Location *baseLocation = NULL;
     List<Location *> *params = new List<Location *>;
     int offSet = -1;
     // get base location of acall inlcuding implied "this" and class object as base
     if (base == NULL) {
-        fnDecl = dynamic_cast<FnDecl *>(scope->GetSymbol(field->GetName()));
-        Assert(fnDecl);
         if (fnDecl->offset != -1) {
             // implied this
             ifAcall = true;
@@ -317,14 +349,6 @@ Location *Call::cgen() {
         }
     } else {
         ifAcall = true;
-        Decl *baseDeclNode =
-            StackNode::namedTypeTable->GetSymbol(base->cachedType->GetName());
-        // printf("%s\n", base->cachedType->GetName());
-        Assert(baseDeclNode);
-        ClassDecl *baseDecl = dynamic_cast<ClassDecl *>(baseDeclNode);
-        Assert(baseDecl);
-        fnDecl = dynamic_cast<FnDecl *>(baseDecl->GetFields(field->GetName()));
-        Assert(fnDecl);
         Assert(fnDecl->offset != -1);
         baseLocation = base->cgen();
         offSet = fnDecl->offset;
@@ -32,6 +32,9 @@ public:
     Expr() : Stmt() {}
     virtual Location *cgen() { return NULL; }
     virtual void Emit() { cgen(); }
+    // true (with the value) for int/bool/null literals, which code
+    // generation can then fold into an immediate operand
+    virtual bool getConstant(int &v) { return false; }
 };
 
 /* This node type is used for those places where an expression is optional.
@@ -49,6 +52,10 @@ protected:
 public:
     void Check(Context ctx) { cachedType = Type::intType; }
     IntConstant(yyltype loc, int val);
+    virtual bool getConstant(int &v) {
+        v = value;
+        return true;
+    }
     virtual Location *cgen() {
         return CodeGenerator::instance->GenLoadConstant(value);
     }
@@ -74,6 +81,10 @@ protected:
 public:
     void Check(Context ctx) { cachedType = Type::boolType; }
     BoolConstant(yyltype loc, bool val);
+    virtual bool getConstant(int &v) {
+        v = value;
+        return true;
+    }
     virtual Location *cgen() {
         return CodeGenerator::instance->GenLoadConstant(value);
     }
@@ -95,6 +106,10 @@ class NullConstant : public Expr {
 public:
     void Check(Context ctx) { cachedType = Type::nullType; }
     NullConstant(yyltype loc) : Expr(loc) {}
+    virtual bool getConstant(int &v) {
+        v = 0;
+        return true;
+    }
     virtual Location *cgen() {
         return CodeGenerator::instance->GenLoadConstant(0);
     }
@@ -117,12 +132,23 @@ protected:
     Operator *op;
     Expr *left, *right; // left will be NULL if unary
 
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
+    bool isCommutative();
 
 public:
     CompoundExpr(Expr *lhs, Operator *op, Expr *rhs); // for binary
     CompoundExpr(Operator *op, Expr *rhs);            // for unary
+    Expr *GetLeft() { return left; }
+    Expr *GetRight() { return right; }
+    const char *GetOp() { return op->getToken(); }
     virtual Location *cgen() {
+        int value;
+        if (left != NULL && right->getConstant(value))
+            return CodeGenerator::instance->GenBinaryOp(op->getToken(),
+                                                        left->cgen(), value);
+        if (left != NULL && isCommutative() && left->getConstant(value))
+            return CodeGenerator::instance->GenBinaryOp(op->getToken(),
+                                                        right->cgen(), value);
         Location *l = left == NULL ? NULL : left->cgen();
         Location *r = right->cgen();
         if (l == NULL) {
@@ -140,17 +166,18 @@ public:
     void Check(Context ctx) {
         CompoundExpr::Check(ctx);
 
-        if ((left != NULL && isErrorTypeName(left->cachedType->GetName())) ||
-            isErrorTypeName(right->cachedType->GetName())) {
+        if ((left != NULL && left->cachedType->IsError()) ||
+            right->cachedType->IsError()) {
             cachedType = Type::errorType;
             return;
         }
-        if ((left == NULL || "int" == (string) left->cachedType->GetName()) &&
-            "int" == (string) right->cachedType->GetName())
+        if ((left == NULL ||
+             left->cachedType->IsEquivalentTo(Type::intType)) &&
+            right->cachedType->IsEquivalentTo(Type::intType))
             cachedType = Type::intType;
         if ((left == NULL ||
-             "double" == (string) left->cachedType->GetName()) &&
-            "double" == (string) right->cachedType->GetName())
+             left->cachedType->IsEquivalentTo(Type::doubleType)) &&
+            right->cachedType->IsEquivalentTo(Type::doubleType))
             cachedType = Type::doubleType;
 
         if (!cachedType) {
@@ -189,8 +216,8 @@ public:
         CompoundExpr::Check(ctx);
         cachedType = Type::boolType;
 
-        if (!isErrorTypeName(left->cachedType->GetName()) &&
-            !isErrorTypeName(right->cachedType->GetName())) {
+        if (!left->cachedType->IsError() &&
+            !right->cachedType->IsError()) {
             if (!(typeMatchParent(left->cachedType, right->cachedType) ||
                   typeMatchParent(
                       right->cachedType,
@@ -203,20 +230,27 @@ public:
         : CompoundExpr(lhs, op, rhs) {}
     const char *GetPrintNameForNode() { return "EqualityExpr"; }
     virtual Location *cgen() {
-        Location *l = left->cgen();
-        Location *r = right->cgen();
         char *opStr = op->getToken();
         Location *equal = NULL;
+        int value;
         if (left->cachedType == Type::stringType) {
+            Location *l = left->cgen();
+            Location *r = right->cgen();
             equal = CodeGenerator::instance->GenBuiltInCall(StringEqual, l, r);
+        } else if (right->getConstant(value)) {
+            equal = CodeGenerator::instance->GenBinaryOp("==", left->cgen(),
+                                                         value);
+        } else if (left->getConstant(value)) {
+            equal = CodeGenerator::instance->GenBinaryOp("==", right->cgen(),
+                                                         value);
         } else {
+            Location *l = left->cgen();
+            Location *r = right->cgen();
             equal = CodeGenerator::instance->GenBinaryOp("==", l, r);
         }
         if (strcmp(opStr, "==") == 0)
             return equal;
-        Location *zero = CodeGenerator::instance->GenLoadConstant(0);
-        Location *rv = CodeGenerator::instance->GenBinaryOp("==", equal, zero);
-        return rv;
+        return CodeGenerator::instance->GenBinaryOp("==", equal, 0);
     }
 };
 
@@ -225,11 +259,11 @@ public:
     void Check(Context ctx) {
         CompoundExpr::Check(ctx);
         cachedType = Type::boolType;
-        if ((left == NULL || !isErrorTypeName(left->cachedType->GetName())) &&
-            !isErrorTypeName(right->cachedType->GetName())) {
+        if ((left == NULL || !left->cachedType->IsError()) &&
+            !right->cachedType->IsError()) {
             if ((left != NULL &&
-                 (string) left->cachedType->GetName() != "bool") ||
-                (string) right->cachedType->GetName() != "bool") {
+                 !left->cachedType->IsEquivalentTo(Type::boolType)) ||
+                !right->cachedType->IsEquivalentTo(Type::boolType)) {
                 if (left)
                     ReportError::IncompatibleOperands(op, left->cachedType,
                                                       right->cachedType);
@@ -247,9 +281,7 @@ public:
         if (left == NULL) {
             Assert(strcmp(op->getToken(), "!") == 0);
             Location *r = right->cgen();
-            Location *zero = CodeGenerator::instance->GenLoadConstant(0);
-            Location *rv = CodeGenerator::instance->GenBinaryOp("==", r, zero);
-            return rv;
+            return CodeGenerator::instance->GenBinaryOp("==", r, 0);
         } else {
             return CompoundExpr::cgen();
         }
@@ -261,8 +293,8 @@ public:
     void Check(Context ctx) {
         CompoundExpr::Check(ctx);
         cachedType = left->cachedType;
-        if (!isErrorTypeName(left->cachedType->GetName()) &&
-            !isErrorTypeName(right->cachedType->GetName())) {
+        if (!left->cachedType->IsError() &&
+            !right->cachedType->IsError()) {
             if (!typeMatchParent(right->cachedType, left->cachedType))
                 ReportError::IncompatibleOperands(op, left->cachedType,
                                                   right->cachedType);
@@ -271,6 +303,7 @@ public:
     AssignExpr(Expr *lhs, Operator *op, Expr *rhs)
         : CompoundExpr(lhs, op, rhs) {}
     const char *GetPrintNameForNode() { return "AssignExpr"; }
+    bool Assigns(VarDecl *a, VarDecl *b);
     virtual Location *cgen() {
         Assert(false);
         return NULL;
@@ -295,8 +328,7 @@ public:
             cachedType = Type::errorType;
 
         } else {
-            cachedType = new NamedTypeNoLoc(
-                new Identifier({0, 0, 0, 0, 0, 0}, ctx.outer_class->GetName()));
+            cachedType = Type::Named(ctx.outer_class->GetName());
         }
     }
     Location *cgen() { return new Location(fpRelative, 4, "this"); }
@@ -306,7 +338,7 @@ class ArrayAccess : public LValue {
 protected:
     Expr *base, *subscript;
 
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
     // for IR
     Location *finalLocation = NULL;
@@ -318,20 +350,20 @@ protected:
 public:
     void Check(Context ctx) {
         LValue::Check(ctx);
-        if (!isErrorTypeName(base->cachedType->GetName())) {
-            if (!isArrayTypeName(base->cachedType->GetName())) {
+        if (!base->cachedType->IsError()) {
+            if (!base->cachedType->IsArray()) {
                 ReportError::BracketsOnNonArray(base);
                 cachedType = Type::errorType;
             } else {
                 cachedType =
-                    dynamic_cast<ArrayType *>(base->cachedType)->elemType;
+                    dynamic_cast<ArrayType *>(base->cachedType)->GetElemType();
             }
         } else {
             cachedType = Type::errorType;
         }
 
-        if (!isErrorTypeName(subscript->cachedType->GetName()) &&
-            (string) subscript->cachedType->GetName() != "int") {
+        if (!subscript->cachedType->IsError() &&
+            !subscript->cachedType->IsEquivalentTo(Type::intType)) {
             ReportError::SubscriptNotInteger(subscript);
         }
     }
@@ -365,12 +397,13 @@ protected:
 
             } else {
                 cachedType = src->type;
+                field->SetDecl(src);
             }
 
         } else {
             //looks like need warp to another scope
 
-            if (isErrorTypeName(base->cachedType->GetName())) {
+            if (base->cachedType->IsError()) {
                 cachedType = Type::errorType;
             } else {
 
@@ -396,16 +429,15 @@ protected:
                         } else if (dynamic_cast<VarDecl *>(field_decl_node)) {
                             cachedType =
                                 dynamic_cast<VarDecl *>(field_decl_node)->type;
+                            field->SetDecl(field_decl_node);
 
                             if (!ctx.in_class)
                                 ReportError::InaccessibleField(
                                     field, base->cachedType);
                             else {
-                                Identifier tmp({0, 0, 0, 0, 0, 0},
-                                               ctx.outer_class->GetName());
-                                NamedTypeNoLoc outer_type(&tmp);
-                                if (!typeMatchParent(&outer_type,
-                                                     base->cachedType))
+                                if (!typeMatchParent(
+                                        Type::Named(ctx.outer_class->GetName()),
+                                        base->cachedType))
                                     ReportError::InaccessibleField(
                                         field, base->cachedType);
                             }
@@ -430,7 +462,7 @@ protected:
         }
     }
 
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
     // For IR
     Location *baseLocation = NULL;
@@ -441,6 +473,9 @@ public:
     FieldAccess(Expr *base, Identifier *field); //ok to pass NULL base
     Location *cgen();
     void getAssign(Expr *expr);
+    // The local variable or parameter this names, NULL if it is anything
+    // else (a field, a global) that code elsewhere could change
+    VarDecl *GetLocal();
 };
 
 /* Like field access, call is used both for qualified base.field()
@@ -453,7 +488,7 @@ protected:
     Identifier *field;
     List<Expr *> *actuals;
 
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
     void Check(Context ctx) {
         Expr::Check(ctx);
         bool check_sig_match = false;
@@ -471,11 +506,12 @@ protected:
                 cachedType = src->returnType;
                 check_sig_match = true;
                 target = src->formals;
+                field->SetDecl(src);
             }
 
         } else {
             //looks like need warp to another scope
-            if (isErrorTypeName(base->cachedType->GetName())) {
+            if (base->cachedType->IsError()) {
                 cachedType = Type::errorType;
             } else {
 
@@ -495,6 +531,7 @@ protected:
                             cachedType = field_decl_node->returnType;
                             check_sig_match = true;
                             target = field_decl_node->formals;
+                            field->SetDecl(field_decl_node);
                         } else {
                             ReportError::FieldNotFoundInBase(field,
                                                              base->cachedType);
@@ -511,6 +548,7 @@ protected:
                             check_sig_match = true;
                             target = dynamic_cast<FnDecl *>(field_decl_node)
                                          ->formals;
+                            field->SetDecl(field_decl_node);
                         } else if (dynamic_cast<VarDecl *>(field_decl_node)) {
                             ReportError::FieldNotFoundInBase(field,
                                                              base->cachedType);
@@ -525,7 +563,7 @@ protected:
 
                 } else if (dynamic_cast<ArrayType *>(base->cachedType)) {
                     //array type
-                    if ((string) field->GetName() != "length") {
+                    if (field->GetName() != Intern("length")) {
                         ReportError::FieldNotFoundInBase(field,
                                                          base->cachedType);
                         cachedType = Type::errorType;
@@ -569,15 +607,18 @@ public:
     Call(yyltype loc, Expr *base, Identifier *field, List<Expr *> *args);
 
     Location *cgen();
+    // The array of an array.length() call, NULL for other calls
+    Expr *GetLengthBase();
 };
 
 class NewExpr : public Expr {
 protected:
     NamedType *cType;
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     void Check(Context ctx) {
+        CheckType();
         Expr::Check(ctx);
         cachedType = cType;
         if (!cachedType)
@@ -593,17 +634,18 @@ protected:
     Expr *size;
     Type *elemType;
 
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     void Check(Context ctx) {
+        CheckType();
         Expr::Check(ctx);
-        if ((!isErrorTypeName(size->cachedType->GetName())) &&
-            (string) size->cachedType->GetName() != "int") {
+        if ((!size->cachedType->IsError()) &&
+            !size->cachedType->IsEquivalentTo(Type::intType)) {
             ReportError::NewArraySizeNotInteger(size);
         }
 
-        cachedType = new ArrayTypeNoLoc({0, 0, 0, 0, 0, 0}, elemType);
+        cachedType = Type::ArrayOf(elemType->Canonical());
     }
     NewArrayExpr(yyltype loc, Expr *sizeExpr, Type *elemType);
     void CheckType();
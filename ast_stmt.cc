@@ -7,8 +7,12 @@
 #include "ast_expr.h"
 #include "ast_type.h"
 #include "hashtable.h"
+#include <algorithm>
+#include <limits.h>
 #include <set>
+#include <stdlib.h>
 #include <string>
+#include <time.h>
 using std::set;
 using std::string;
 Program::Program(List<Decl *> *d) {
@@ -16,6 +20,12 @@ Program::Program(List<Decl *> *d) {
     (decls = d)->SetParentAll(this);
 }
 
+static double Seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 class Context;
 void Program::Check() {
     /* pp3: here is where the semantic analyzer is kicked off.
@@ -26,36 +36,41 @@ void Program::Check() {
      *      and polymorphism in the node classes.
      */
 
+    double start = Seconds();
     StackNode::root = new StackNode(NULL);
     StackNode::namedTypeTable = new StackNode(NULL);
+    // First the declarations, none of which look into function bodies.
     // Add global decls to locate the classes and interfaces
     this->AddGlobal();
 
     // Patch all wrong type to unknown type and check extends type of class
     this->CheckType();
 
+    // number the class hierarchy for the subtype checks, which start
+    // with the override checks in ResolveConflict
+    ClassDecl::NumberHierarchy(decls);
+
     // visited is only for resolving circular extend in classes
     set<Node *> *visited = new set<Node *>();
-    // mainly in declarations and stmtblock
+    // scopes of classes and functions, class members
     this->ResolveConflict(visited);
+    double declared = Seconds();
 
     //argument for context passing (in loop? rettype?)
     Context ctx;
 
-    /* //recursive approach */
-
-    /* //mark duplicate node as error node. */
-    //this->resolve_conflict_decl(ctx);
-
-    //annotate source node
+    // Then one walk over everything else: scopes and declared types of
+    // the statements and expressions are set up as it reaches them.
     //report error for undeclared identifiers and marked as error type.
     //except for field access right side, T_This and
 
-    for (auto &i : children()) {
+    ForEachChild([&](Node *i) {
         if (i) {
             i->Check(ctx);
         }
-    }
+    });
+    PrintDebug("sema", "declarations %.3f ms, checking %.3f ms",
+               (declared - start) * 1e3, (Seconds() - declared) * 1e3);
     return;
 }
 
@@ -80,20 +95,19 @@ void Program::Emit() {
     }
     // local vars locations are all at the beginning so we can combine
     // this with emit
-    for (auto &i : children()) {
-        VarDecl *var = dynamic_cast<VarDecl *>(i);
+    for (int i = 0; i < decls->NumElements(); i++) {
+        VarDecl *var = dynamic_cast<VarDecl *>(decls->Nth(i));
         // Fn or Class
         if (var == NULL) {
-            i->Emit();
+            decls->Nth(i)->Emit();
         }
     }
     CodeGenerator::instance->DoFinalCodeGen();
 }
 
-vector<Node *> Program::children() {
-    vector<Node *> result = Node::children();
-    result.assign(decls->elems.begin(), decls->elems.end());
-    return result;
+void Program::VisitChildren(ChildVisitor *v) {
+    Node::VisitChildren(v);
+    v->VisitAll(decls);
 }
 
 StmtBlock::StmtBlock(List<VarDecl *> *d, List<Stmt *> *s) {
@@ -102,33 +116,28 @@ StmtBlock::StmtBlock(List<VarDecl *> *d, List<Stmt *> *s) {
     (stmts = s)->SetParentAll(this);
 }
 
-vector<Node *> StmtBlock::children() {
-    vector<Node *> result = Stmt::children();
-    result.assign(decls->elems.begin(), decls->elems.end());
-    result.insert(result.end(), stmts->elems.begin(), stmts->elems.end());
-    return result;
+void StmtBlock::VisitChildren(ChildVisitor *v) {
+    Stmt::VisitChildren(v);
+    v->VisitAll(decls);
+    v->VisitAll(stmts);
 }
 
 void StmtBlock::Emit() {
-    for (auto &i : children()) {
+    ForEachChild([](Node *i) {
+        i->MarkSourceLine();
         i->Emit();
-    }
+    });
 }
 
-void StmtBlock::ResolveConflict(set<Node *> *visited) {
-    if (scope == NULL) {
-        scope = new StackNode(parent->scope);
-        for (int i = 0; i < decls->NumElements(); i++) {
-            VarDecl *decl = decls->Nth(i);
-            scope->AddSymbol(decl->GetName(), decl);
-        }
-    }
-
-    for (int i = 0; i < stmts->NumElements(); i++) {
-        Stmt *stmt = stmts->Nth(i);
-        stmt->ResolveConflict(visited);
+void StmtBlock::Check(Context ctx) {
+    // the block's own scope, with its variables in it
+    scope = new StackNode(parent->scope);
+    for (int i = 0; i < decls->NumElements(); i++) {
+        VarDecl *decl = decls->Nth(i);
+        decl->CheckType();
+        scope->AddSymbol(decl->GetName(), decl);
     }
-    /* Node::ResolveConflict(visited); */
+    Stmt::Check(ctx);
 }
 
 ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b) {
@@ -137,11 +146,10 @@ ConditionalStmt::ConditionalStmt(Expr *t, Stmt *b) {
     (body = b)->SetParent(this);
 }
 
-vector<Node *> ConditionalStmt::children() {
-    vector<Node *> result = Stmt::children();
-    result.push_back(test);
-    result.push_back(body);
-    return result;
+void ConditionalStmt::VisitChildren(ChildVisitor *v) {
+    Stmt::VisitChildren(v);
+    v->Visit(test);
+    v->Visit(body);
 }
 
 ForStmt::ForStmt(Expr *i, Expr *t, Expr *s, Stmt *b) : LoopStmt(t, b) {
@@ -150,25 +158,41 @@ ForStmt::ForStmt(Expr *i, Expr *t, Expr *s, Stmt *b) : LoopStmt(t, b) {
     (step = s)->SetParent(this);
 }
 
-vector<Node *> ForStmt::children() {
-    vector<Node *> result = LoopStmt::children();
-    result.push_back(init);
-    result.push_back(step);
-    return result;
+void ForStmt::VisitChildren(ChildVisitor *v) {
+    LoopStmt::VisitChildren(v);
+    v->Visit(init);
+    v->Visit(step);
 }
 
-void ForStmt::Emit() {
-    init->Emit();
-    const char *beginLabel = CodeGenerator::instance->NewLabel();
+/* Method: EmitLoop
+ * ----------------
+ * The loop is rotated into a guarded do-while:
+ *
+ *         IfZ test Goto break
+ *     top:
+ *         body; step
+ *         IfNZ test Goto top
+ *     break:
+ *
+ * so an iteration runs one conditional branch instead of the test's
+ * branch plus a Goto back to it. The test is generated twice.
+ */
+void LoopStmt::EmitLoop(Expr *step) {
+    const char *topLabel = CodeGenerator::instance->NewLabel();
     const char *breakLabel = CodeGenerator::instance->NewLabel();
-    CodeGenerator::instance->GenLabel(beginLabel);
-    Location *testLocation = test->cgen();
-    CodeGenerator::instance->GenIfZ(testLocation, breakLabel);
+    test->MarkSourceLine();
+    CodeGenerator::instance->GenIfZ(test->cgen(), breakLabel);
+    CodeGenerator::instance->GenLabel(topLabel);
     CodeGenerator::instance->loopEndLabels->push(
         breakLabel); // labels recorded for break
+    body->MarkSourceLine();
     body->Emit();
-    step->Emit();
-    CodeGenerator::instance->GenGoto(beginLabel);
+    if (step) {
+        step->MarkSourceLine();
+        step->Emit();
+    }
+    test->MarkSourceLine();
+    CodeGenerator::instance->GenIfNZ(test->cgen(), topLabel);
     Assert(CodeGenerator::instance->loopEndLabels->size());
     const char *tmp = CodeGenerator::instance->loopEndLabels->top();
     Assert(strcmp(tmp, breakLabel) == 0);
@@ -176,22 +200,183 @@ void ForStmt::Emit() {
     CodeGenerator::instance->GenLabel(breakLabel);
 }
 
+void ForStmt::Emit() {
+    init->MarkSourceLine();
+    init->Emit();
+    if (!EmitUnrolled())
+        EmitLoop(step);
+}
+
+// Unrolling may grow a loop body, step included, to this many Tac
+// instructions; a loop running at most FullUnrollTrips times whose
+// iterations all fit is unrolled completely.
+static const int UnrollBudget = 32;
+static const int FullUnrollTrips = 8;
+
+// Gives the locals declared anywhere in node their frame slots.
+static void EmitLocals(Node *node) {
+    if (VarDecl *var = dynamic_cast<VarDecl *>(node)) {
+        var->Emit();
+        return;
+    }
+    node->ForEachChild([](Node *child) {
+        if (child)
+            EmitLocals(child);
+    });
+}
+
+// The local variable expr names, if it is a plain use of one.
+static VarDecl *LocalOf(Expr *expr) {
+    FieldAccess *access = dynamic_cast<FieldAccess *>(expr);
+    return access ? access->GetLocal() : NULL;
+}
+
+/* Method: EmitUnrolled
+ * --------------------
+ * A counted loop is "for (i = start; i < bound; i = i + 1) body" with
+ * i a local variable, < or <= (or != when start and bound are constants
+ * and start <= bound), and a bound that is a constant, a local variable
+ * or the length of a local array, none of which body assigns to. As
+ * locals can only be changed by the function itself, the bound is then
+ * loop invariant.
+ *
+ * The body is generated once just to count its Tac instructions. The
+ * factor is -unroll=N (default 4), cut down so that the unrolled body
+ * stays within UnrollBudget. The loop becomes
+ *
+ *         limit = bound - (factor-1)
+ *         IfZ i < limit Goto rest
+ *     top:
+ *         body; step; ... body; step       (factor times)
+ *         IfNZ i < limit Goto top
+ *     rest:
+ *         the loop as usual, for the last few iterations
+ *     break:
+ *
+ * (bound - (factor-2) for a <= test). Subtracting from the bound rather
+ * than adding to i can't overflow as long as the bound is at least
+ * INT_MIN + factor-1: a constant bound is checked here, a variable one
+ * goes straight to rest if it is smaller. An array length can't be.
+ *
+ * The body is generated several times over, so the locals declared in
+ * it get their frame slots once, up front, and every copy shares them.
+ */
+bool ForStmt::EmitUnrolled() {
+    const char *factorOption = GetOptionValue("unroll");
+    int factor = factorOption ? atoi(factorOption) : 4;
+    if (!IsOptionOn("O") || factor < 2)
+        return false;
+
+    AssignExpr *initAssign = dynamic_cast<AssignExpr *>(init);
+    VarDecl *var = initAssign ? LocalOf(initAssign->GetLeft()) : NULL;
+    CompoundExpr *compare = dynamic_cast<RelationalExpr *>(test);
+    if (compare == NULL)
+        compare = dynamic_cast<EqualityExpr *>(test);
+    if (var == NULL || compare == NULL || LocalOf(compare->GetLeft()) != var)
+        return false;
+    string op = compare->GetOp();
+    if (op != "<" && op != "<=" && op != "!=")
+        return false;
+
+    AssignExpr *stepAssign = dynamic_cast<AssignExpr *>(step);
+    ArithmeticExpr *increment =
+        stepAssign ? dynamic_cast<ArithmeticExpr *>(stepAssign->GetRight()) : NULL;
+    int one;
+    if (increment == NULL || LocalOf(stepAssign->GetLeft()) != var ||
+        strcmp(increment->GetOp(), "+") != 0 || increment->GetLeft() == NULL ||
+        !((LocalOf(increment->GetLeft()) == var &&
+           increment->GetRight()->getConstant(one)) ||
+          (LocalOf(increment->GetRight()) == var &&
+           increment->GetLeft()->getConstant(one))) ||
+        one != 1)
+        return false;
+
+    Expr *bound = compare->GetRight();
+    VarDecl *boundVar = NULL;
+    int start, end;
+    bool constantBound = bound->getConstant(end);
+    if (!constantBound) {
+        Call *call = dynamic_cast<Call *>(bound);
+        boundVar = LocalOf(call ? call->GetLengthBase() : bound);
+        if (boundVar == NULL)
+            return false;
+    }
+    if (body->Assigns(var, boundVar))
+        return false;
+    bool constantTrips = constantBound && initAssign->GetRight()->getConstant(start);
+    if (op == "!=" && !(constantTrips && start <= end))
+        return false;
+
+    CodeGenerator *cg = CodeGenerator::instance;
+    EmitLocals(body);
+    const char *breakLabel = cg->NewLabel();
+    cg->loopEndLabels->push(breakLabel); // labels recorded for break
+    int mark = cg->NumInstructions(), temps = cg->localVarNum;
+    body->Emit();
+    step->Emit();
+    int size = cg->NumInstructions() - mark;
+    cg->DiscardFrom(mark);
+    cg->localVarNum = temps;
+
+    long long trips =
+        constantTrips ? std::max(0LL, (long long) end - start + (op == "<=")) : -1;
+    bool full = constantTrips && trips <= FullUnrollTrips &&
+                trips * size <= UnrollBudget;
+    factor = std::min(factor, UnrollBudget / std::max(size, 1));
+    int slack = factor - (op == "<=" ? 2 : 1);
+    if (!full && (factor < 2 || (constantBound && end < INT_MIN + slack))) {
+        cg->loopEndLabels->pop();
+        return false;
+    }
+
+    const char *topLabel = NULL, *restLabel = NULL;
+    Location *limit = NULL; // bound - slack, unless the bound is a constant
+    auto unrolledTest = [&]() {
+        return limit ? cg->GenBinaryOp("<", var->location, limit)
+                     : cg->GenBinaryOp("<", var->location, end - slack);
+    };
+    if (!full) {
+        topLabel = cg->NewLabel();
+        restLabel = cg->NewLabel();
+        test->MarkSourceLine();
+        if (!constantBound)
+            limit = UnrolledLimit(bound, slack, restLabel);
+        cg->GenIfZ(unrolledTest(), restLabel);
+        cg->GenLabel(topLabel);
+    }
+    for (int i = 0; i < (full ? trips : factor); i++) {
+        body->MarkSourceLine();
+        body->Emit();
+        step->MarkSourceLine();
+        step->Emit();
+    }
+    if (!full) {
+        test->MarkSourceLine();
+        cg->GenIfNZ(unrolledTest(), topLabel);
+    }
+    Assert(strcmp(cg->loopEndLabels->top(), breakLabel) == 0);
+    cg->loopEndLabels->pop();
+    if (!full) {
+        cg->GenLabel(restLabel);
+        EmitLoop(step);
+    }
+    cg->GenLabel(breakLabel);
+    return true;
+}
+
+// bound - slack for a variable bound, computed once before the loop;
+// a bound below INT_MIN + slack branches to rest instead.
+Location *ForStmt::UnrolledLimit(Expr *bound, int slack, const char *rest) {
+    CodeGenerator *cg = CodeGenerator::instance;
+    Location *b = bound->cgen();
+    if (dynamic_cast<Call *>(bound) == NULL) // not a length
+        cg->GenIfNZ(cg->GenBinaryOp("<", b, INT_MIN + slack), rest);
+    return cg->GenBinaryOp("+", b, -slack);
+}
+
 void WhileStmt::Emit() {
     // same as for stmt without step and init
-    const char *beginLabel = CodeGenerator::instance->NewLabel();
-    const char *breakLabel = CodeGenerator::instance->NewLabel();
-    CodeGenerator::instance->GenLabel(beginLabel);
-    Location *testLocation = test->cgen();
-    CodeGenerator::instance->GenIfZ(testLocation, breakLabel);
-    CodeGenerator::instance->loopEndLabels->push(
-        breakLabel); // labels recorded for break
-    body->Emit();
-    CodeGenerator::instance->GenGoto(beginLabel);
-    Assert(CodeGenerator::instance->loopEndLabels->size());
-    const char *tmp = CodeGenerator::instance->loopEndLabels->top();
-    Assert(strcmp(tmp, breakLabel) == 0);
-    CodeGenerator::instance->loopEndLabels->pop();
-    CodeGenerator::instance->GenLabel(breakLabel);
+    EmitLoop(NULL);
 }
 
 void BreakStmt::Emit() {
@@ -206,11 +391,9 @@ IfStmt::IfStmt(Expr *t, Stmt *tb, Stmt *eb) : ConditionalStmt(t, tb) {
         elseBody->SetParent(this);
 }
 
-vector<Node *> IfStmt::children() {
-    vector<Node *> result = ConditionalStmt::children();
-    result.push_back(elseBody);
-
-    return result;
+void IfStmt::VisitChildren(ChildVisitor *v) {
+    ConditionalStmt::VisitChildren(v);
+    v->Visit(elseBody);
 }
 
 void IfStmt::Emit() {
@@ -218,15 +401,19 @@ void IfStmt::Emit() {
     if (elseBody)
         elseLabel = CodeGenerator::instance->NewLabel();
     const char *endLabel = CodeGenerator::instance->NewLabel();
+    test->MarkSourceLine();
     Location *testLocation = test->cgen();
     if (elseBody) {
         CodeGenerator::instance->GenIfZ(testLocation, elseLabel);
+        body->MarkSourceLine();
         body->Emit();
         CodeGenerator::instance->GenGoto(endLabel);
         CodeGenerator::instance->GenLabel(elseLabel);
+        elseBody->MarkSourceLine();
         elseBody->Emit();
     } else {
         CodeGenerator::instance->GenIfZ(testLocation, endLabel);
+        body->MarkSourceLine();
         body->Emit();
     }
     CodeGenerator::instance->GenLabel(endLabel);
@@ -237,10 +424,9 @@ ReturnStmt::ReturnStmt(yyltype loc, Expr *e) : Stmt(loc) {
     (expr = e)->SetParent(this);
 }
 
-vector<Node *> ReturnStmt::children() {
-    vector<Node *> result = Stmt::children();
-    result.push_back(expr);
-    return result;
+void ReturnStmt::VisitChildren(ChildVisitor *v) {
+    Stmt::VisitChildren(v);
+    v->Visit(expr);
 }
 
 void ReturnStmt::Emit() {
@@ -257,11 +443,9 @@ PrintStmt::PrintStmt(List<Expr *> *a) {
     (args = a)->SetParentAll(this);
 }
 
-vector<Node *> PrintStmt::children() {
-    vector<Node *> result = Stmt::children();
-    result.insert(result.end(), args->elems.begin(), args->elems.end());
-
-    return result;
+void PrintStmt::VisitChildren(ChildVisitor *v) {
+    Stmt::VisitChildren(v);
+    v->VisitAll(args);
 }
 
 void PrintStmt::Check(Context ctx) {
@@ -270,12 +454,11 @@ void PrintStmt::Check(Context ctx) {
     int c = 0;
     for (auto &i : args->elems) {
         c++;
-        //if(isErrorTypeName(i->c))
-        if (isErrorTypeName(i->cachedType->GetName()))
+        if (i->cachedType->IsError())
             continue;
-        if ((string) i->cachedType->GetName() == "int" ||
-            (string) i->cachedType->GetName() == "bool" ||
-            (string) i->cachedType->GetName() == "string")
+        if (i->cachedType->IsEquivalentTo(Type::intType) ||
+            i->cachedType->IsEquivalentTo(Type::boolType) ||
+            i->cachedType->IsEquivalentTo(Type::stringType))
             continue;
 
         ReportError::PrintArgMismatch(i, c, i->cachedType);
@@ -284,14 +467,15 @@ void PrintStmt::Check(Context ctx) {
 
 void PrintStmt::Emit() {
     for (auto &i : args->elems) {
+        i->MarkSourceLine();
         // printf("%s\n", i->cachedType->GetName());
-        if ((string) i->cachedType->GetName() == "int") {
+        if (i->cachedType->IsEquivalentTo(Type::intType)) {
             CodeGenerator::instance->GenBuiltInCall(PrintInt, i->cgen(), NULL);
         }
-        if ((string) i->cachedType->GetName() == "bool") {
+        if (i->cachedType->IsEquivalentTo(Type::boolType)) {
             CodeGenerator::instance->GenBuiltInCall(PrintBool, i->cgen(), NULL);
         }
-        if ((string) i->cachedType->GetName() == "string") {
+        if (i->cachedType->IsEquivalentTo(Type::stringType)) {
             CodeGenerator::instance->GenBuiltInCall(PrintString, i->cgen(),
                                                     NULL);
         }
@@ -300,8 +484,8 @@ void PrintStmt::Emit() {
 
 void ConditionalStmt::Check(Context ctx) {
     Stmt::Check(ctx);
-    if (!(isErrorTypeName(test->cachedType->GetName()) ||
-          (string) test->cachedType->GetName() == "bool")) {
+    if (!(test->cachedType->IsError() ||
+          test->cachedType->IsEquivalentTo(Type::boolType))) {
         ReportError::TestNotBoolean(test);
     }
 }
@@ -312,7 +496,7 @@ void ReturnStmt::Check(Context ctx) {
         if (!typeMatchParent(expr->cachedType, ctx.rettype))
             ReportError::ReturnMismatch(this, expr->cachedType, ctx.rettype);
     } else {
-        if ((string) ctx.rettype->GetName() != "void")
+        if (!ctx.rettype->IsEquivalentTo(Type::voidType))
             ReportError::ReturnMismatch(this, Type::voidType, ctx.rettype);
     }
 }
\ No newline at end of file
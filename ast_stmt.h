@@ -23,7 +23,7 @@ class Expr;
 class Program : public Node {
 protected:
     List<Decl *> *decls;
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     Program(List<Decl *> *declList);
@@ -41,11 +41,11 @@ class StmtBlock : public Stmt {
 protected:
     List<VarDecl *> *decls;
     List<Stmt *> *stmts;
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     StmtBlock(List<VarDecl *> *variableDeclarations, List<Stmt *> *statements);
-    void ResolveConflict(set<Node *> *visited);
+    void Check(Context ctx);
     virtual void Emit();
 };
 
@@ -53,7 +53,7 @@ class ConditionalStmt : public Stmt {
 protected:
     Expr *test;
     Stmt *body;
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     void Check(Context ctx);
@@ -68,12 +68,22 @@ public:
         ConditionalStmt::Check(ctx);
     }
     LoopStmt(Expr *testExpr, Stmt *body) : ConditionalStmt(testExpr, body) {}
+
+protected:
+    // Emits the loop with its test at the bottom, guarded by a copy of
+    // the test in front, and step (if not NULL) after the body.
+    void EmitLoop(Expr *step);
 };
 
 class ForStmt : public LoopStmt {
 protected:
     Expr *init, *step;
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
+
+    // Under -O, emits a counted loop (see ast_stmt.cc) unrolled and
+    // returns true; returns false, emitting nothing, for other loops.
+    bool EmitUnrolled();
+    Location *UnrolledLimit(Expr *bound, int slack, const char *rest);
 
 public:
     ForStmt(Expr *init, Expr *test, Expr *step, Stmt *body);
@@ -90,7 +100,7 @@ class IfStmt : public ConditionalStmt {
 protected:
     Stmt *elseBody;
 
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     IfStmt(Expr *test, Stmt *thenBody, Stmt *elseBody);
@@ -111,7 +121,7 @@ public:
 class ReturnStmt : public Stmt {
 protected:
     Expr *expr;
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     void Check(Context ctx);
@@ -122,7 +132,7 @@ public:
 class PrintStmt : public Stmt {
 protected:
     List<Expr *> *args;
-    vector<Node *> children();
+    void VisitChildren(ChildVisitor *v);
 
 public:
     void Check(Context ctx);
@@ -5,6 +5,7 @@
 #include "ast_type.h"
 #include "ast_decl.h"
 #include "scope.h"
+#include "hashtable.h"
 #include <string.h>
  
 /* Class constants
@@ -12,20 +13,59 @@
  * These are public constants for the built-in base types (int, double, etc.)
  * They can be accessed with the syntax Type::intType. This allows you to
  * directly access them and share the built-in types where needed rather that
- * creates lots of copies.
+ * creates lots of copies. Like the other canonical types they live in
+ * Arena::types, so they survive the release of the tree.
  */
 
-Type *Type::intType    = new Type("int");
-Type *Type::doubleType = new Type("double");
-Type *Type::voidType   = new Type("void");
-Type *Type::boolType   = new Type("bool");
-Type *Type::nullType   = new Type("null");
-Type *Type::stringType = new Type("string");
-Type *Type::errorType  = new Type("#error");//since error could also be a type name we somehow need to separate them
+Type *Type::intType    = new (Arena::types) Type("int");
+Type *Type::doubleType = new (Arena::types) Type("double");
+Type *Type::voidType   = new (Arena::types) Type("void");
+Type *Type::boolType   = new (Arena::types) Type("bool");
+Type *Type::nullType   = new (Arena::types) Type("null");
+Type *Type::stringType = new (Arena::types) Type("string");
+Type *Type::errorType  = new (Arena::types) Type("#error");//since error could also be a type name we somehow need to separate them
+
+static int numTypes = 0;
 
 Type::Type(const char *n) {
     Assert(n);
-    typeName = strdup(n);
+    typeName = Intern(n);
+    isError = (typeName[0] == '#');
+    MakeCanonical();
+}
+
+void Type::MakeCanonical() {
+    canonical = this;
+    typeId = numTypes++;
+}
+
+/* Type::Named, Type::ArrayOf
+ * --------------------------
+ * Named types are hash-consed on their name; the canonical array of a
+ * type hangs off the canonical element type, so each array depth is
+ * made once.
+ */
+Type *Type::Named(const char *name) {
+    static Hashtable<Type *> named;
+    Type *t = named.Lookup(name);
+    if (!t) {
+        t = new (Arena::types)
+            NamedTypeNoLoc(new (Arena::types) Identifier({NoOffset, NoOffset}, name));
+        t->MakeCanonical();
+        named.Enter(name, t);
+    }
+    return t;
+}
+
+Type *Type::ArrayOf(Type *elem) {
+    Assert(elem == elem->Canonical());
+    if (!elem->arrayOf) {
+        Type *t = new (Arena::types) ArrayTypeNoLoc({NoOffset, NoOffset}, elem);
+        t->MakeCanonical();
+        t->isError = elem->isError;
+        elem->arrayOf = t;
+    }
+    return elem->arrayOf;
 }
 	
 NamedType::NamedType(Identifier *i) : Type(*i->GetLocation()) {
@@ -78,6 +118,9 @@ ArrayType::ArrayType(yyltype loc, Type *et) : Type(loc) {
 
 Type* ArrayType::CheckTypeHelper(reasonT reason) {
     elemType = elemType->CheckTypeHelper(reason);
+    // the element type may have turned into the error type
+    canonical = NULL;
+    cachedName = NULL;
     return this;
 }
 
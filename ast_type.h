@@ -7,6 +7,14 @@
  *
  * pp3: You will need to extend the Type classes to implement
  * the type system and rules for type equivalency and compatibility.
+ *
+ * Type nodes in the tree carry source locations, so there are many of
+ * them for one type. Each type also has a canonical Type, the single
+ * object shared by all of them: the built-in types are their own,
+ * there is one for each class or interface name (Type::Named) and one
+ * for an array of each canonical type (Type::ArrayOf). Two types are
+ * equivalent exactly when their canonical types are the same object,
+ * and each canonical type is numbered with a small type id.
  */
 
 #ifndef _H_ast_type
@@ -21,7 +29,16 @@ using std::string;
 
 class Type : public Node {
 protected:
-    char *typeName;
+    const char *typeName; // interned
+    Type *canonical = NULL; // once looked up
+    int typeId = -1;        // canonical types only
+    bool isError = false;   // canonical: error, or an array of it
+    Type *arrayOf = NULL;   // canonical: the canonical array of this
+
+    // Finds the canonical type for Canonical() to cache. Built-in types
+    // are made canonical by their constructor.
+    virtual Type *FindCanonical() { return this; }
+    void MakeCanonical();
 
 public:
     static Type *intType, *doubleType, *boolType, *voidType, *nullType,
@@ -30,6 +47,24 @@ public:
     Type(yyltype loc) : Node(loc) {}
     Type(const char *str);
 
+    // The canonical class or interface type of that (interned) name, and
+    // the canonical array of the canonical type elem.
+    static Type *Named(const char *name);
+    static Type *ArrayOf(Type *elem);
+
+    Type *Canonical() {
+        if (!canonical)
+            canonical = FindCanonical();
+        return canonical;
+    }
+    int GetTypeId() { return Canonical()->typeId; }
+    bool IsEquivalentTo(Type *other) {
+        return Canonical() == other->Canonical();
+    }
+    // the error type, or an array of it
+    bool IsError() { return Canonical()->isError; }
+    virtual bool IsArray() { return false; }
+
     virtual void PrintToStream(std::ostream &out) {
         if (typeName && typeName[0] == '#')
             out << (typeName + 1);
@@ -50,10 +85,9 @@ public:
 class NamedType : public Type {
 protected:
     Identifier *id;
-    vector<Node *> children() {
-        vector<Node *> result = Type::children();
-        result.push_back(id);
-        return result;
+    void VisitChildren(ChildVisitor *v) {
+        Type::VisitChildren(v);
+        v->Visit(id);
     }
 
 public:
@@ -62,6 +96,7 @@ public:
     /* virtual bool IsCompatible(Type *other); */
     const char *GetName() { return id->GetName(); }
     Identifier *GetId() { return id; }
+    Type *FindCanonical() { return Named(GetName()); }
     Type *CheckTypeHelper(reasonT);
     int GetTypeSize();
 };
@@ -76,16 +111,13 @@ public:
 };
 
 class ArrayType : public Type {
-    friend class ArrayAccess;
-
 protected:
-    char *cachedName = NULL;
+    const char *cachedName = NULL;
     Type *elemType;
 
-    vector<Node *> children() {
-        vector<Node *> result = Type::children();
-        result.push_back(elemType);
-        return result;
+    void VisitChildren(ChildVisitor *v) {
+        Type::VisitChildren(v);
+        v->Visit(elemType);
     }
 
 public:
@@ -93,15 +125,15 @@ public:
 
     void PrintToStream(std::ostream &out) { out << elemType << "[]"; }
     const char *GetName() {
-        if (!cachedName) {
-            cachedName = new char[strlen(elemType->GetName()) + 2];
-            strcpy(cachedName, elemType->GetName());
-            strcat(cachedName, "[]");
-        }
+        if (!cachedName)
+            cachedName = Intern((string(elemType->GetName()) + "[]").c_str());
         return cachedName;
     } //I believe this is a bug
     /* virtual bool IsCompatible(Type *other); */
     Type *CheckTypeHelper(reasonT);
+    Type *FindCanonical() { return ArrayOf(elemType->Canonical()); }
+    bool IsArray() { return true; }
+    Type *GetElemType() { return elemType; }
 };
 
 class ArrayTypeNoLoc : public ArrayType {
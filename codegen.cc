@@ -6,22 +6,47 @@
  */
 
 #include "codegen.h"
+#include "intern.h"
 #include <string.h>
+#include <limits.h>
 #include "tac.h"
 #include "mips.h"
+#include "isel.h"
+#include "profile.h"
+#include "layout.h"
+#include "sched.h"
+#include "x86.h"
+#include "csource.h"
+#include "interp.h"
+#include "errors.h"
   
 CodeGenerator::CodeGenerator()
 {
   code = new List<Instruction*>();
+  sourceLine = 0;
   loopEndLabels = new stack<const char*>();
+  for (int i = 0; i < NumErrorIRs; i++)
+    errorStubUsed[i] = false;
 }
 
-char *CodeGenerator::NewLabel()
+void CodeGenerator::Append(Instruction *instr)
+{
+  instr->SetLine(sourceLine);
+  code->Append(instr);
+}
+
+void CodeGenerator::DiscardFrom(int n)
+{
+  while (code->NumElements() > n)
+    code->RemoveAt(code->NumElements() - 1);
+}
+
+const char *CodeGenerator::NewLabel()
 {
   static int nextLabelNum = 0;
   char temp[10];
   sprintf(temp, "_L%d", nextLabelNum++);
-  return strdup(temp);
+  return Intern(temp);
 }
 
 
@@ -46,41 +71,41 @@ Location *CodeGenerator::GenTempVar()
 Location *CodeGenerator::GenLoadConstant(int value)
 {
   Location *result = GenTempVar();
-  code->Append(new LoadConstant(result, value));
+  Append(new LoadConstant(result, value));
   return result;
 }
 
 Location *CodeGenerator::GenLoadConstant(const char *s)
 {
   Location *result = GenTempVar();
-  code->Append(new LoadStringConstant(result, s));
+  Append(new LoadStringConstant(result, s));
   return result;
 } 
 
 Location *CodeGenerator::GenLoadLabel(const char *label)
 {
   Location *result = GenTempVar();
-  code->Append(new LoadLabel(result, label));
+  Append(new LoadLabel(result, label));
   return result;
 } 
 
 
 void CodeGenerator::GenAssign(Location *dst, Location *src)
 {
-  code->Append(new Assign(dst, src));
+  Append(new Assign(dst, src));
 }
 
 
 Location *CodeGenerator::GenLoad(Location *ref, int offset)
 {
   Location *result = GenTempVar();
-  code->Append(new Load(result, ref, offset));
+  Append(new Load(result, ref, offset));
   return result;
 }
 
 void CodeGenerator::GenStore(Location *dst,Location *src, int offset)
 {
-  code->Append(new Store(dst, src, offset));
+  Append(new Store(dst, src, offset));
 }
 
 
@@ -89,32 +114,52 @@ Location *CodeGenerator::GenBinaryOp(const char *opName, Location *op1,
 {
   Location *result = GenTempVar();
   if (strcmp(opName, ">")==0)  {
-    code->Append(new BinaryOp(BinaryOp::OpCodeForName("<"), result, op2, op1));
+    Append(new BinaryOp(BinaryOp::OpCodeForName("<"), result, op2, op1));
   } else {
-  code->Append(new BinaryOp(BinaryOp::OpCodeForName(opName), result, op1, op2));
+  Append(new BinaryOp(BinaryOp::OpCodeForName(opName), result, op1, op2));
+  }
+  return result;
+}
+
+Location *CodeGenerator::GenBinaryOp(const char *opName, Location *op1,
+						     int imm)
+{
+  if (strcmp(opName, ">")==0)  {
+    // x > c is !(x < c+1), unless c+1 would overflow
+    if (imm == INT_MAX)
+      return GenBinaryOp(opName, op1, GenLoadConstant(imm));
+    Location *less = GenBinaryOp("<", op1, imm + 1);
+    return GenBinaryOp("==", less, 0);
   }
+  Location *result = GenTempVar();
+  Append(new BinaryOp(BinaryOp::OpCodeForName(opName), result, op1, imm));
   return result;
 }
 
 
 void CodeGenerator::GenLabel(const char *label)
 {
-  code->Append(new Label(label));
+  Append(new Label(label));
 }
 
 void CodeGenerator::GenIfZ(Location *test, const char *label)
 {
-  code->Append(new IfZ(test, label));
+  Append(new IfZ(test, label));
+}
+
+void CodeGenerator::GenIfNZ(Location *test, const char *label)
+{
+  Append(new IfNZ(test, label));
 }
 
 void CodeGenerator::GenGoto(const char *label)
 {
-  code->Append(new Goto(label));
+  Append(new Goto(label));
 }
 
 void CodeGenerator::GenReturn(Location *val)
 {
-  code->Append(new Return(val));
+  Append(new Return(val));
 }
 
 
@@ -122,39 +167,39 @@ BeginFunc *CodeGenerator::GenBeginFunc()
 {
   Assert(localVarNum == 0);
   BeginFunc *result = new BeginFunc;
-  code->Append(result);
+  Append(result);
   return result;
 }
 
 void CodeGenerator::GenEndFunc()
 {
   localVarNum = 0;
-  code->Append(new EndFunc());
+  Append(new EndFunc());
 }
 
 void CodeGenerator::GenPushParam(Location *param)
 {
-  code->Append(new PushParam(param));
+  Append(new PushParam(param));
 }
 
 void CodeGenerator::GenPopParams(int numBytesOfParams)
 {
   Assert(numBytesOfParams >= 0 && numBytesOfParams % VarSize == 0); // sanity check
   if (numBytesOfParams > 0)
-    code->Append(new PopParams(numBytesOfParams));
+    Append(new PopParams(numBytesOfParams));
 }
 
 Location *CodeGenerator::GenLCall(const char *label, bool fnHasReturnValue)
 {
   Location *result = fnHasReturnValue ? GenTempVar() : NULL;
-  code->Append(new LCall(label, result));
+  Append(new LCall(label, result));
   return result;
 }
 
 Location *CodeGenerator::GenACall(Location *fnAddr, bool fnHasReturnValue)
 {
   Location *result = fnHasReturnValue ? GenTempVar() : NULL;
-  code->Append(new ACall(fnAddr, result));
+  Append(new ACall(fnAddr, result));
   return result;
 }
  
@@ -184,31 +229,91 @@ Location *CodeGenerator::GenBuiltInCall(BuiltIn bn,Location *arg1, Location *arg
   Assert((b->numArgs == 0 && !arg1 && !arg2)
 	|| (b->numArgs == 1 && arg1 && !arg2)
 	|| (b->numArgs == 2 && arg1 && arg2));
-  if (arg2) code->Append(new PushParam(arg2));
-  if (arg1) code->Append(new PushParam(arg1));
-  code->Append(new LCall(b->label, result));
+  if (arg2) Append(new PushParam(arg2));
+  if (arg1) Append(new PushParam(arg1));
+  Append(new LCall(b->label, result));
   GenPopParams(VarSize*b->numArgs);
   return result;
 }
 
 
+static struct _errorstub {
+  const char *label;
+  const char *message;
+} errorstubs[] =
+ {{"_ArrayOutOfBounds", err_arr_out_of_bounds},
+  {"_ArraySizeNeg", err_arr_bad_size}};
+
+void CodeGenerator::GenError(ErrorIR e, Location *test)
+{
+  Assert(e >= 0 && e < NumErrorIRs);
+  errorStubUsed[e] = true;
+  GenIfNZ(test, errorstubs[e].label);
+}
+
+
 void CodeGenerator::GenVTable(const char *className, List<const char *> *methodLabels)
 {
-  code->Append(new VTable(className, methodLabels));
+  Append(new VTable(className, methodLabels));
 }
 
 
 void CodeGenerator::DoFinalCodeGen()
 {
+  // the cold error paths go after all the functions, one copy each
+  sourceLine = 0;
+  for (int i = 0; i < NumErrorIRs; i++)
+    if (errorStubUsed[i])
+      Append(new ErrorStub(errorstubs[i].label, errorstubs[i].message));
+
+  if (const char *file = GetOptionValue("fprofile-use")) {
+    ProfileData profile;
+    if (!profile.Read(file))
+      Failure("Cannot open profile %s", file);
+    BlockLayout(&profile).Run(code);
+  } else if (IsOptionOn("O") && !IsOptionOn("profile")) {
+    // a -profile build keeps the layout the profile will be matched to
+    BlockLayout().Run(code);
+  }
+
   if (IsDebugOn("tac")) { // if debug don't translate to mips, just print Tac
     for (int i = 0; i < code->NumElements(); i++)
 	code->Nth(i)->Print();
-   }  else {
+   } else if (IsOptionOn("run") || IsOptionOn("jit")) { // execute in-process instead
+     const char *input = GetOptionValue("input");
+     FILE *in = input ? fopen(input, "r") : stdin;
+     if (in == NULL)
+       Failure("Cannot open input file %s", input);
+     Interpreter interp;
+     interp.Run(code, in);
+  } else if (IsTarget("x86-64")) {
+     X86 x86;
+     x86.EmitProgram(code);
+  } else if (IsTarget("c")) {
+     CSource csource;
+     csource.EmitProgram(code);
+  } else {
      Mips mips;
+     // the runtime printed after the program goes through it as well
+     if (IsOptionOn("O") || IsOptionOn("delay-slots"))
+       Mips::SetScheduler(new Scheduler(IsOptionOn("O"), IsOptionOn("delay-slots")));
+     Profiler *profiler = IsOptionOn("profile") ? new Profiler() : NULL;
      mips.EmitPreamble();
-     for (int i = 0; i < code->NumElements(); i++)
+     if (IsOptionOn("O")) {
+       InstructionSelector isel(&mips);
+       isel.SelectProgram(code, profiler);
+     } else {
+       for (int i = 0; i < code->NumElements(); i++) {
+	 if (profiler) profiler->Before(code, i);
 	 code->Nth(i)->Emit(&mips);
+	 if (profiler) profiler->After(code, i);
+       }
+     }
+     Mips::SourceLine(0); // the runtime belongs to no source line
+     if (profiler) profiler->EmitRuntime();
+     mips.EmitStringPool();
   }
+  Arena::ir.Release(); // the Tac is all translated
 }
 
 CodeGenerator* CodeGenerator::instance = new CodeGenerator();
@@ -33,11 +33,16 @@ typedef enum {
     NumBuiltIns
 } BuiltIn;
 
-typedef enum { ArrayOutOfBound, ArraySizeNeg } ErrorIR;
+typedef enum { ArrayOutOfBound, ArraySizeNeg, NumErrorIRs } ErrorIR;
 
 class CodeGenerator {
 private:
     List<Instruction *> *code;
+    bool errorStubUsed[NumErrorIRs];
+    int sourceLine;
+
+    // Appends instr to the list, tagged with the current source line
+    void Append(Instruction *instr);
 
 public:
     // Here are some class constants to remind you of the offsets
@@ -62,7 +67,7 @@ public:
 
     // Assigns a new unique label name and returns it. Does not
     // generate any Tac instructions (see GenLabel below if needed)
-    char *NewLabel();
+    const char *NewLabel();
 
     // Creates and returns a Location for a new uniquely named
     // temp variable. Does not generate any Tac instructions
@@ -106,6 +111,11 @@ public:
     // was stored.
     Location *GenBinaryOp(const char *opName, Location *op1, Location *op2);
 
+    // Same as above, but the right operand is the integer constant imm,
+    // which saves loading it into a temp first. The final code generator
+    // picks an immediate form of the instruction when imm fits.
+    Location *GenBinaryOp(const char *opName, Location *op1, int imm);
+
     // Generates the Tac instruction for pushing a single
     // parameter. Used to set up for ACall and LCall instructions.
     // The Decaf convention is that parameters are pushed right
@@ -150,6 +160,7 @@ public:
     // (or omit arg) to GenReturn for a return that does not
     // return a value
     void GenIfZ(Location *test, const char *label);
+    void GenIfNZ(Location *test, const char *label);
     void GenGoto(const char *label);
     void GenReturn(Location *val = NULL);
     void GenLabel(const char *label);
@@ -174,16 +185,20 @@ public:
     // useful in debugging to first make sure your Tac is correct.
     void DoFinalCodeGen();
 
-    void GenError(ErrorIR e) {
-        const char *errorMsg = NULL;
-        if (e == ArrayOutOfBound)
-            errorMsg = "Decaf runtime error: Array subscript out of bounds\\n";
-        else
-            errorMsg = "Decaf runtime error: Array size is <= 0\\n";
-        Location *newLoc = CodeGenerator::instance->GenLoadConstant(errorMsg);
-        CodeGenerator::instance->GenBuiltInCall(PrintString, newLoc);
-        CodeGenerator::instance->GenBuiltInCall(Halt);
-    }
+    // Generates a single conditional branch to the shared runtime error
+    // stub for e, taken when test is non-zero. The stub itself (print the
+    // message and halt) is emitted once per program by DoFinalCodeGen.
+    void GenError(ErrorIR e, Location *test);
+
+    // Sets the source line that the instructions generated from here
+    // on are tagged with; lines <= 0 are ignored
+    void SetSourceLine(int line) { if (line > 0) sourceLine = line; }
+
+    // How many Tac instructions there are so far, and a way to take
+    // back the ones after the first n (see ForStmt::EmitUnrolled)
+    int NumInstructions() { return code->NumElements(); }
+    void DiscardFrom(int n);
+
     bool ifMain = false;
     stack<const char*> *loopEndLabels;
 };
@@ -0,0 +1,325 @@
+/* File: csource.cc
+ * ----------------
+ * Implementation of the CSource class, the C counterpart of Mips.
+ *
+ * Names in the C file get a one letter prefix by kind (f_ function,
+ * v_ vtable, s_ string, L_ branch target) with the dots of method labels
+ * turned into double underscores. Frame slots are l<n> for fp-n, p<n>
+ * for parameter fp+n and globals g<n> for gp+n.
+ */
+
+#include "csource.h"
+#include <algorithm>
+#include <stdarg.h>
+#include <string.h>
+
+CSource::CSource() {
+  errorStubs = new Hashtable<const char *>;
+  pushed = maxPushed = 0;
+}
+
+
+/* Method: Emit
+ * ------------
+ * Prints one line of a function body, indented, ending in a newline.
+ */
+void CSource::Emit(const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  printf("  ");
+  vprintf(fmt, args);
+  printf("\n");
+  va_end(args);
+}
+
+const char *CSource::StringLabel(const char *str)
+{
+  return strings.Label(str);
+}
+
+const char *CSource::Name(char kind, const char *label)
+{
+  std::string name(1, kind);
+  if (*label != '_')
+    name += '_';
+  for (const char *c = label; *c; c++)
+    name += *c == '.' ? std::string("__") : std::string(1, *c);
+  return strdup(name.c_str());
+}
+
+/* Method: Var
+ * -----------
+ * Returns the C variable for a frame or global slot. The result is good
+ * until a few more calls.
+ */
+const char *CSource::Var(Location *var)
+{
+  static char bufs[4][32];
+  static int next = 0;
+  char *buf = bufs[next++ % 4];
+  int offset = var->GetOffset();
+  if (var->GetSegment() == gpRelative)
+    sprintf(buf, "g%d", offset);
+  else
+    sprintf(buf, "%c%d", offset > 0 ? 'p' : 'l', offset > 0 ? offset : -offset);
+  return buf;
+}
+
+const char *CSource::Operand(BinaryOp *b)
+{
+  static char buf[32];
+  if (b->GetOp2())
+    return Var(b->GetOp2());
+  sprintf(buf, "%d", b->GetImm());
+  return buf;
+}
+
+
+void CSource::EmitBranch(const char *cond, Location *test, const char *label)
+{
+  const char *message = errorStubs->Lookup(label);
+  if (message)
+    Emit("if (%s%s) decaf_fail(\"%s\");", cond, Var(test), message);
+  else
+    Emit("if (%s%s) goto %s;", cond, Var(test), Name('L', label));
+}
+
+/* Method: EmitCall
+ * ----------------
+ * The parameters pushed for the call are the last ones stored in stk,
+ * which fills from the top down, so they start at stk + (maxPushed -
+ * pushed) with the first parameter first.
+ */
+void CSource::EmitCall(Location *result, const char *fn)
+{
+  if (result)
+    Emit("%s = %s(stk + %d);", Var(result), fn, maxPushed - pushed);
+  else
+    Emit("%s(stk + %d);", fn, maxPushed - pushed);
+}
+
+
+/* Method: EmitInstruction
+ * -----------------------
+ * Translates one Tac instruction of a function body into C statements,
+ * after echoing the Tac as a comment.
+ */
+void CSource::EmitInstruction(Instruction *instr)
+{
+  if (*instr->GetPrinted())
+    Emit("// %s", instr->GetPrinted());
+
+  if (LoadConstant *lc = dynamic_cast<LoadConstant *>(instr)) {
+    Emit("%s = %d;", Var(lc->GetDst()), lc->GetValue());
+  } else if (LoadStringConstant *ls = dynamic_cast<LoadStringConstant *>(instr)) {
+    Emit("%s = %s;", Var(ls->GetDst()), Name('s', StringLabel(ls->GetString())));
+  } else if (LoadLabel *ll = dynamic_cast<LoadLabel *>(instr)) {
+    Emit("%s = %s;", Var(ll->GetDst()), Name('v', ll->GetLabel()));
+  } else if (Assign *a = dynamic_cast<Assign *>(instr)) {
+    Emit("%s = %s;", Var(a->GetDst()), Var(a->GetSrc()));
+  } else if (Load *l = dynamic_cast<Load *>(instr)) {
+    Emit("%s = W(%s + %d);", Var(l->GetDst()), Var(l->GetSrc()), l->GetOffset());
+  } else if (Store *s = dynamic_cast<Store *>(instr)) {
+    Emit("W(%s + %d) = %s;", Var(s->GetDst()), s->GetOffset(), Var(s->GetSrc()));
+  } else if (BinaryOp *b = dynamic_cast<BinaryOp *>(instr)) {
+    // add and sub trap on signed overflow like MIPS add and sub; mul
+    // wraps like mul, without the undefined behavior of overflow in C
+    static const char *const format[BinaryOp::NumOps] = {
+      "if (__builtin_add_overflow(%s, %s, &%s)) decaf_fault(\"arithmetic overflow\");",
+      "if (__builtin_sub_overflow(%s, %s, &%s)) decaf_fault(\"arithmetic overflow\");",
+      "%s = (int32_t) ((uint32_t) %s * (uint32_t) %s);",
+      "%s = decaf_div(%s, %s);", "%s = decaf_mod(%s, %s);", "%s = %s == %s;",
+      "%s = %s < %s;", "%s = %s & %s;", "%s = %s | %s;"};
+    if (b->GetCode() == BinaryOp::Add || b->GetCode() == BinaryOp::Sub)
+      Emit(format[b->GetCode()], Var(b->GetOp1()), Operand(b), Var(b->GetDst()));
+    else
+      Emit(format[b->GetCode()], Var(b->GetDst()), Var(b->GetOp1()), Operand(b));
+  } else if (Label *lab = dynamic_cast<Label *>(instr)) {
+    printf("%s: ;\n", Name('L', lab->GetLabel()));
+  } else if (Goto *g = dynamic_cast<Goto *>(instr)) {
+    Emit("goto %s;", Name('L', g->GetLabel()));
+  } else if (IfZ *z = dynamic_cast<IfZ *>(instr)) {
+    EmitBranch("!", z->GetTest(), z->GetLabel());
+  } else if (IfNZ *nz = dynamic_cast<IfNZ *>(instr)) {
+    EmitBranch("", nz->GetTest(), nz->GetLabel());
+  } else if (dynamic_cast<EndFunc *>(instr)) {
+    Emit("return 0;");
+    printf("}\n\n");
+  } else if (Return *r = dynamic_cast<Return *>(instr)) {
+    Emit("return %s;", r->GetValue() ? Var(r->GetValue()) : "0");
+  } else if (PushParam *p = dynamic_cast<PushParam *>(instr)) {
+    Emit("stk[%d] = %s;", maxPushed - 1 - pushed++, Var(p->GetParam()));
+  } else if (PopParams *pp = dynamic_cast<PopParams *>(instr)) {
+    pushed -= pp->GetNumBytes() / 4;
+  } else if (LCall *call = dynamic_cast<LCall *>(instr)) {
+    EmitCall(call->GetDst(), Name('f', call->GetLabel()));
+  } else if (ACall *ac = dynamic_cast<ACall *>(instr)) {
+    char fn[48];
+    sprintf(fn, "FN(%s)", Var(ac->GetMethodAddr()));
+    EmitCall(ac->GetDst(), fn);
+  } else if (!dynamic_cast<BeginFunc *>(instr)) {
+    Failure("CSource: no translation for Tac '%s'", instr->GetPrinted());
+  }
+}
+
+
+/* Method: EmitFunction
+ * --------------------
+ * Emits the function whose label is code[begin], up to its EndFunc. A
+ * first pass finds the frame slots it uses and how many parameters are
+ * pushed at most at any one time, which sizes stk.
+ */
+void CSource::EmitFunction(List<Instruction *> *code, int begin)
+{
+  std::set<int> locals, params;
+  int end = begin, depth = 0;
+  maxPushed = 1;
+  for (; !dynamic_cast<EndFunc *>(code->Nth(end)); end++) {
+    Instruction *instr = code->Nth(end);
+    Location *ops[3];
+    for (int n = instr->GetOperands(ops) - 1; n >= 0; n--)
+      if (ops[n]->GetSegment() == fpRelative)
+        (ops[n]->GetOffset() > 0 ? params : locals).insert(ops[n]->GetOffset());
+    if (dynamic_cast<PushParam *>(instr) && ++depth > maxPushed)
+      maxPushed = depth;
+    else if (PopParams *pp = dynamic_cast<PopParams *>(instr))
+      depth -= pp->GetNumBytes() / 4;
+  }
+
+  Label *label = dynamic_cast<Label *>(code->Nth(begin));
+  printf("static int32_t %s(int32_t *params)\n{\n", Name('f', label->GetLabel()));
+  for (std::set<int>::iterator p = params.begin(); p != params.end(); ++p)
+    Emit("int32_t p%d = params[%d];", *p, *p / 4 - 1);
+  for (std::set<int>::iterator l = locals.begin(); l != locals.end(); ++l)
+    Emit("int32_t l%d = 0;", -*l);
+  Emit("int32_t stk[%d];", maxPushed);
+  pushed = 0;
+  for (int i = begin + 1; i <= end; i++)
+    EmitInstruction(code->Nth(i));
+}
+
+
+/* Method: EmitProgram
+ * -------------------
+ * Lays out the C file: declarations for everything that is referenced
+ * before it is defined, each function, and decaf_start, which the
+ * runtime calls to copy the string literals and vtables into Decaf
+ * memory and run main.
+ */
+void CSource::EmitProgram(List<Instruction *> *code)
+{
+  std::set<std::string> defined, builtins;
+  List<VTable *> vtables;
+  List<const char *> fns;
+  int globalBytes = 0;
+  for (int i = 0; i < code->NumElements(); i++) {
+    Instruction *instr = code->Nth(i);
+    Location *ops[3];
+    for (int n = instr->GetOperands(ops) - 1; n >= 0; n--)
+      if (ops[n]->GetSegment() == gpRelative && ops[n]->GetOffset() + 4 > globalBytes)
+        globalBytes = ops[n]->GetOffset() + 4;
+    if (Label *l = dynamic_cast<Label *>(instr)) {
+      if (i + 1 < code->NumElements() && dynamic_cast<BeginFunc *>(code->Nth(i + 1)))
+        defined.insert(l->GetLabel());
+    } else if (LCall *call = dynamic_cast<LCall *>(instr)) {
+      builtins.insert(call->GetLabel());
+    } else if (LoadStringConstant *ls = dynamic_cast<LoadStringConstant *>(instr)) {
+      StringLabel(ls->GetString());
+    } else if (ErrorStub *es = dynamic_cast<ErrorStub *>(instr)) {
+      errorStubs->Enter(es->GetLabel(), es->GetMessage());
+    } else if (VTable *vt = dynamic_cast<VTable *>(instr)) {
+      vtables.Append(vt);
+      List<const char *> *methods = vt->GetMethodLabels();
+      for (int m = 0; m < methods->NumElements(); m++)
+        if (fnIndex.find(methods->Nth(m)) == fnIndex.end()) {
+          fns.Append(methods->Nth(m));
+          fnIndex[methods->Nth(m)] = fns.NumElements(); // 0 is the stub
+        }
+    }
+  }
+
+  printf("/* Generated by dcc -target=c, link with runtime/c.c */\n\n");
+  printf("#include <stddef.h>\n#include <stdint.h>\n\n");
+  printf("typedef int32_t (*DecafFn)(int32_t *params);\n");
+  printf("extern char *decaf_mem;\n");
+  printf("int32_t decaf_alloc(int32_t bytes);\n");
+  printf("int32_t decaf_string(const char *s);\n");
+  printf("void decaf_fail(const char *message);\n");
+  printf("void decaf_fault(const char *message);\n");
+  // A debug build checks every access like -run does, so one through null
+  // faults even where the C compiler would drop the unused load
+  printf("#ifdef NDEBUG\n");
+  printf("#define W(addr) (*(int32_t *) (decaf_mem + (uint32_t) (addr)))\n");
+  printf("#else\n");
+  printf("extern uint32_t decaf_top;\n");
+  printf("static inline int32_t *decaf_word(uint32_t addr)\n{\n");
+  Emit("if (addr - 8 > decaf_top - 12)");
+  Emit("  decaf_fault(addr < 8 || addr >= -8u ? \"null dereference\" : \"bad address\");");
+  Emit("return (int32_t *) (decaf_mem + addr);");
+  printf("}\n");
+  printf("#define W(addr) (*decaf_word(addr))\n");
+  printf("#endif\n\n");
+  // division traps on zero like the MIPS runtime check, and INT_MIN / -1
+  // gives what dsim does instead of being undefined in C
+  printf("static inline int32_t decaf_div(int32_t a, int32_t b)\n{\n");
+  Emit("if (b == 0) decaf_fault(\"division by zero\");");
+  Emit("return b == -1 ? (int32_t) -(uint32_t) a : a / b;");
+  printf("}\n\n");
+  printf("static inline int32_t decaf_mod(int32_t a, int32_t b)\n{\n");
+  Emit("if (b == 0) decaf_fault(\"division by zero\");");
+  Emit("return b == -1 ? 0 : a %% b;");
+  printf("}\n\n");
+
+  for (std::set<std::string>::iterator f = builtins.begin(); f != builtins.end(); ++f)
+    if (defined.find(*f) == defined.end())
+      printf("int32_t %s(int32_t *params);\n", Name('f', f->c_str()));
+  for (std::set<std::string>::iterator f = defined.begin(); f != defined.end(); ++f)
+    printf("static int32_t %s(int32_t *params);\n", Name('f', f->c_str()));
+  for (int g = 0; g < globalBytes; g += 4)
+    printf("static int32_t g%d;\n", g);
+  for (int s = 0; s < strings.NumStrings(); s++)
+    printf("static int32_t %s;\n", Name('s', strings.NthLabel(s)));
+  for (int v = 0; v < vtables.NumElements(); v++)
+    printf("static int32_t %s;\n", Name('v', vtables.Nth(v)->GetLabel()));
+  // A method called on null gets its address from the zeroed bottom of
+  // memory (see decaf_start), so fns[0] is a stub that stops the
+  // program; a debug build also sends any index out of range there.
+  printf("\nstatic int32_t decaf_null_method(int32_t *params)\n{\n");
+  Emit("decaf_fault(\"null dereference\");");
+  Emit("return 0;");
+  printf("}\n\n");
+  printf("static const DecafFn fns[] = {\n  decaf_null_method,\n");
+  for (int f = 0; f < fns.NumElements(); f++)
+    printf("  %s,\n", Name('f', fns.Nth(f)));
+  printf("};\n");
+  printf("#ifdef NDEBUG\n#define FN(i) fns[i]\n#else\n");
+  printf("#define FN(i) fns[(uint32_t) (i) < sizeof(fns) / sizeof(fns[0]) ? (i) : 0]\n");
+  printf("#endif\n\n");
+
+  for (int i = 0; i < code->NumElements(); i++)
+    if (i + 1 < code->NumElements() && dynamic_cast<BeginFunc *>(code->Nth(i + 1)))
+      EmitFunction(code, i);
+
+  printf("void decaf_start(void)\n{\n");
+  // The vtable of null is at offset 0: the first allocation keeps the
+  // words of the largest vtable there zero, each one fns[0].
+  int nullVtable = 0;
+  for (int v = 0; v < vtables.NumElements(); v++)
+    nullVtable = std::max(nullVtable, 4 * vtables.Nth(v)->GetMethodLabels()->NumElements());
+  if (nullVtable)
+    Emit("decaf_alloc(%d);", nullVtable);
+  for (int s = 0; s < strings.NumStrings(); s++) {
+    Emit("%s = decaf_string(%s);", Name('s', strings.NthLabel(s)),
+         strings.Nth(s));
+  }
+  for (int v = 0; v < vtables.NumElements(); v++) {
+    const char *vtable = Name('v', vtables.Nth(v)->GetLabel());
+    List<const char *> *methods = vtables.Nth(v)->GetMethodLabels();
+    Emit("%s = decaf_alloc(%d);", vtable, 4 * methods->NumElements());
+    for (int m = 0; m < methods->NumElements(); m++)
+      Emit("W(%s + %d) = %d;", vtable, 4 * m, fnIndex[methods->Nth(m)]);
+  }
+  Emit("f_main(NULL);");
+  printf("}\n");
+}
@@ -0,0 +1,59 @@
+/* File: csource.h
+ * ---------------
+ * The CSource class translates the Tac of a whole program into a single
+ * C file, as the alternative to the Mips class when compiling with
+ * -target=c. The host C compiler then does the optimizing, which makes
+ * this both a quick way to run Decaf at native speed and a reference
+ * point for the MIPS code generators.
+ *
+ * Every Decaf function becomes a C function whose frame slots are plain
+ * int32_t locals, named after their fp offset, so the C compiler can
+ * keep them in registers. Parameters are still passed the Decaf way: the
+ * caller stores them in a small array as it pushes them and the callee
+ * gets a pointer to them. Decaf memory (objects, arrays, strings and
+ * vtables) lives in one arena addressed by 32-bit offsets, so values are
+ * 32 bits on any host, and vtable entries index a table of function
+ * pointers, whose entry 0 stops the program the way a method call on
+ * null should. The built-in routines come from runtime/c.c:
+ *
+ *     dcc -target=c < prog.decaf > prog.c
+ *     cc -O2 -o prog prog.c runtime/c.c
+ */
+
+#ifndef _H_csource
+#define _H_csource
+
+#include "tac.h"
+#include "list.h"
+#include "hashtable.h"
+#include "strpool.h"
+#include <map>
+#include <set>
+#include <string>
+
+class CSource {
+  public:
+    CSource();
+
+    // Translates the whole program, runtime entry point included.
+    void EmitProgram(List<Instruction *> *code);
+
+  private:
+    StringPool strings;
+    Hashtable<const char *> *errorStubs;   // stub label -> message
+    std::map<std::string, int> fnIndex;    // position in the fns[] table
+    int pushed, maxPushed;                 // params pushed so far
+
+    static void Emit(const char *fmt, ...);
+    const char *StringLabel(const char *str);
+    const char *Name(char kind, const char *label);
+    const char *Var(Location *var);
+    const char *Operand(BinaryOp *b);
+
+    void EmitFunction(List<Instruction *> *code, int begin);
+    void EmitInstruction(Instruction *instr);
+    void EmitBranch(const char *cond, Location *test, const char *label);
+    void EmitCall(Location *result, const char *fn);
+};
+
+#endif
@@ -0,0 +1,74 @@
+/* File: dsim.cc
+ * -------------
+ * Command-line driver for the MIPS simulator.
+ *
+ *   dsim [-stats] [-delayed] [-pipeline] [-icache=S:L:W] [-dcache=S:L:W]
+ *        [-miss=N] file.s
+ *
+ * Program output goes to stdout, program input comes from stdin. With
+ * -stats the dynamic counters are written to stderr when the program
+ * finishes. -delayed runs with MIPS branch and load delay slots, for
+ * code compiled with dcc -delay-slots.
+ *
+ * -pipeline adds the timing model of pipeline.h to the counters (and
+ * implies -stats). The caches are given as total size, line size and
+ * associativity in bytes/ways, and -miss sets the miss penalty in cycles.
+ */
+
+#include "mipssim.h"
+#include "pipeline.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *usage = "Usage: dsim [-stats] [-delayed] [-pipeline] "
+                           "[-icache=S:L:W] [-dcache=S:L:W] [-miss=N] file.s\n";
+
+static bool ParseCache(const char *arg, Cache::Config &config) {
+    return sscanf(arg, "%d:%d:%d", &config.size, &config.line,
+                  &config.ways) == 3 && Cache::Valid(config);
+}
+
+int main(int argc, char *argv[]) {
+    bool stats = false, delayed = false, pipelined = false;
+    Cache::Config icache = {4096, 16, 1}, dcache = {4096, 16, 2};
+    int missPenalty = 10;
+    const char *file = NULL;
+    for (int i = 1; i < argc; i++) {
+        bool ok = true;
+        if (strcmp(argv[i], "-stats") == 0)
+            stats = true;
+        else if (strcmp(argv[i], "-delayed") == 0)
+            delayed = true;
+        else if (strcmp(argv[i], "-pipeline") == 0)
+            pipelined = true;
+        else if (strncmp(argv[i], "-icache=", 8) == 0)
+            ok = pipelined = ParseCache(argv[i] + 8, icache);
+        else if (strncmp(argv[i], "-dcache=", 8) == 0)
+            ok = pipelined = ParseCache(argv[i] + 8, dcache);
+        else if (strncmp(argv[i], "-miss=", 6) == 0)
+            ok = pipelined = (missPenalty = atoi(argv[i] + 6)) >= 0;
+        else if (argv[i][0] != '-' && !file)
+            file = argv[i];
+        else
+            ok = false;
+        if (!ok) {
+            fprintf(stderr, "%s", usage);
+            return 2;
+        }
+    }
+    if (!file) {
+        fprintf(stderr, "%s", usage);
+        return 2;
+    }
+    MipsSim sim;
+    sim.SetDelayed(delayed);
+    Pipeline pipeline(icache, dcache, missPenalty, delayed);
+    if (pipelined)
+        sim.SetPipeline(&pipeline);
+    if (!sim.Load(file))
+        return 2;
+    int status = sim.Run();
+    if (stats || pipelined)
+        sim.PrintStats(stderr);
+    return status;
+}
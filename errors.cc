@@ -19,9 +19,9 @@ using namespace std;
 
 
 int ReportError::numErrors = 0;
-multimap<yyltype,string> ReportError::errors;
+multimap<SourcePos,string> ReportError::errors;
 
-void ReportError::UnderlineErrorInLine(const char *line, const yyltype *pos) {
+void ReportError::UnderlineErrorInLine(const char *line, const SourcePos *pos) {
     if (!line) return;
     cerr << line << endl;
     for (int i = 1; i <= pos->last_column; i++)
@@ -31,25 +31,31 @@ void ReportError::UnderlineErrorInLine(const char *line, const yyltype *pos) {
 
  
 void ReportError::EmitError(yyltype *loc, string msg) {
+    if (loc && loc->first != NoOffset)
+	EmitError(GetSourcePos(*loc), msg);
+    else {
+	numErrors++;
+	OutputError(NULL, msg);
+    }
+}
+
+void ReportError::EmitError(const SourcePos &pos, string msg) {
     numErrors++;
-    if (loc)
-	errors.insert(make_pair(*loc, msg));
-    else
-	OutputError(loc, msg);
+    errors.insert(make_pair(pos, msg));
 }
 
-void ReportError::OutputError(const yyltype *loc, string msg) {
+void ReportError::OutputError(const SourcePos *pos, string msg) {
     fflush(stdout); // make sure any buffered text has been output
-    if (loc) {
-        cerr << endl << "*** Error line " << loc->first_line << "." << endl;
-        UnderlineErrorInLine(GetLineNumbered(loc->first_line), loc);
+    if (pos) {
+        cerr << endl << "*** Error line " << pos->line << "." << endl;
+        UnderlineErrorInLine(GetLineNumbered(pos->line), pos);
     } else
         cerr << endl << "*** Error." << endl;
     cerr << "*** " << msg << endl << endl;
 }
 
 void ReportError::PrintErrors() {
-    for (multimap<yyltype,string>::iterator iter = errors.begin(); iter != errors.end(); ++iter)
+    for (multimap<SourcePos,string>::iterator iter = errors.begin(); iter != errors.end(); ++iter)
 	OutputError(&iter->first, iter->second);
 }
 
@@ -68,8 +74,8 @@ void ReportError::UntermComment() {
 }
 
 void ReportError::InvalidDirective(int linenum) {
-    yyltype ll = {0, linenum, 0, 0};
-    EmitError(&ll, "Invalid # directive");
+    SourcePos pos = {linenum, 0, 0};
+    EmitError(pos, "Invalid # directive");
 }
 
 void ReportError::LongIdentifier(yyltype *loc, const char *ident) {
@@ -93,7 +99,7 @@ void ReportError::UnrecogChar(yyltype *loc, char ch) {
 void ReportError::DeclConflict(Decl *decl, Decl *prevDecl) {
     ostringstream s;
     s << "Declaration of '" << decl << "' here conflicts with declaration on line " 
-      << prevDecl->GetLocation()->first_line;
+      << GetLineOf(prevDecl->GetLocation()->first);
     EmitError(decl->GetLocation(), s.str());
 }
   
@@ -117,11 +117,12 @@ class ReportError
   
  private:
 
-  static void UnderlineErrorInLine(const char *line, const yyltype *pos);
+  static void UnderlineErrorInLine(const char *line, const SourcePos *pos);
   static void EmitError(yyltype *loc, string msg);
-  static void OutputError(const yyltype *loc, string msg);
+  static void EmitError(const SourcePos &pos, string msg);
+  static void OutputError(const SourcePos *pos, string msg);
   static int numErrors;
-  static multimap<yyltype,string> errors;
+  static multimap<SourcePos,string> errors;
   
 };
 
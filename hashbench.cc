@@ -0,0 +1,210 @@
+/* File: hashbench.cc
+ * ------------------
+ * Microbenchmark for Hashtable (make hashbench). It runs the same
+ * workloads against the table in hashtable.h and against MapTable, the
+ * std::multimap table it replaced, kept here as the baseline:
+ *
+ *   enter     filling a table with distinct keys
+ *   hit       looking up keys that are there
+ *   miss      looking up keys that aren't
+ *   scopes    the semantic analyzer's pattern: a stack of small nested
+ *             scopes, each name looked up from the innermost outwards
+ *   shadow    entering a key repeatedly without overwriting, looking it
+ *             up and removing the values again
+ *
+ * and prints the time per operation of each. A checksum of the values
+ * each workload found is compared with the baseline's, and a mismatch
+ * is reported (and makes the exit status 1).
+ *
+ *   hashbench [-n keys] [-r rounds]
+ */
+
+#include "hashtable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+using std::vector;
+
+template <class Value> class MapTable {
+  std::multimap<const char *, Value, ltstr> mmap;
+
+public:
+  void Enter(const char *key, Value val, bool overwrite = true) {
+    Value prev;
+    if (overwrite && (prev = Lookup(key)))
+      Remove(key, prev);
+    mmap.insert(std::make_pair(strdup(key), val));
+  }
+
+  void Remove(const char *key, Value val) {
+    typename std::multimap<const char *, Value, ltstr>::iterator itr;
+    for (itr = mmap.find(key); itr != mmap.upper_bound(key); ++itr)
+      if (itr->second == val) {
+        mmap.erase(itr);
+        break;
+      }
+  }
+
+  Value Lookup(const char *key) {
+    if (mmap.count(key) == 0)
+      return NULL;
+    typename std::multimap<const char *, Value, ltstr>::iterator last;
+    last = mmap.upper_bound(key);
+    return (--last)->second;
+  }
+};
+
+static double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// identifiers of the shapes Decaf programs use, interned as the
+// compiler's are
+static vector<const char *> MakeKeys(int n, const char *prefix) {
+  static const char *stems[] = {"i", "count", "GetValue", "_tmp", "node",
+                                "this", "length", "Matrix", "next", "x"};
+  vector<const char *> keys;
+  char buf[64];
+  for (int i = 0; i < n; i++) {
+    snprintf(buf, sizeof(buf), "%s%s%d", prefix, stems[i % 10], i / 10);
+    keys.push_back(Intern(buf));
+  }
+  return keys;
+}
+
+template <class Table> struct Workloads {
+  const vector<const char *> &keys, &missing;
+  int rounds;
+  long check;
+
+  Workloads(const vector<const char *> &k, const vector<const char *> &m, int r)
+      : keys(k), missing(m), rounds(r), check(0) {}
+
+  double Enter() {
+    double start = Now();
+    for (int r = 0; r < rounds; r++) {
+      Table t;
+      for (size_t i = 0; i < keys.size(); i++)
+        t.Enter(keys[i], (void *) (i + 1));
+      check += (long) t.Lookup(keys[0]);
+    }
+    return (Now() - start) / (rounds * keys.size());
+  }
+
+  double Hit(Table &t) {
+    double start = Now();
+    for (int r = 0; r < rounds; r++)
+      for (size_t i = 0; i < keys.size(); i++)
+        check += (long) t.Lookup(keys[i]);
+    return (Now() - start) / (rounds * keys.size());
+  }
+
+  double Miss(Table &t) {
+    double start = Now();
+    for (int r = 0; r < rounds; r++)
+      for (size_t i = 0; i < missing.size(); i++)
+        check += (long) t.Lookup(missing[i]);
+    return (Now() - start) / (rounds * missing.size());
+  }
+
+  // scopes of 8 names, 6 deep, every name looked up from the innermost
+  double Scopes() {
+    const int width = 8, depth = 6;
+    long lookups = 0;
+    double start = Now();
+    for (int r = 0; r < rounds; r++) {
+      for (size_t base = 0; base + width * depth <= keys.size(); base += width * depth) {
+        Table scopes[depth];
+        for (int d = 0; d < depth; d++)
+          for (int w = 0; w < width; w++)
+            scopes[d].Enter(keys[base + d * width + w], (void *) (long) (d + 1));
+        for (int k = 0; k < width * depth; k++) {
+          const char *name = keys[base + k];
+          for (int d = depth - 1; d >= 0; d--, lookups++)
+            if (void *v = scopes[d].Lookup(name)) {
+              check += (long) v;
+              break;
+            }
+        }
+      }
+    }
+    return lookups ? (Now() - start) / lookups : 0;
+  }
+
+  double Shadow() {
+    const int layers = 4;
+    double start = Now();
+    for (int r = 0; r < rounds; r++) {
+      Table t;
+      for (int l = 1; l <= layers; l++)
+        for (size_t i = 0; i < keys.size(); i++)
+          t.Enter(keys[i], (void *) (long) l, false);
+      for (size_t i = 0; i < keys.size(); i++)
+        check += (long) t.Lookup(keys[i]);
+      for (int l = layers; l >= 1; l--)
+        for (size_t i = 0; i < keys.size(); i++)
+          t.Remove(keys[i], (void *) (long) l);
+      check += (long) t.Lookup(keys[0]);
+    }
+    return (Now() - start) / (rounds * keys.size() * (2 * layers + 1));
+  }
+};
+
+template <class Table> static void Run(const vector<const char *> &keys,
+                                       const vector<const char *> &missing, int rounds,
+                                       double times[5], long checks[5]) {
+  Workloads<Table> w(keys, missing, rounds);
+  Table table;
+  for (size_t i = 0; i < keys.size(); i++)
+    table.Enter(keys[i], (void *) (i + 1));
+  double (Workloads<Table>::*plain[])() = {&Workloads<Table>::Enter, NULL, NULL,
+                                           &Workloads<Table>::Scopes,
+                                           &Workloads<Table>::Shadow};
+  for (int k = 0; k < 5; k++) {
+    w.check = 0;
+    if (k == 1)
+      times[k] = w.Hit(table);
+    else if (k == 2)
+      times[k] = w.Miss(table);
+    else
+      times[k] = (w.*plain[k])();
+    checks[k] = w.check;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int n = 2000, rounds = 200;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "-n") == 0)
+      n = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-r") == 0)
+      rounds = atoi(argv[i + 1]);
+  }
+  if (n < 1 || rounds < 1) {
+    fprintf(stderr, "Usage: hashbench [-n keys] [-r rounds]\n");
+    return 2;
+  }
+  vector<const char *> keys = MakeKeys(n, ""), missing = MakeKeys(n, "no_");
+
+  static const char *names[] = {"enter", "hit", "miss", "scopes", "shadow"};
+  double hashTimes[5], mapTimes[5];
+  long hashChecks[5], mapChecks[5];
+  Run<Hashtable<void *> >(keys, missing, rounds, hashTimes, hashChecks);
+  Run<MapTable<void *> >(keys, missing, rounds, mapTimes, mapChecks);
+
+  printf("%d keys, %d rounds\n", n, rounds);
+  printf("%-10s %12s %12s %8s\n", "workload", "multimap ns", "hash ns", "speedup");
+  int status = 0;
+  for (int k = 0; k < 5; k++) {
+    printf("%-10s %12.1f %12.1f %7.2fx%s\n", names[k], mapTimes[k] * 1e9,
+           hashTimes[k] * 1e9, hashTimes[k] > 0 ? mapTimes[k] / hashTimes[k] : 0.0,
+           hashChecks[k] == mapChecks[k] ? "" : "  MISMATCH");
+    if (hashChecks[k] != mapChecks[k])
+      status = 1;
+  }
+  return status;
+}
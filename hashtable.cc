@@ -2,24 +2,80 @@
  * ------------------
  * Implementation of Hashtable class.
  */
-   
+
+#include <algorithm>
+
+
+/* Hashtable::Find
+ * ---------------
+ * Linear probing from the key's home slot. Returns the slot holding
+ * the key, or the empty slot where it would go. Keys are interned, so
+ * they match exactly when the pointers do. Keys are never taken out of
+ * the slots, so there are no tombstones to skip.
+ */
+template <class Value> int Hashtable<Value>::Find(const char *key, uint32_t hash) const
+{
+  int mask = slots.size() - 1;
+  for (int i = hash & mask; ; i = (i + 1) & mask) {
+    int k = slots[i];
+    if (k < 0 || keys[k].name == key)
+      return i;
+  }
+}
+
+
+/* Hashtable::Grow
+ * ---------------
+ * Doubles the slots, keeping them at most half full, and puts the keys
+ * back with the hashes they were stored with.
+ */
+template <class Value> void Hashtable<Value>::Grow()
+{
+  slots.assign(slots.size() * 2, -1);
+  int mask = slots.size() - 1;
+  for (size_t k = 0; k < keys.size(); k++) {
+    int i = keys[k].hash & mask;
+    while (slots[i] >= 0)
+      i = (i + 1) & mask;
+    slots[i] = k;
+  }
+}
+
 
 /* Hashtable::Enter
  * ----------------
  * Stores new value for given identifier. If the key already
  * has an entry and flag is to overwrite, will remove previous entry first,
- * otherwise it just adds another entry under same key. Copies the
- * key, so you don't have to worry about its allocation.
+ * otherwise it just adds another entry under same key. The key is
+ * interned, so the table can keep the pointer itself.
  */
 template <class Value> void Hashtable<Value>::Enter(const char *key, Value val, bool overwrite)
 {
-  Value prev;
-  if (overwrite && (prev = Lookup(key)))
-    Remove(key, prev);
-  mmap.insert(std::make_pair(strdup(key), val));
+  uint32_t hash = InternHash(key);
+  int slot = Find(key, hash);
+  if (slots[slot] < 0) {
+    if (2 * (keys.size() + 1) > slots.size()) {
+      Grow();
+      slot = Find(key, hash);
+    }
+    Key k = {key, hash, -1};
+    slots[slot] = keys.size();
+    keys.push_back(k);
+  }
+  Key &k = keys[slots[slot]];
+  if (overwrite && k.newest >= 0) {
+    // the previous value goes, the new one is the newest again
+    entries[k.newest].live = false;
+    k.newest = entries[k.newest].older;
+    numEntries--;
+  }
+  Entry e = {val, slots[slot], k.newest, true};
+  k.newest = entries.size();
+  entries.push_back(e);
+  numEntries++;
 }
 
- 
+
 /* Hashtable::Remove
  * -----------------
  * Removes a given key-value pair from table. If no such pair, no
@@ -27,19 +83,19 @@ template <class Value> void Hashtable<Value>::Enter(const char *key, Value val,
  */
 template <class Value> void Hashtable<Value>::Remove(const char *key, Value val)
 {
-  if (mmap.count(key) == 0) // no matches at all
+  int k = slots[Find(key, InternHash(key))];
+  if (k < 0) // no matches at all
     return;
-
-  typename std::multimap<const char *, Value>::iterator itr;
-  itr = mmap.find(key); // start at first occurrence
-  while (itr != mmap.upper_bound(key)) {
-    if (itr->second == val) { // iterate to find matching pair
-	mmap.erase(itr);
-	break;
+  for (int *link = &keys[k].newest; *link >= 0; link = &entries[*link].older) {
+    Entry &e = entries[*link];
+    if (e.value == val) {
+      e.live = false;
+      *link = e.older;
+      numEntries--;
+      return;
     }
-    ++itr;
   }
-} 
+}
 
 
 /* Hashtable::Lookup
@@ -47,23 +103,12 @@ template <class Value> void Hashtable<Value>::Remove(const char *key, Value val)
  * Returns the value earlier stored under key or NULL
  *if there is no matching entry
  */
-template <class Value> Value Hashtable<Value>::Lookup(const char *key) 
+template <class Value> Value Hashtable<Value>::Lookup(const char *key) const
 {
-  Value found = NULL;
-  
-  if (mmap.count(key) > 0) {
-    typename std::multimap<const char *, Value>::iterator cur, last, prev;
-    cur = mmap.find(key); // start at first occurrence
-    last = mmap.upper_bound(key);
-    while (cur != last) { // iterate to find last entered
-	prev = cur; 
-	if (++cur == mmap.upper_bound(key)) { // have to go one too far
-	  found = prev->second; // one before last was it
-	  break;
-	}
-    }
-  }
-  return found;
+  int k = slots[Find(key, InternHash(key))];
+  if (k < 0 || keys[k].newest < 0)
+    return NULL;
+  return entries[keys[k].newest].value;
 }
 
 
@@ -72,7 +117,7 @@ template <class Value> Value Hashtable<Value>::Lookup(const char *key)
  */
 template <class Value> int Hashtable<Value>::NumEntries() const
 {
-  return mmap.size();
+  return numEntries;
 }
 
 
@@ -80,10 +125,21 @@ template <class Value> int Hashtable<Value>::NumEntries() const
 /* Hashtable:GetIterator
  * ---------------------
  * Returns iterator which can be used to walk through all values in table.
+ * The values are those of the entries still in the table, sorted by
+ * key; the sort is stable so values under the same key stay in the
+ * order they were entered.
  */
-template <class Value> Iterator<Value> Hashtable<Value>::GetIterator() 
+template <class Value> Iterator<Value> Hashtable<Value>::GetIterator()
 {
-  return Iterator<Value>(mmap);
+  std::vector<std::pair<const char *, int> > order;
+  for (size_t i = 0; i < entries.size(); i++)
+    if (entries[i].live)
+      order.push_back(std::make_pair(keys[entries[i].key].name, (int) i));
+  std::stable_sort(order.begin(), order.end(), OrderByKey());
+  Iterator<Value> iter;
+  for (size_t i = 0; i < order.size(); i++)
+    iter.values.push_back(entries[order[i].second].value);
+  return iter;
 }
 
 
@@ -94,6 +150,5 @@ template <class Value> Iterator<Value> Hashtable<Value>::GetIterator()
  */
 template <class Value> Value Iterator<Value>::GetNextValue()
 {
-  return (cur == end ? NULL : (*cur++).second);
+  return (cur == values.size() ? NULL : values[cur++]);
 }
-
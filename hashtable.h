@@ -1,10 +1,12 @@
 /* File: hashtable.h
  * -----------------
  * This is a simple table for storing values associated with a string
- * key, supporting simple operations for Enter and Lookup.  It is not
- * much more than a thin cover over the STL associative map container,
- * but hides the awkward C++ template syntax and provides a more
- * familiar interface.
+ * key, supporting simple operations for Enter and Lookup. It is an
+ * open-addressing hash table, looked up by linear probing. Keys must be
+ * interned strings (see intern.h): the table uses the hash the interner
+ * stored with each one and compares keys by pointer, so neither Enter
+ * nor Lookup reads the characters. The values entered under a key form a chain,
+ * newest first, which is what lets an entry shadow an earlier one.
  *
  * The keys are always strings, but the values can be of any type
  * (ok, that's actually kind of a fib, it expects the type to be
@@ -33,8 +35,11 @@
 #ifndef _H_hashtable
 #define _H_hashtable
 
+#include "intern.h"
 #include <map>
+#include <stdint.h>
 #include <string.h>
+#include <vector>
 
 struct ltstr {
   bool operator()(const char* s1, const char* s2) const
@@ -46,17 +51,41 @@ template <class Value> class Iterator;
 
 template<class Value> class Hashtable {
 
-  private: 
-     std::multimap<const char*, Value, ltstr> mmap;
- 
+  private:
+     struct Key {
+       const char *name;
+       uint32_t hash;
+       int newest;              // entry last entered, -1 if none left
+     };
+     struct Entry {
+       Value value;
+       int key;
+       int older;               // entry it shadows, -1 if none
+       bool live;
+     };
+
+     struct OrderByKey {       // (key, entry) pairs, by key
+       bool operator()(const std::pair<const char*, int> &a,
+                       const std::pair<const char*, int> &b) const
+       { return strcmp(a.first, b.first) < 0; }
+     };
+
+     std::vector<Key> keys;
+     std::vector<Entry> entries;
+     std::vector<int> slots;    // index into keys, -1 if empty
+     int numEntries;
+
+     int Find(const char *key, uint32_t hash) const; // slot of key or empty
+     void Grow();
+
    public:
             // ctor creates a new empty hashtable
-     Hashtable() {}
+     Hashtable() : slots(16, -1), numEntries(0) {}
 
            // Returns number of entries currently in table
      int NumEntries() const;
 
-           // Associates value with key. If a previous entry for
+           // Associates value with key, which must be interned. If a previous entry for
            // key exists, the bool parameter controls whether 
            // new value overwrites the previous (removing it from
            // from the table entirely) or just shadows it (keeps previous
@@ -71,10 +100,10 @@ template<class Value> class Hashtable {
            // entirely.
      void Remove(const char *key, Value value);
 
-          // Returns value stored under key or NULL if no match.
+          // Returns value stored under (interned) key or NULL if no match.
           // If more than one value for key (ie shadow feature was
           // used during Enter), returns the lastmost entered one.
-     Value Lookup(const char *key);
+     Value Lookup(const char *key) const;
 
           // Returns an Iterator object (see below) that can be used to
           // visit each value in the table in alphabetical order.
@@ -91,9 +120,9 @@ template<class Value> class Iterator {
   friend class Hashtable<Value>;
 
   private:
-    typename std::multimap<const char*, Value , ltstr>::iterator cur, end;
-    Iterator(std::multimap<const char*, Value, ltstr>& t)
-      : cur(t.begin()), end(t.end()) {}
+    std::vector<Value> values; // in order, taken when it was made
+    size_t cur;
+    Iterator() : cur(0) {}
 
   public:
          // Returns current value and advances iterator to next.
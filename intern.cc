@@ -0,0 +1,94 @@
+/* File: intern.cc
+ * ---------------
+ * Implementation of the string interner: an open-addressing table of
+ * the interned strings with their hashes, and the blocks the strings
+ * are copied into. Each copy is preceded by its hash, which is where
+ * InternHash finds it.
+ */
+
+#include "intern.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+struct Slot {
+    const char *s;  // NULL if empty
+    uint32_t hash;
+    int len;
+};
+
+const int BlockSize = 64 * 1024;
+
+// Function-local statics, so that interning works during static
+// initialization (Type::intType and friends) whatever the link order.
+std::vector<Slot> &Slots() {
+    static std::vector<Slot> slots(1024, Slot());
+    return slots;
+}
+
+int numStrings = 0;
+char *block = NULL; // where the next copy goes
+int blockLeft = 0;
+
+// the hash, then the characters, rounded up to keep the next hash aligned
+const char *Copy(const char *s, int len, uint32_t hash) {
+    int need = (sizeof(uint32_t) + len + 1 + sizeof(uint32_t) - 1) &
+               ~(int) (sizeof(uint32_t) - 1);
+    if (need > blockLeft) {
+        int size = need > BlockSize ? need : BlockSize;
+        block = (char *) malloc(size);
+        blockLeft = size;
+    }
+    memcpy(block, &hash, sizeof(uint32_t));
+    char *copy = block + sizeof(uint32_t);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    block += need;
+    blockLeft -= need;
+    return copy;
+}
+
+void Grow() {
+    std::vector<Slot> &slots = Slots();
+    std::vector<Slot> old(slots.size() * 2, Slot());
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (size_t i = 0; i < old.size(); i++) {
+        if (old[i].s == NULL) continue;
+        size_t j = old[i].hash & mask;
+        while (slots[j].s) j = (j + 1) & mask;
+        slots[j] = old[i];
+    }
+}
+
+} // namespace
+
+const char *Intern(const char *s) {
+    return Intern(s, strlen(s));
+}
+
+/* Function: Intern
+ * ----------------
+ * FNV-1a hash, then linear probing; the table is kept at most half
+ * full.
+ */
+const char *Intern(const char *s, int len) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char) s[i]) * 16777619u;
+    std::vector<Slot> &slots = Slots();
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    for (; slots[i].s; i = (i + 1) & mask)
+        if (slots[i].hash == hash && slots[i].len == len &&
+            memcmp(slots[i].s, s, len) == 0)
+            return slots[i].s;
+    Slot slot = {Copy(s, len, hash), hash, len};
+    slots[i] = slot;
+    if (2 * ++numStrings > (int) slots.size())
+        Grow();
+    return slot.s;
+}
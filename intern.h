@@ -0,0 +1,37 @@
+/* File: intern.h
+ * --------------
+ * The string interner keeps a single copy of every distinct string it
+ * is handed for the whole run of the compiler. Identifiers come out of
+ * the scanner interned, and type names, labels, temp names and the keys
+ * of every Hashtable are interned too, so two of them are the same name
+ * exactly when they are the same pointer. The copies live in large
+ * blocks that are never freed, instead of one small heap allocation
+ * (strdup) per name.
+ */
+
+#ifndef _H_intern
+#define _H_intern
+
+#include <stdint.h>
+
+/* Function: Intern()
+ * Usage: const char *name = Intern(yytext);
+ * -----------------------------------------
+ * Returns the interned copy of the string s, or of its first len
+ * characters. Equal strings always give back the same pointer.
+ */
+const char *Intern(const char *s);
+const char *Intern(const char *s, int len);
+
+/* Function: InternHash()
+ * Usage: uint32_t hash = InternHash(name);
+ * ----------------------------------------
+ * Returns the hash the interner computed for s, which must be a
+ * string Intern returned. It is stored next to the copy, so this does
+ * not look at the characters.
+ */
+inline uint32_t InternHash(const char *s) {
+    return ((const uint32_t *) s)[-1];
+}
+
+#endif
@@ -0,0 +1,366 @@
+/* File: interp.cc
+ * ---------------
+ * Implementation of the Interpreter class.
+ */
+
+#include "interp.h"
+#include "jit.h"
+#include "errors.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const builtinNames[] = {
+  "_PrintInt", "_PrintString", "_PrintBool", "_Alloc", "_ReadLine",
+  "_ReadInteger", "_StringEqual"};
+
+static const uint32_t NullGuard = 8; // where gp points, below it is null
+
+Interpreter::Interpreter() {
+  memSize = 1 << 26;
+  mem = (char *) calloc(memSize, 1);
+  heapTop = NullGuard;
+  in = stdin;
+}
+
+Interpreter::~Interpreter() {
+  free(mem);
+}
+
+
+/* Method: Fault
+ * -------------
+ * Stops the program on something the MIPS code would have crashed on.
+ */
+void Interpreter::Fault(const char *message)
+{
+  fflush(stdout);
+  fprintf(stderr, "Decaf runtime error: %s\n", message);
+  exit(1);
+}
+
+int32_t &Interpreter::Word(uint32_t address)
+{
+  if (address - NullGuard > memSize - NullGuard - 4)
+    Fault(address < NullGuard || address >= 0u - NullGuard ? "null dereference"
+                                                  : "bad address");
+  return *(int32_t *) (mem + address);
+}
+
+int32_t Interpreter::StaticData(const char *bytes, int size)
+{
+  int32_t address = heapTop;
+  memcpy(mem + address, bytes, size);
+  heapTop += (size + 7) & ~7;
+  return address;
+}
+
+/* Method: StringAddress
+ * ---------------------
+ * Returns where a (quoted) string literal lives, copying it into memory
+ * the first time. Escapes are handled the way the assembler would.
+ */
+int32_t Interpreter::StringAddress(const char *quoted)
+{
+  std::map<std::string, int32_t>::iterator found = strings.find(quoted);
+  if (found != strings.end())
+    return found->second;
+  std::string text;
+  for (const char *c = quoted + 1; *c && c[1]; c++) {
+    if (*c == '\\' && c[1] && c[2]) {
+      c++;
+      text += *c == 'n' ? '\n' : *c == 't' ? '\t' : *c;
+    } else {
+      text += *c;
+    }
+  }
+  return strings[quoted] = StaticData(text.c_str(), text.size() + 1);
+}
+
+
+/* Method: Append
+ * --------------
+ * Adds an operation to the decoded program. Location operands become
+ * their offset, with a flag for globals since those are relative to the
+ * fixed gp and so can be stored as absolute addresses; a NULL z means
+ * imm is used instead.
+ */
+void Interpreter::Append(OpCode code, Location *x, Location *y, Location *z,
+                         int32_t imm)
+{
+  Op op = {(uint8_t) code, 0, 0, 0, imm};
+  Location *operands[3] = {x, y, z};
+  int32_t *fields[3] = {&op.x, &op.y, &op.z};
+  for (int i = 0; i < 3; i++) {
+    if (operands[i] == NULL)
+      continue;
+    *fields[i] = operands[i]->GetOffset();
+    if (operands[i]->GetSegment() == gpRelative) {
+      *fields[i] += NullGuard;
+      op.flags |= GlobalX << i;
+    }
+  }
+  if (z == NULL)
+    op.flags |= ImmZ;
+  ops.push_back(op);
+}
+
+void Interpreter::AppendJump(OpCode code, Location *test, const char *label)
+{
+  fixups.push_back(std::make_pair((int) ops.size(), std::string(label)));
+  Append(code, NULL, test);
+}
+
+
+/* Method: Decode
+ * --------------
+ * Translates one Tac instruction into operations. Calls to the built-in
+ * routines are recognized by label, and a call's result is picked up
+ * by a separate ResultOp after it returns.
+ */
+void Interpreter::Decode(Instruction *instr)
+{
+  if (LoadConstant *lc = dynamic_cast<LoadConstant *>(instr)) {
+    Append(ConstOp, lc->GetDst(), NULL, NULL, lc->GetValue());
+  } else if (LoadStringConstant *ls = dynamic_cast<LoadStringConstant *>(instr)) {
+    Append(ConstOp, ls->GetDst(), NULL, NULL, StringAddress(ls->GetString()));
+  } else if (LoadLabel *ll = dynamic_cast<LoadLabel *>(instr)) {
+    if (vtables.find(ll->GetLabel()) == vtables.end())
+      Failure("Interpreter: no data for label %s", ll->GetLabel());
+    Append(ConstOp, ll->GetDst(), NULL, NULL, vtables[ll->GetLabel()]);
+  } else if (Assign *a = dynamic_cast<Assign *>(instr)) {
+    Append(CopyOp, a->GetDst(), a->GetSrc());
+  } else if (Load *l = dynamic_cast<Load *>(instr)) {
+    Append(LoadOp, l->GetDst(), l->GetSrc(), NULL, l->GetOffset());
+  } else if (Store *s = dynamic_cast<Store *>(instr)) {
+    Append(StoreOp, s->GetDst(), s->GetSrc(), NULL, s->GetOffset());
+  } else if (BinaryOp *b = dynamic_cast<BinaryOp *>(instr)) {
+    Append((OpCode) (AddOp + b->GetCode()), b->GetDst(), b->GetOp1(),
+           b->GetOp2(), b->GetImm());
+  } else if (Label *lab = dynamic_cast<Label *>(instr)) {
+    labels[lab->GetLabel()] = ops.size();
+  } else if (Goto *g = dynamic_cast<Goto *>(instr)) {
+    AppendJump(GotoOp, NULL, g->GetLabel());
+  } else if (IfZ *z = dynamic_cast<IfZ *>(instr)) {
+    AppendJump(IfZOp, z->GetTest(), z->GetLabel());
+  } else if (IfNZ *nz = dynamic_cast<IfNZ *>(instr)) {
+    AppendJump(IfNZOp, nz->GetTest(), nz->GetLabel());
+  } else if (BeginFunc *bf = dynamic_cast<BeginFunc *>(instr)) {
+    Append(EnterOp, NULL, NULL, NULL, bf->GetFrameSize());
+  } else if (dynamic_cast<EndFunc *>(instr)) {
+    Append(LeaveOp);
+  } else if (Return *r = dynamic_cast<Return *>(instr)) {
+    Append(LeaveOp, NULL, r->GetValue(), NULL, r->GetValue() != NULL);
+  } else if (PushParam *p = dynamic_cast<PushParam *>(instr)) {
+    Append(PushOp, NULL, p->GetParam());
+  } else if (PopParams *pp = dynamic_cast<PopParams *>(instr)) {
+    Append(PopOp, NULL, NULL, NULL, pp->GetNumBytes());
+  } else if (LCall *call = dynamic_cast<LCall *>(instr)) {
+    int builtin = 0;
+    while (builtin < NumBuiltins && strcmp(call->GetLabel(), builtinNames[builtin]))
+      builtin++;
+    if (builtin < NumBuiltins) {
+      Append(BuiltinOp, NULL, NULL, NULL, builtin);
+    } else if (strcmp(call->GetLabel(), "_Halt") == 0) {
+      Append(HaltOp);
+    } else {
+      AppendJump(CallOp, NULL, call->GetLabel());
+    }
+    if (call->GetDst())
+      Append(ResultOp, call->GetDst());
+  } else if (ACall *ac = dynamic_cast<ACall *>(instr)) {
+    Append(CallAddrOp, NULL, ac->GetMethodAddr());
+    if (ac->GetDst())
+      Append(ResultOp, ac->GetDst());
+  } else if (ErrorStub *es = dynamic_cast<ErrorStub *>(instr)) {
+    std::string quoted = std::string("\"") + es->GetMessage() + "\"";
+    labels[es->GetLabel()] = ops.size();
+    Append(FailOp, NULL, NULL, NULL, StringAddress(quoted.c_str()));
+  } else if (!dynamic_cast<VTable *>(instr)) {
+    Failure("Interpreter: no translation for Tac '%s'", instr->GetPrinted());
+  }
+}
+
+
+int32_t Interpreter::CallBuiltin(int code, uint32_t sp)
+{
+  int32_t arg = Word(sp + 4);
+  switch (code) {
+  case PrintInt:
+    printf("%d", arg);
+    return 0;
+  case PrintString:
+    Word(arg);
+    fputs(mem + arg, stdout);
+    return 0;
+  case PrintBool:
+    fputs(arg ? "true" : "false", stdout);
+    return 0;
+  case Alloc: {
+    uint32_t size = (arg + 7) & ~7;
+    if (arg < 0 || heapTop + size + 4096 > sp)
+      Fault("out of memory");
+    heapTop += size;
+    return heapTop - size;
+  }
+  case ReadLine: {
+    char *buf = mem + heapTop;
+    if (heapTop + 104 + 4096 > sp)
+      Fault("out of memory");
+    if (fgets(buf, 101, in) != NULL && strchr(buf, '\n'))
+      *strchr(buf, '\n') = '\0';
+    heapTop += 104;
+    return buf - mem;
+  }
+  case ReadInteger: {
+    char line[256];
+    return fgets(line, sizeof(line), in) ? atoi(line) : 0;
+  }
+  case StringEqual:
+    Word(arg);
+    Word(Word(sp + 8));
+    return strcmp(mem + arg, mem + Word(sp + 8)) == 0;
+  }
+  return 0;
+}
+
+
+/* Method: Execute
+ * ---------------
+ * The dispatch loop. Registers are kept in locals; fp-relative operands
+ * are fp plus the field, global ones the field itself.
+ */
+void Interpreter::Execute(int pc)
+{
+  uint32_t sp = memSize - 4, fp = sp;
+  int32_t ra = -1, rv = 0;
+#define V(field, global) Word((op.flags & (global)) ? op.field : fp + op.field)
+#define Z ((op.flags & ImmZ) ? op.z : V(z, GlobalZ))
+
+  for (;;) {
+    const Op &op = ops[pc++];
+    switch (op.code) {
+    case ConstOp:  V(x, GlobalX) = op.z; break;
+    case CopyOp:   V(x, GlobalX) = V(y, GlobalY); break;
+    case LoadOp:   V(x, GlobalX) = Word(V(y, GlobalY) + op.z); break;
+    case StoreOp:  Word(V(x, GlobalX) + op.z) = V(y, GlobalY); break;
+    case AddOp:
+    case SubOp: {
+      // signed overflow traps, as add and sub do on MIPS
+      int32_t result;
+      if (op.code == AddOp ? __builtin_add_overflow(V(y, GlobalY), Z, &result)
+                           : __builtin_sub_overflow(V(y, GlobalY), Z, &result))
+        Fault("arithmetic overflow");
+      V(x, GlobalX) = result;
+      break;
+    }
+    case MulOp:    V(x, GlobalX) = (uint32_t) V(y, GlobalY) * (uint32_t) Z; break;
+    case DivOp:
+    case ModOp: {
+      int32_t a = V(y, GlobalY), b = Z;
+      if (b == 0)
+        Fault("division by zero");
+      if (b == -1) // INT_MIN / -1 traps on the host
+        V(x, GlobalX) = op.code == DivOp ? -(uint32_t) a : 0;
+      else
+        V(x, GlobalX) = op.code == DivOp ? a / b : a % b;
+      break;
+    }
+    case EqOp:     V(x, GlobalX) = V(y, GlobalY) == Z; break;
+    case LessOp:   V(x, GlobalX) = V(y, GlobalY) < Z; break;
+    case AndOp:    V(x, GlobalX) = V(y, GlobalY) & Z; break;
+    case OrOp:     V(x, GlobalX) = V(y, GlobalY) | Z; break;
+    case GotoOp:   pc = op.x; break;
+    case IfZOp:    if (V(y, GlobalY) == 0) pc = op.x; break;
+    case IfNZOp:   if (V(y, GlobalY) != 0) pc = op.x; break;
+    case EnterOp:
+      sp -= 8;
+      Word(sp + 8) = fp;
+      Word(sp + 4) = ra;
+      fp = sp + 8;
+      sp -= op.z;
+      if (sp < heapTop + 4096)
+        Fault("stack overflow");
+      break;
+    case LeaveOp:
+      if (op.z)
+        rv = V(y, GlobalY);
+      sp = fp;
+      ra = Word(fp - 4);
+      fp = Word(fp);
+      if (ra < 0)
+        return;
+      pc = ra;
+      break;
+    case PushOp:
+      sp -= 4;
+      Word(sp + 4) = V(y, GlobalY);
+      break;
+    case PopOp:    sp += op.z; break;
+    case CallOp:   ra = pc; pc = op.x; break;
+    case CallAddrOp:
+      ra = pc;
+      pc = V(y, GlobalY);
+      if ((uint32_t) pc >= ops.size())
+        Fault("bad method address");
+      break;
+    case ResultOp: V(x, GlobalX) = rv; break;
+    case BuiltinOp: rv = CallBuiltin(op.z, sp); break;
+    case FailOp:
+      fputs(mem + op.z, stdout);
+      return;
+    case HaltOp:
+      return;
+    }
+  }
+#undef V
+#undef Z
+}
+
+
+/* Method: Run
+ * -----------
+ * Lays out the globals, vtables and string literals, decodes the
+ * program, resolves the labels and runs it from main.
+ */
+void Interpreter::Run(List<Instruction *> *code, FILE *input)
+{
+  in = input;
+  for (int i = 0; i < code->NumElements(); i++) {
+    Location *operands[3];
+    Instruction *instr = code->Nth(i);
+    for (int n = instr->GetOperands(operands) - 1; n >= 0; n--)
+      if (operands[n]->GetSegment() == gpRelative &&
+          operands[n]->GetOffset() + NullGuard + 4 > heapTop)
+        heapTop = operands[n]->GetOffset() + NullGuard + 4;
+  }
+  heapTop = (heapTop + 7) & ~7;
+  for (int i = 0; i < code->NumElements(); i++) {
+    if (VTable *vt = dynamic_cast<VTable *>(code->Nth(i))) {
+      List<const char *> *methods = vt->GetMethodLabels();
+      std::vector<char> table(4 * methods->NumElements() + 4, 0);
+      int32_t address = StaticData(&table[0], table.size());
+      vtables[vt->GetLabel()] = address;
+      for (int m = 0; m < methods->NumElements(); m++)
+        vtableFixups.push_back(std::make_pair(address + 4 * m,
+                                              std::string(methods->Nth(m))));
+    }
+  }
+
+  for (int i = 0; i < code->NumElements(); i++)
+    Decode(code->Nth(i));
+  for (size_t f = 0; f < fixups.size(); f++) {
+    if (labels.find(fixups[f].second) == labels.end())
+      Failure("Interpreter: undefined label %s", fixups[f].second.c_str());
+    ops[fixups[f].first].x = labels[fixups[f].second];
+  }
+  for (size_t f = 0; f < vtableFixups.size(); f++)
+    Word(vtableFixups[f].first) = labels[vtableFixups[f].second];
+
+  if (labels.find("main") == labels.end())
+    Failure("Interpreter: no main");
+  if (IsOptionOn("jit"))
+    Jit(this).Run(labels["main"]);
+  else
+    Execute(labels["main"]);
+  fflush(stdout);
+}
@@ -0,0 +1,80 @@
+/* File: interp.h
+ * --------------
+ * The Interpreter runs the Tac of a whole program inside the compiler,
+ * with no assembly or simulator involved (dcc -run). The instruction
+ * list is first decoded into a compact array of fixed size operations
+ * with labels resolved to indices, then a dispatch loop executes them.
+ *
+ * The machine it emulates is the one the Mips class targets: a single
+ * array of memory with the globals at gp, the heap above them and the
+ * stack at the top, growing down. Frames are laid out exactly like the
+ * MIPS ones (saved fp and return address below fp, parameters above,
+ * locals and temps below), so each fp- or gp-relative Location is a
+ * fixed offset from one of the two registers. The built-in routines
+ * (_Alloc, _PrintInt, ...) are implemented natively.
+ */
+
+#ifndef _H_interp
+#define _H_interp
+
+#include "tac.h"
+#include "list.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Interpreter {
+    friend class Jit;
+
+  public:
+    Interpreter();
+    ~Interpreter();
+
+    // Runs the program until main returns or it halts. The program
+    // reads its input from in.
+    void Run(List<Instruction *> *code, FILE *in);
+
+  private:
+    typedef enum { ConstOp, CopyOp, LoadOp, StoreOp, AddOp, SubOp, MulOp,
+                   DivOp, ModOp, EqOp, LessOp, AndOp, OrOp, GotoOp, IfZOp,
+                   IfNZOp, EnterOp, LeaveOp, PushOp, PopOp, CallOp,
+                   CallAddrOp, ResultOp, BuiltinOp, FailOp, HaltOp } OpCode;
+
+    typedef enum { PrintInt, PrintString, PrintBool, Alloc, ReadLine,
+                   ReadInteger, StringEqual, NumBuiltins } BuiltinCode;
+
+    // flag bits saying which operands are globals (absolute addresses
+    // rather than fp offsets) and whether z is an immediate
+    enum { GlobalX = 1, GlobalY = 2, GlobalZ = 4, ImmZ = 8 };
+
+    struct Op {
+        uint8_t code, flags;
+        int32_t x, y, z;
+    };
+
+    std::vector<Op> ops;
+    std::map<std::string, int> labels;                // label -> op index
+    std::vector<std::pair<int, std::string> > fixups; // ops[i].x = label
+    std::vector<std::pair<int32_t, std::string> > vtableFixups;
+    std::map<std::string, int32_t> strings;           // literal -> address
+    std::map<std::string, int32_t> vtables;           // label -> address
+
+    char *mem;
+    uint32_t memSize, heapTop;
+    FILE *in;
+
+    int32_t &Word(uint32_t address);
+    int32_t StaticData(const char *bytes, int size);
+    int32_t StringAddress(const char *quoted);
+    void Append(OpCode code, Location *x = NULL, Location *y = NULL,
+                Location *z = NULL, int32_t imm = 0);
+    void AppendJump(OpCode code, Location *test, const char *label);
+    void Decode(Instruction *instr);
+    void Fault(const char *message);
+    int32_t CallBuiltin(int code, uint32_t sp);
+    void Execute(int pc);
+};
+
+#endif
@@ -0,0 +1,691 @@
+/* File: isel.cc
+ * -------------
+ * Implementation of the InstructionSelector class: building trees from
+ * the Tac of a basic block, the rule table and the labelling/reduction
+ * passes of the tree-pattern matcher.
+ */
+
+#include "isel.h"
+#include "mips.h"
+#include "profile.h"
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+using std::string;
+using std::vector;
+
+// TreeNode operators. The first BinaryOp::NumOps agree with BinaryOp::OpCode,
+// the statement roots come last.
+enum {
+    OpCnst = BinaryOp::NumOps, OpLabel, OpVar, OpLoad,
+    OpAssign, OpStore, OpIfZ, OpIfNZ, OpParam, OpRet, OpACall,
+    NumNodeOps
+};
+static const char *const opNames[NumNodeOps] = {
+    "ADD", "SUB", "MUL", "DIV", "MOD", "EQ", "LESS", "AND", "OR",
+    "CNST", "LABEL", "VAR", "LOAD",
+    "ASSIGN", "STORE", "IFZ", "IFNZ", "PARAM", "RET", "ACALL"};
+
+// Nonterminals of the tree grammar
+enum { NtStmt, NtReg, NtAddr, NtCon16, NtUcon16, NtZero, NtPow2, NumNts };
+static const char *const ntNames[NumNts] = {
+    "stmt", "reg", "addr", "con16", "ucon16", "zero", "pow2"};
+
+// Conditions on the value of a CNST node
+typedef enum { Any, Fits16, FitsU16, IsZero, IsPow2 } Predicate;
+
+static const int Infinity = INT_MAX / 2;
+
+// Trees are capped so that evaluating one never needs more registers
+// than $t0-$t9 provide.
+static const int NumTreeRegs = 10, MaxTreeNeed = 8;
+static const char *const treeRegs[NumTreeRegs] = {
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$t8", "$t9"};
+
+
+/* The rule table
+ * --------------
+ * Each rule rewrites a tree pattern into a nonterminal. Patterns are
+ * written in prefix form with operators in upper case and nonterminals
+ * in lower case; a pattern that is just a nonterminal is a chain rule.
+ * The cost is the number of native MIPS instructions the rule emits.
+ * In templates, %0, %1 are the operands matched by the nonterminals of
+ * the pattern (left to right), %r the result register, %c the constant
+ * of a CNST node and %s its log2, %l the label of the node and %a the
+ * stack or global slot of its variable. Rules producing stmt or reg emit
+ * their template as instructions (one per line); the others produce an
+ * operand that is substituted into the rule using them.
+ */
+static const struct {
+    const char *lhs, *pattern;
+    Predicate pred;
+    int cost;
+    const char *tmpl;
+} ruleTable[] = {
+    {"con16",  "CNST",                 Fits16,  0, "%c"},
+    {"ucon16", "CNST",                 FitsU16, 0, "%c"},
+    {"zero",   "CNST",                 IsZero,  0, "0"},
+    {"pow2",   "CNST",                 IsPow2,  0, "%s"},
+    {"addr",   "reg",                  Any,     0, "0(%0)"},
+    {"addr",   "ADD(reg,con16)",       Any,     0, "%1(%0)"},
+
+    {"reg",    "con16",                Any,     1, "li %r, %0"},
+    {"reg",    "CNST",                 Any,     2, "li %r, %c"},
+    {"reg",    "LABEL",                Any,     2, "la %r, %l"},
+    {"reg",    "VAR",                  Any,     1, "lw %r, %a"},
+    {"reg",    "LOAD(addr)",           Any,     1, "lw %r, %0"},
+    {"reg",    "ADD(reg,reg)",         Any,     1, "add %r, %0, %1"},
+    {"reg",    "ADD(reg,con16)",       Any,     1, "addi %r, %0, %1"},
+    {"reg",    "SUB(reg,reg)",         Any,     1, "sub %r, %0, %1"},
+    {"reg",    "MUL(reg,reg)",         Any,     2, "mul %r, %0, %1"},
+    {"reg",    "MUL(reg,pow2)",        Any,     1, "sll %r, %0, %1"},
+    {"reg",    "DIV(reg,reg)",         Any,     4, "div %r, %0, %1"},
+    {"reg",    "MOD(reg,reg)",         Any,     4, "rem %r, %0, %1"},
+    {"reg",    "EQ(reg,reg)",          Any,     2, "xor %r, %0, %1\nsltiu %r, %r, 1"},
+    {"reg",    "EQ(reg,zero)",         Any,     1, "sltiu %r, %0, 1"},
+    {"reg",    "EQ(reg,ucon16)",       Any,     2, "xori %r, %0, %1\nsltiu %r, %r, 1"},
+    {"reg",    "LESS(reg,reg)",        Any,     1, "slt %r, %0, %1"},
+    {"reg",    "LESS(reg,con16)",      Any,     1, "slti %r, %0, %1"},
+    {"reg",    "AND(reg,reg)",         Any,     1, "and %r, %0, %1"},
+    {"reg",    "AND(reg,ucon16)",      Any,     1, "andi %r, %0, %1"},
+    {"reg",    "OR(reg,reg)",          Any,     1, "or %r, %0, %1"},
+    {"reg",    "OR(reg,ucon16)",       Any,     1, "ori %r, %0, %1"},
+
+    {"stmt",   "ASSIGN(reg)",          Any,     1, "sw %0, %a"},
+    {"stmt",   "ASSIGN(zero)",         Any,     1, "sw $zero, %a"},
+    {"stmt",   "STORE(addr,reg)",      Any,     1, "sw %1, %0"},
+    {"stmt",   "STORE(addr,zero)",     Any,     1, "sw $zero, %0"},
+    {"stmt",   "IFZ(reg)",             Any,     1, "beqz %0, %l"},
+    {"stmt",   "IFZ(EQ(reg,reg))",     Any,     1, "bne %0, %1, %l"},
+    {"stmt",   "IFZ(EQ(reg,zero))",    Any,     1, "bnez %0, %l"},
+    {"stmt",   "IFZ(LESS(reg,zero))",  Any,     1, "bgez %0, %l"},
+    {"stmt",   "IFNZ(reg)",            Any,     1, "bnez %0, %l"},
+    {"stmt",   "IFNZ(EQ(reg,reg))",    Any,     1, "beq %0, %1, %l"},
+    {"stmt",   "IFNZ(EQ(reg,zero))",   Any,     1, "beqz %0, %l"},
+    {"stmt",   "IFNZ(LESS(reg,zero))", Any,     1, "bltz %0, %l"},
+    {"stmt",   "PARAM(reg)",           Any,     2, "subu $sp, $sp, 4\nsw %0, 4($sp)"},
+    {"stmt",   "RET(reg)",             Any,     1, "move $v0, %0"},
+    {"stmt",   "ACALL(reg)",           Any,     1, "jalr %0"},
+};
+static const int NumRules = sizeof(ruleTable) / sizeof(ruleTable[0]);
+
+
+// A parsed pattern: either an operator with kids or a nonterminal leaf
+struct Pattern {
+    int op, nt; // op is -1 for a nonterminal leaf
+    Pattern *kids[2];
+};
+
+struct Rule {
+    int lhs;
+    Pattern *pattern;
+    Predicate pred;
+    int cost;
+    const char *tmpl;
+};
+static vector<Rule> rules;
+
+static int LookupName(const char *const *names, int n, const string &name) {
+    for (int i = 0; i < n; i++)
+        if (name == names[i])
+            return i;
+    return -1;
+}
+
+static Pattern *ParsePattern(const char *&p) {
+    const char *start = p;
+    while (*p && *p != '(' && *p != ',' && *p != ')')
+        p++;
+    string name(start, p - start);
+    Pattern *pat = new Pattern;
+    pat->kids[0] = pat->kids[1] = NULL;
+    pat->op = LookupName(opNames, NumNodeOps, name);
+    pat->nt = -1;
+    if (pat->op < 0) {
+        pat->nt = LookupName(ntNames, NumNts, name);
+        if (pat->nt < 0)
+            Failure("Unknown name '%s' in instruction selection rule", name.c_str());
+        return pat;
+    }
+    if (*p == '(') {
+        for (int k = 0; *p != ')'; k++) {
+            p++; // skip ( or ,
+            Assert(k < 2);
+            pat->kids[k] = ParsePattern(p);
+        }
+        p++; // skip )
+    }
+    return pat;
+}
+
+static void InitRules() {
+    if (!rules.empty())
+        return;
+    for (int i = 0; i < NumRules; i++) {
+        const char *p = ruleTable[i].pattern;
+        Rule r;
+        r.lhs = LookupName(ntNames, NumNts, ruleTable[i].lhs);
+        Assert(r.lhs >= 0);
+        r.pattern = ParsePattern(p);
+        r.pred = ruleTable[i].pred;
+        r.cost = ruleTable[i].cost;
+        r.tmpl = ruleTable[i].tmpl;
+        rules.push_back(r);
+    }
+}
+
+
+struct InstructionSelector::TreeNode {
+    int op;
+    int value;         // CNST
+    const char *label; // LABEL, IFZ, IFNZ
+    Location *var;     // VAR, ASSIGN
+    TreeNode *kids[2];
+    int cost[NumNts];  // filled in by the labeller
+    int rule[NumNts];
+};
+
+struct InstructionSelector::Operand {
+    string text;
+    int reg; // register held by the operand, -1 if none
+};
+
+typedef InstructionSelector::TreeNode TreeNode;
+
+static TreeNode *NewNode(int op, TreeNode *left = NULL, TreeNode *right = NULL) {
+    TreeNode *n = new TreeNode;
+    n->op = op;
+    n->value = 0;
+    n->label = NULL;
+    n->var = NULL;
+    n->kids[0] = left;
+    n->kids[1] = right;
+    return n;
+}
+
+static TreeNode *NewConstant(int value) {
+    TreeNode *n = NewNode(OpCnst);
+    n->value = value;
+    return n;
+}
+
+static TreeNode *NewLabel(int op, const char *label, TreeNode *kid = NULL) {
+    TreeNode *n = NewNode(op, kid);
+    n->label = label;
+    return n;
+}
+
+static TreeNode *NewVar(int op, Location *var, TreeNode *kid = NULL) {
+    TreeNode *n = NewNode(op, kid);
+    n->var = var;
+    return n;
+}
+
+// base + offset, with the offset folded into a constant already added
+static TreeNode *NewAddress(TreeNode *base, int offset) {
+    if (offset == 0)
+        return base;
+    if (base->op == BinaryOp::Add && base->kids[1]->op == OpCnst) {
+        long long sum = (long long) base->kids[1]->value + offset;
+        if (sum >= INT_MIN && sum <= INT_MAX) {
+            base->kids[1]->value = (int) sum;
+            return base;
+        }
+    }
+    return NewNode(BinaryOp::Add, base, NewConstant(offset));
+}
+
+static bool Satisfies(Predicate pred, TreeNode *n) {
+    int v = n->value;
+    switch (pred) {
+    case Any:     return true;
+    case Fits16:  return v >= -32768 && v <= 32767;
+    case FitsU16: return v >= 0 && v <= 65535;
+    case IsZero:  return v == 0;
+    case IsPow2:  return v > 0 && (v & (v - 1)) == 0;
+    }
+    return false;
+}
+
+static bool Match(Pattern *p, TreeNode *n, int &cost) {
+    if (p->op < 0) {
+        if (n->cost[p->nt] >= Infinity)
+            return false;
+        cost += n->cost[p->nt];
+        return true;
+    }
+    if (p->op != n->op)
+        return false;
+    for (int k = 0; k < 2 && p->kids[k]; k++)
+        if (!Match(p->kids[k], n->kids[k], cost))
+            return false;
+    return true;
+}
+
+/* Function: LabelTree
+ * -------------------
+ * The bottom-up pass: after labelling the kids, records for each
+ * nonterminal the cheapest rule that derives it at this node. Chain
+ * rules are applied until nothing improves.
+ */
+static void LabelTree(TreeNode *n) {
+    for (int k = 0; k < 2; k++)
+        if (n->kids[k])
+            LabelTree(n->kids[k]);
+    for (int nt = 0; nt < NumNts; nt++) {
+        n->cost[nt] = Infinity;
+        n->rule[nt] = -1;
+    }
+    for (int i = 0; i < rules.size(); i++) {
+        Rule &r = rules[i];
+        int cost = r.cost;
+        if (r.pattern->op < 0 || !Match(r.pattern, n, cost))
+            continue;
+        if (n->op == OpCnst && !Satisfies(r.pred, n))
+            continue;
+        if (cost < n->cost[r.lhs]) {
+            n->cost[r.lhs] = cost;
+            n->rule[r.lhs] = i;
+        }
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int i = 0; i < rules.size(); i++) {
+            Rule &r = rules[i];
+            if (r.pattern->op >= 0 || n->cost[r.pattern->nt] >= Infinity)
+                continue;
+            int cost = n->cost[r.pattern->nt] + r.cost;
+            if (cost < n->cost[r.lhs]) {
+                n->cost[r.lhs] = cost;
+                n->rule[r.lhs] = i;
+                changed = true;
+            }
+        }
+    }
+}
+
+// the (node, nonterminal) pairs matched by the leaves of a pattern
+static void CollectLeaves(Pattern *p, TreeNode *n,
+                          vector<std::pair<TreeNode *, int> > &leaves) {
+    if (p->op < 0) {
+        leaves.push_back(std::make_pair(n, p->nt));
+        return;
+    }
+    for (int k = 0; k < 2 && p->kids[k]; k++)
+        CollectLeaves(p->kids[k], n->kids[k], leaves);
+}
+
+static bool HoldsRegister(int nt) {
+    return nt == NtReg || nt == NtAddr;
+}
+
+static string VarAddress(Location *var) {
+    char buf[32];
+    sprintf(buf, "%d(%s)", var->GetOffset(),
+            var->GetSegment() == fpRelative ? "$fp" : "$gp");
+    return buf;
+}
+
+InstructionSelector::InstructionSelector(Mips *m) : mips(m) {
+    InitRules();
+    for (int i = 0; i < NumTreeRegs; i++)
+        regUsed[i] = false;
+}
+
+int InstructionSelector::AllocReg() {
+    for (int i = 0; i < NumTreeRegs; i++)
+        if (!regUsed[i]) {
+            regUsed[i] = true;
+            return i;
+        }
+    Failure("Instruction selector ran out of registers");
+    return -1;
+}
+
+/* Method: Need
+ * ------------
+ * Number of registers needed to evaluate n as nonterminal nt with the
+ * chosen rules (the Sethi-Ullman number), given that the operands are
+ * evaluated in decreasing order of need.
+ */
+int InstructionSelector::Need(TreeNode *n, int nt) {
+    Rule &r = rules[n->rule[nt]];
+    vector<std::pair<TreeNode *, int> > leaves;
+    CollectLeaves(r.pattern, n, leaves);
+    vector<int> needs;
+    for (int i = 0; i < leaves.size(); i++)
+        needs.push_back(Need(leaves[i].first, leaves[i].second));
+    vector<bool> done(leaves.size(), false);
+    int peak = r.lhs == NtReg ? 1 : 0, held = 0;
+    for (int k = 0; k < leaves.size(); k++) {
+        int next = -1;
+        for (int i = 0; i < leaves.size(); i++)
+            if (!done[i] && (next < 0 || needs[i] > needs[next]))
+                next = i;
+        done[next] = true;
+        peak = std::max(peak, held + needs[next]);
+        if (HoldsRegister(leaves[next].second))
+            held++;
+    }
+    return peak;
+}
+
+/* Method: Reduce
+ * --------------
+ * The top-down pass: emits the rule chosen for deriving n as nt. The
+ * operands of the rule are reduced first, the one needing the most
+ * registers first. Returns the register or operand text the rule
+ * produced.
+ */
+InstructionSelector::Operand InstructionSelector::Reduce(TreeNode *n, int nt) {
+    Assert(n->rule[nt] >= 0);
+    Rule &r = rules[n->rule[nt]];
+    vector<std::pair<TreeNode *, int> > leaves;
+    CollectLeaves(r.pattern, n, leaves);
+    vector<int> needs;
+    for (int i = 0; i < leaves.size(); i++)
+        needs.push_back(Need(leaves[i].first, leaves[i].second));
+    vector<Operand> ops(leaves.size());
+    vector<bool> done(leaves.size(), false);
+    for (int k = 0; k < leaves.size(); k++) {
+        int next = -1;
+        for (int i = 0; i < leaves.size(); i++)
+            if (!done[i] && (next < 0 || needs[i] > needs[next]))
+                next = i;
+        done[next] = true;
+        ops[next] = Reduce(leaves[next].first, leaves[next].second);
+    }
+
+    Operand result;
+    result.reg = -1;
+    bool emits = r.lhs == NtReg || r.lhs == NtStmt;
+    for (int i = 0; i < ops.size(); i++) {
+        if (ops[i].reg < 0)
+            continue;
+        if (emits)
+            regUsed[ops[i].reg] = false; // read before the result is written
+        else
+            result.reg = ops[i].reg;     // stays live inside the operand
+    }
+    if (r.lhs == NtReg)
+        result.reg = AllocReg();
+
+    string text;
+    for (const char *t = r.tmpl; *t; t++) {
+        if (*t != '%') {
+            text += *t;
+            continue;
+        }
+        char buf[32];
+        switch (*++t) {
+        case 'r': text += treeRegs[result.reg]; break;
+        case 'c': sprintf(buf, "%d", n->value); text += buf; break;
+        case 's': {
+            int shift = 0;
+            while ((1 << shift) != n->value) shift++;
+            sprintf(buf, "%d", shift);
+            text += buf;
+            break;
+        }
+        case 'l': text += n->label; break;
+        case 'a': text += VarAddress(n->var); break;
+        default:
+            Assert(*t >= '0' && *t - '0' < ops.size());
+            text += ops[*t - '0'].text;
+        }
+    }
+    if (!emits) {
+        result.text = text;
+        return result;
+    }
+    for (size_t start = 0; start < text.size();) {
+        size_t end = text.find('\n', start);
+        if (end == string::npos)
+            end = text.size();
+        Mips::Emit("%s", text.substr(start, end - start).c_str());
+        start = end + 1;
+    }
+    if (r.lhs == NtReg)
+        result.text = treeRegs[result.reg];
+    return result;
+}
+
+void InstructionSelector::EmitTree(TreeNode *root) {
+    LabelTree(root);
+    if (root->rule[NtStmt] < 0)
+        Failure("No instruction selection rule covers %s", opNames[root->op]);
+    Reduce(root, NtStmt);
+}
+
+
+// Registers needed for a tree before tiling, an upper bound used to
+// keep folded trees within the register budget.
+static int TreeNeed(TreeNode *n) {
+    if (n->kids[0] == NULL)
+        return 1;
+    int l = TreeNeed(n->kids[0]);
+    if (n->kids[1] == NULL)
+        return l;
+    int r = TreeNeed(n->kids[1]);
+    return l == r ? l + 1 : std::max(l, r);
+}
+
+static InstructionSelector::Slot SlotOf(Location *var) {
+    return std::make_pair((int) var->GetSegment(), var->GetOffset());
+}
+
+static bool ReadsVar(TreeNode *n, InstructionSelector::Slot slot) {
+    if (n->op == OpVar && SlotOf(n->var) == slot)
+        return true;
+    for (int k = 0; k < 2; k++)
+        if (n->kids[k] && ReadsVar(n->kids[k], slot))
+            return true;
+    return false;
+}
+
+// loads read memory a store may change, and loads or divisions can fault,
+// so such trees are not moved past a store
+static bool ReadsMemoryOrFaults(TreeNode *n, InstructionSelector::Slot) {
+    if (n->op == OpLoad || n->op == BinaryOp::Div || n->op == BinaryOp::Mod)
+        return true;
+    for (int k = 0; k < 2; k++)
+        if (n->kids[k] && ReadsMemoryOrFaults(n->kids[k], InstructionSelector::Slot()))
+            return true;
+    return false;
+}
+
+static bool Always(TreeNode *, InstructionSelector::Slot) {
+    return true;
+}
+
+
+/* Method: CountFunction
+ * ---------------------
+ * Counts definitions and uses of every stack slot in the function that
+ * starts at code[begin]. Only a temp with a single definition and a
+ * single use can be folded into its use.
+ */
+void InstructionSelector::CountFunction(List<Instruction *> *code, int begin) {
+    defs.clear();
+    uses.clear();
+    for (int i = begin; i < code->NumElements(); i++) {
+        Instruction *instr = code->Nth(i);
+        Location *d = NULL, *u[2] = {NULL, NULL};
+        if (LoadConstant *lc = dynamic_cast<LoadConstant *>(instr)) {
+            d = lc->GetDst();
+        } else if (LoadStringConstant *ls = dynamic_cast<LoadStringConstant *>(instr)) {
+            d = ls->GetDst();
+        } else if (LoadLabel *ll = dynamic_cast<LoadLabel *>(instr)) {
+            d = ll->GetDst();
+        } else if (Assign *a = dynamic_cast<Assign *>(instr)) {
+            d = a->GetDst();
+            u[0] = a->GetSrc();
+        } else if (Load *l = dynamic_cast<Load *>(instr)) {
+            d = l->GetDst();
+            u[0] = l->GetSrc();
+        } else if (Store *s = dynamic_cast<Store *>(instr)) {
+            u[0] = s->GetDst();
+            u[1] = s->GetSrc();
+        } else if (BinaryOp *b = dynamic_cast<BinaryOp *>(instr)) {
+            d = b->GetDst();
+            u[0] = b->GetOp1();
+            u[1] = b->GetOp2();
+        } else if (IfZ *z = dynamic_cast<IfZ *>(instr)) {
+            u[0] = z->GetTest();
+        } else if (IfNZ *nz = dynamic_cast<IfNZ *>(instr)) {
+            u[0] = nz->GetTest();
+        } else if (Return *r = dynamic_cast<Return *>(instr)) {
+            u[0] = r->GetValue();
+        } else if (PushParam *p = dynamic_cast<PushParam *>(instr)) {
+            u[0] = p->GetParam();
+        } else if (LCall *call = dynamic_cast<LCall *>(instr)) {
+            d = call->GetDst();
+        } else if (ACall *ac = dynamic_cast<ACall *>(instr)) {
+            d = ac->GetDst();
+            u[0] = ac->GetMethodAddr();
+        } else if (dynamic_cast<EndFunc *>(instr)) {
+            break;
+        }
+        if (d)
+            defs[SlotOf(d)]++;
+        for (int k = 0; k < 2; k++)
+            if (u[k])
+                uses[SlotOf(u[k])]++;
+    }
+}
+
+// The tree computing var: the folded definition if there is one pending,
+// otherwise a read of its slot.
+TreeNode *InstructionSelector::Use(Location *var) {
+    std::map<Slot, Pending>::iterator it = pending.find(SlotOf(var));
+    if (it == pending.end())
+        return NewVar(OpVar, var);
+    TreeNode *tree = it->second.tree;
+    pending.erase(it);
+    return tree;
+}
+
+void InstructionSelector::Define(Location *dst, TreeNode *tree) {
+    Slot slot = SlotOf(dst);
+    Flush(ReadsVar, slot); // they must see the old value
+    if (dst->GetSegment() == fpRelative && defs[slot] == 1 &&
+        uses[slot] == 1 && TreeNeed(tree) <= MaxTreeNeed) {
+        Pending p = {dst, tree};
+        pending[slot] = p;
+        pendingOrder.push_back(slot);
+    } else {
+        EmitTree(NewVar(OpAssign, dst, tree));
+    }
+}
+
+// Stores the pending trees for which mustFlush holds into their slots,
+// in the order they were defined.
+void InstructionSelector::Flush(bool (*mustFlush)(TreeNode *, Slot), Slot written) {
+    vector<Slot> keep;
+    for (int i = 0; i < pendingOrder.size(); i++) {
+        std::map<Slot, Pending>::iterator it = pending.find(pendingOrder[i]);
+        if (it == pending.end())
+            continue; // already used
+        if (!mustFlush(it->second.tree, written)) {
+            keep.push_back(pendingOrder[i]);
+            continue;
+        }
+        Pending p = it->second;
+        pending.erase(it);
+        EmitTree(NewVar(OpAssign, p.dst, p.tree));
+    }
+    pendingOrder = keep;
+}
+
+void InstructionSelector::FlushAll() {
+    Flush(Always, Slot());
+}
+
+static bool IsCommutative(int op) {
+    return op == BinaryOp::Add || op == BinaryOp::Mul || op == BinaryOp::Eq ||
+           op == BinaryOp::And || op == BinaryOp::Or;
+}
+
+/* Method: Select
+ * --------------
+ * Handles one Tac instruction: expression instructions become (pending)
+ * trees, the instructions that consume them become tree roots that are
+ * tiled right away, and everything else is handed to the Mips class
+ * after the pending trees are stored.
+ */
+void InstructionSelector::Select(Instruction *instr) {
+    Mips::SourceLine(instr->GetLine());
+    if (*instr->GetPrinted())
+        Mips::Emit("# %s", instr->GetPrinted());
+
+    if (LoadConstant *lc = dynamic_cast<LoadConstant *>(instr)) {
+        Define(lc->GetDst(), NewConstant(lc->GetValue()));
+    } else if (LoadStringConstant *ls = dynamic_cast<LoadStringConstant *>(instr)) {
+        Define(ls->GetDst(), NewLabel(OpLabel, mips->StringLabel(ls->GetString())));
+    } else if (LoadLabel *ll = dynamic_cast<LoadLabel *>(instr)) {
+        Define(ll->GetDst(), NewLabel(OpLabel, ll->GetLabel()));
+    } else if (Assign *a = dynamic_cast<Assign *>(instr)) {
+        Define(a->GetDst(), Use(a->GetSrc()));
+    } else if (Load *l = dynamic_cast<Load *>(instr)) {
+        TreeNode *addr = NewAddress(Use(l->GetSrc()), l->GetOffset());
+        Define(l->GetDst(), NewNode(OpLoad, addr));
+    } else if (BinaryOp *b = dynamic_cast<BinaryOp *>(instr)) {
+        int op = b->GetCode();
+        TreeNode *left = Use(b->GetOp1());
+        TreeNode *right = b->GetOp2() ? Use(b->GetOp2()) : NewConstant(b->GetImm());
+        if (op == BinaryOp::Sub && right->op == OpCnst && right->value != INT_MIN) {
+            op = BinaryOp::Add;
+            right->value = -right->value;
+        }
+        if (IsCommutative(op) && left->op == OpCnst && right->op != OpCnst)
+            std::swap(left, right);
+        Define(b->GetDst(), NewNode(op, left, right));
+    } else if (Store *s = dynamic_cast<Store *>(instr)) {
+        TreeNode *addr = NewAddress(Use(s->GetDst()), s->GetOffset());
+        TreeNode *val = Use(s->GetSrc());
+        Flush(ReadsMemoryOrFaults, Slot());
+        EmitTree(NewNode(OpStore, addr, val));
+    } else if (IfZ *z = dynamic_cast<IfZ *>(instr)) {
+        TreeNode *test = Use(z->GetTest());
+        FlushAll();
+        EmitTree(NewLabel(OpIfZ, z->GetLabel(), test));
+    } else if (IfNZ *nz = dynamic_cast<IfNZ *>(instr)) {
+        TreeNode *test = Use(nz->GetTest());
+        FlushAll();
+        EmitTree(NewLabel(OpIfNZ, nz->GetLabel(), test));
+    } else if (PushParam *p = dynamic_cast<PushParam *>(instr)) {
+        EmitTree(NewNode(OpParam, Use(p->GetParam())));
+    } else if (ACall *ac = dynamic_cast<ACall *>(instr)) {
+        TreeNode *fn = Use(ac->GetMethodAddr());
+        FlushAll();
+        EmitTree(NewNode(OpACall, fn));
+        if (ac->GetDst())
+            Mips::Emit("sw $v0, %s", VarAddress(ac->GetDst()).c_str());
+    } else if (Return *r = dynamic_cast<Return *>(instr)) {
+        TreeNode *val = r->GetValue() ? Use(r->GetValue()) : NULL;
+        FlushAll();
+        if (val)
+            EmitTree(NewNode(OpRet, val));
+        mips->EmitReturn(NULL);
+    } else if (dynamic_cast<PopParams *>(instr)) {
+        instr->EmitSpecific(mips);
+    } else {
+        FlushAll();
+        instr->EmitSpecific(mips);
+    }
+}
+
+void InstructionSelector::SelectProgram(List<Instruction *> *code,
+                                        Profiler *profiler) {
+    for (int i = 0; i < code->NumElements(); i++) {
+        Instruction *instr = code->Nth(i);
+        if (dynamic_cast<BeginFunc *>(instr))
+            CountFunction(code, i);
+        if (profiler) profiler->Before(code, i);
+        Select(instr);
+        if (profiler) profiler->After(code, i);
+    }
+    FlushAll();
+}
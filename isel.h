@@ -0,0 +1,75 @@
+/* File: isel.h
+ * ------------
+ * The InstructionSelector is the optimizing alternative to the one Tac
+ * instruction at a time translation done by the Emit methods of the Mips
+ * class. It is used when compiling with -O.
+ *
+ * Within each basic block the Tac is turned back into expression trees:
+ * a temp that is defined once and used once has its defining expression
+ * folded into the use (temps used more than once stay in their stack
+ * slot, which is where the DAG is cut into trees). The trees are then
+ * tiled with MIPS instructions by a bottom-up rewrite system in the
+ * style of iburg. A rule table gives, for each tree pattern, the
+ * nonterminal it produces, its cost in machine instructions and the
+ * assembly to emit. A bottom-up dynamic programming pass labels every
+ * node with the cheapest rule for each nonterminal and a top-down pass
+ * emits the chosen rules, evaluating intermediate values in $t0-$t9.
+ * This lets "lw" fold an address offset, immediates fold into I-type
+ * instructions and a compare fold into the conditional branch.
+ *
+ * Instructions the rules do not cover (function entry/exit, calls to a
+ * label, vtables, ...) are emitted by the usual Mips methods.
+ */
+
+#ifndef _H_isel
+#define _H_isel
+
+#include "list.h"
+#include "tac.h"
+#include <map>
+#include <utility>
+#include <vector>
+
+class Mips;
+class Profiler;
+
+class InstructionSelector {
+  public:
+    InstructionSelector(Mips *mips);
+
+    // Translates the whole program, as an alternative to emitting each
+    // instruction of the list with Instruction::Emit. The profiler, if
+    // any, is told about each instruction.
+    void SelectProgram(List<Instruction *> *code, Profiler *profiler = NULL);
+
+    struct TreeNode;
+    typedef std::pair<int, int> Slot; // segment and offset of a variable
+
+  private:
+    struct Operand;
+    struct Pending {
+        Location *dst;
+        TreeNode *tree;
+    };
+
+    Mips *mips;
+    std::map<Slot, int> defs, uses;   // counts for the current function
+    std::map<Slot, Pending> pending;  // folded temps waiting for their use
+    std::vector<Slot> pendingOrder;
+    bool regUsed[10];
+
+    void CountFunction(List<Instruction *> *code, int begin);
+    void Select(Instruction *instr);
+
+    TreeNode *Use(Location *var);
+    void Define(Location *dst, TreeNode *tree);
+    void Flush(bool (*mustFlush)(TreeNode *, Slot), Slot written);
+    void FlushAll();
+
+    void EmitTree(TreeNode *root);
+    Operand Reduce(TreeNode *n, int nt);
+    int Need(TreeNode *n, int nt);
+    int AllocReg();
+};
+
+#endif
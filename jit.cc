@@ -0,0 +1,377 @@
+/* File: jit.cc
+ * ------------
+ * Implementation of the Jit class. The templates are written out as
+ * bytes with the instruction they encode alongside; displacements,
+ * immediates and rel32 targets follow them as each operation is compiled.
+ */
+
+#include "jit.h"
+#include "utility.h"
+#include <string.h>
+#include <sys/mman.h>
+
+// where the entry trampoline keeps the caller's stack pointer, so that
+// halting can unwind straight out of any depth of Decaf calls
+static uint64_t savedRsp;
+
+static const uint8_t entryCode[] = {
+  0x53,                         // push %rbx
+  0x55,                         // push %rbp
+  0x41, 0x54,                   // push %r12
+  0x41, 0x55,                   // push %r13
+  0x41, 0x56,                   // push %r14
+  0x41, 0x57,                   // push %r15
+  0x49, 0x89, 0xfc,             // mov %rdi, %r12      memory
+  0x49, 0x89, 0xf7,             // mov %rsi, %r15      &heapTop
+  0x49, 0x89, 0xd6,             // mov %rdx, %r14      op addresses
+  0x41, 0x89, 0xcd,             // mov %ecx, %r13d     sp
+  0x89, 0xcb,                   // mov %ecx, %ebx      fp
+  0x48, 0xb8,                   // mov $&savedRsp, %rax
+};
+static const uint8_t entryCall[] = {
+  0x48, 0x89, 0x20,             // mov %rsp, (%rax)
+  0x4c, 0x89, 0xcc,             // mov %r9, %rsp       own stack
+  0x41, 0xff, 0xd0,             // call *%r8           main
+  0x48, 0xb8,                   // mov $&savedRsp, %rax
+};
+static const uint8_t exitCode[] = {
+  0x48, 0x8b, 0x20,             // mov (%rax), %rsp
+  0x41, 0x5f,                   // pop %r15
+  0x41, 0x5e,                   // pop %r14
+  0x41, 0x5d,                   // pop %r13
+  0x41, 0x5c,                   // pop %r12
+  0x5d,                         // pop %rbp
+  0x5b,                         // pop %rbx
+  0xc3,                         // ret
+};
+
+static const uint8_t aluCode[][8] = {
+  {2, 0x01, 0xc8},              // add %ecx, %eax
+  {2, 0x29, 0xc8},              // sub %ecx, %eax
+  {3, 0x0f, 0xaf, 0xc1},        // imul %ecx, %eax
+  {0}, {0},                     // div and mod are done separately
+  {7, 0x39, 0xc8, 0x0f, 0x94, 0xc0, 0x0f, 0xb6}, // cmp; sete %al; movzbl
+  {7, 0x39, 0xc8, 0x0f, 0x9c, 0xc0, 0x0f, 0xb6}, // cmp; setl %al; movzbl
+  {2, 0x21, 0xc8},              // and %ecx, %eax
+  {2, 0x09, 0xc8},              // or %ecx, %eax
+};
+
+static const uint8_t je[] = {0x0f, 0x84}, jne[] = {0x0f, 0x85},
+                     jb[] = {0x0f, 0x82}, ja[] = {0x0f, 0x87},
+                     jae[] = {0x0f, 0x83}, jo[] = {0x0f, 0x80},
+                     jmp[] = {0xe9}, call[] = {0xe8};
+
+Jit::Jit(Interpreter *i) : interp(i), epilogue(0) {}
+
+void Jit::Bytes(const uint8_t *bytes, int n)
+{
+  code.insert(code.end(), bytes, bytes + n);
+}
+
+void Jit::Imm32(int32_t v)
+{
+  Bytes((const uint8_t *) &v, 4);
+}
+
+void Jit::Imm64(uint64_t v)
+{
+  Bytes((const uint8_t *) &v, 8);
+}
+
+void Jit::Patch32(size_t at, int32_t v)
+{
+  memcpy(&code[at], &v, 4);
+}
+
+/* Method: Slot
+ * ------------
+ * mov between %eax (reg 0) or %ecx (reg 1) and a variable: opcode 0x8b
+ * loads, 0x89 stores. Frame slots are (%r12,%rbx) plus the fp offset,
+ * globals (%r12) plus their address.
+ */
+void Jit::Slot(uint8_t opcode, int reg, int32_t field, bool global)
+{
+  Byte(0x41);
+  Byte(opcode);
+  Byte(0x84 | reg << 3);
+  Byte(global ? 0x24 : 0x1c);
+  Imm32(field);
+}
+
+void Jit::JumpToOp(const uint8_t *opcode, int n, int op)
+{
+  Bytes(opcode, n);
+  jumps.push_back(std::make_pair(code.size(), op));
+  Imm32(0);
+}
+
+void Jit::JumpToFault(const uint8_t *opcode, int n, FaultKind kind)
+{
+  Bytes(opcode, n);
+  faultJumps.push_back(std::make_pair(code.size(), (int) kind));
+  Imm32(0);
+}
+
+/* Method: CallHelper
+ * ------------------
+ * Calls one of the static helpers below with the interpreter as first
+ * argument (%esi and %edx are set by the caller), realigning the host
+ * stack for it in %rbp, which the callee preserves.
+ */
+void Jit::CallHelper(void *helper)
+{
+  static const uint8_t align[] = {0x48, 0x89, 0xe5,        // mov %rsp, %rbp
+                                  0x48, 0x83, 0xe4, 0xf0}; // and $-16, %rsp
+  static const uint8_t restore[] = {0xff, 0xd0,            // call *%rax
+                                    0x48, 0x89, 0xec};     // mov %rbp, %rsp
+  Bytes(align, sizeof(align));
+  Byte(0x48), Byte(0xbf), Imm64((uint64_t) interp);      // mov $interp, %rdi
+  Byte(0x48), Byte(0xb8), Imm64((uint64_t) helper);      // mov $helper, %rax
+  Bytes(restore, sizeof(restore));
+}
+
+// Faults unless the address in %eax is a valid word of Decaf memory,
+// the check Interpreter::Word does
+void Jit::CheckAddress()
+{
+  static const uint8_t lea[] = {0x8d, 0x48, 0xf8};        // lea -8(%rax), %ecx
+  Bytes(lea, sizeof(lea));
+  Byte(0x81), Byte(0xf9), Imm32(interp->memSize - 12);    // cmp $n, %ecx
+  JumpToFault(ja, 2, MemoryFault);
+}
+
+
+/* Method: Compile
+ * ---------------
+ * Appends the machine code for one operation. Operand y is loaded into
+ * %eax and z into %ecx, x is stored from %eax.
+ */
+void Jit::Compile(const Interpreter::Op &op)
+{
+  bool gx = op.flags & Interpreter::GlobalX, gy = op.flags & Interpreter::GlobalY;
+  bool immZ = op.flags & Interpreter::ImmZ;
+
+  switch (op.code) {
+  case Interpreter::ConstOp:
+    Byte(0x41), Byte(0xc7), Byte(0x84), Byte(gx ? 0x24 : 0x1c); // movl $z, x
+    Imm32(op.x);
+    Imm32(op.z);
+    break;
+  case Interpreter::CopyOp:
+    Slot(0x8b, 0, op.y, gy);
+    Slot(0x89, 0, op.x, gx);
+    break;
+  case Interpreter::LoadOp:
+  case Interpreter::StoreOp: {
+    static const uint8_t load[] = {0x41, 0x8b, 0x04, 0x04};  // mov (%r12,%rax), %eax
+    static const uint8_t store[] = {0x41, 0x89, 0x0c, 0x04}; // mov %ecx, (%r12,%rax)
+    bool isLoad = op.code == Interpreter::LoadOp;
+    Slot(0x8b, 0, isLoad ? op.y : op.x, isLoad ? gy : gx);
+    if (op.z)
+      Byte(0x05), Imm32(op.z);                                 // add $z, %eax
+    CheckAddress();
+    if (isLoad) {
+      Bytes(load, sizeof(load));
+      Slot(0x89, 0, op.x, gx);
+    } else {
+      Slot(0x8b, 1, op.y, gy);
+      Bytes(store, sizeof(store));
+    }
+    break;
+  }
+  case Interpreter::AddOp: case Interpreter::SubOp: case Interpreter::MulOp:
+  case Interpreter::DivOp: case Interpreter::ModOp: case Interpreter::EqOp:
+  case Interpreter::LessOp: case Interpreter::AndOp: case Interpreter::OrOp: {
+    Slot(0x8b, 0, op.y, gy);
+    if (immZ)
+      Byte(0xb9), Imm32(op.z);                                 // mov $z, %ecx
+    else
+      Slot(0x8b, 1, op.z, op.flags & Interpreter::GlobalZ);
+    int alu = op.code - Interpreter::AddOp;
+    if (op.code == Interpreter::DivOp || op.code == Interpreter::ModOp) {
+      // INT_MIN / -1 traps on x86, so -1 is done by hand
+      bool div = op.code == Interpreter::DivOp;
+      static const uint8_t test[] = {0x85, 0xc9};              // test %ecx, %ecx
+      static const uint8_t minusOne[] = {0x83, 0xf9, 0xff,     // cmp $-1, %ecx
+                                         0x75, 0x04};          // jne idiv
+      static const uint8_t neg[] = {0xf7, 0xd8, 0xeb, 0x03};   // neg %eax; jmp done
+      static const uint8_t zero[] = {0x31, 0xc0, 0xeb, 0x05};  // xor %eax, %eax; jmp done
+      static const uint8_t idiv[] = {0x99, 0xf7, 0xf9,         // cltd; idiv %ecx
+                                     0x89, 0xd0};              // mov %edx, %eax
+      Bytes(test, sizeof(test));
+      JumpToFault(je, 2, DivideFault);
+      Bytes(minusOne, sizeof(minusOne));
+      Bytes(div ? neg : zero, 4);
+      Bytes(idiv, div ? 3 : 5);
+    } else {
+      Bytes(&aluCode[alu][1], aluCode[alu][0]);
+      if (op.code == Interpreter::EqOp || op.code == Interpreter::LessOp)
+        Byte(0xc0);                                            // ... %al, %eax
+      if (op.code == Interpreter::AddOp || op.code == Interpreter::SubOp)
+        JumpToFault(jo, 2, OverflowFault);
+    }
+    Slot(0x89, 0, op.x, gx);
+    break;
+  }
+  case Interpreter::GotoOp:
+    JumpToOp(jmp, 1, op.x);
+    break;
+  case Interpreter::IfZOp:
+  case Interpreter::IfNZOp:
+    Slot(0x8b, 0, op.y, gy);
+    Byte(0x85), Byte(0xc0);                                    // test %eax, %eax
+    JumpToOp(op.code == Interpreter::IfZOp ? je : jne, 2, op.x);
+    break;
+  case Interpreter::EnterOp: {
+    static const uint8_t enter[] = {
+      0x41, 0x83, 0xed, 0x08,       // sub $8, %r13d
+      0x43, 0x89, 0x5c, 0x2c, 0x08, // mov %ebx, 8(%r12,%r13)   save fp
+      0x41, 0x8d, 0x5d, 0x08,       // lea 8(%r13), %ebx        new fp
+    };
+    Bytes(enter, sizeof(enter));
+    Byte(0x41), Byte(0x81), Byte(0xed), Imm32(op.z);   // sub $z, %r13d
+    Byte(0x41), Byte(0x8b), Byte(0x07);                // mov (%r15), %eax
+    Byte(0x05), Imm32(4096);                           // add $4096, %eax
+    Byte(0x41), Byte(0x39), Byte(0xc5);                // cmp %eax, %r13d
+    JumpToFault(jb, 2, StackFault);
+    break;
+  }
+  case Interpreter::LeaveOp: {
+    static const uint8_t leave[] = {
+      0x41, 0x89, 0xdd,             // mov %ebx, %r13d          sp = fp
+      0x41, 0x8b, 0x1c, 0x1c,       // mov (%r12,%rbx), %ebx    restore fp
+      0xc3,                         // ret
+    };
+    if (op.z)
+      Slot(0x8b, 0, op.y, gy);
+    Bytes(leave, sizeof(leave));
+    break;
+  }
+  case Interpreter::PushOp: {
+    static const uint8_t push[] = {
+      0x41, 0x83, 0xed, 0x04,       // sub $4, %r13d
+      0x43, 0x89, 0x44, 0x2c, 0x04, // mov %eax, 4(%r12,%r13)
+    };
+    Slot(0x8b, 0, op.y, gy);
+    Bytes(push, sizeof(push));
+    break;
+  }
+  case Interpreter::PopOp:
+    Byte(0x41), Byte(0x81), Byte(0xc5), Imm32(op.z);   // add $z, %r13d
+    break;
+  case Interpreter::CallOp:
+    JumpToOp(call, 1, op.x);
+    break;
+  case Interpreter::CallAddrOp: {
+    static const uint8_t callAddr[] = {
+      0x49, 0x8b, 0x04, 0xc6,       // mov (%r14,%rax,8), %rax
+      0xff, 0xd0,                   // call *%rax
+    };
+    Slot(0x8b, 0, op.y, gy);
+    Byte(0x3d), Imm32(interp->ops.size());             // cmp $n, %eax
+    JumpToFault(jae, 2, MethodFault);
+    Bytes(callAddr, sizeof(callAddr));
+    break;
+  }
+  case Interpreter::ResultOp:
+    Slot(0x89, 0, op.x, gx);
+    break;
+  case Interpreter::BuiltinOp:
+    Byte(0xbe), Imm32(op.z);                           // mov $z, %esi
+    Byte(0x44), Byte(0x89), Byte(0xea);                // mov %r13d, %edx
+    CallHelper((void *) Builtin);
+    break;
+  case Interpreter::FailOp:
+  case Interpreter::HaltOp:
+    if (op.code == Interpreter::FailOp) {
+      Byte(0xbe), Imm32(op.z);                         // mov $z, %esi
+      CallHelper((void *) Print);
+    }
+    Byte(0xe9), Imm32(epilogue - (code.size() + 4));  // jmp epilogue
+    break;
+  }
+}
+
+
+int32_t Jit::Builtin(Interpreter *interp, int code, uint32_t sp)
+{
+  return interp->CallBuiltin(code, sp);
+}
+
+void Jit::Print(Interpreter *interp, int32_t address)
+{
+  fputs(interp->mem + address, stdout);
+}
+
+void Jit::Fault(Interpreter *interp, int kind, uint32_t address)
+{
+  if (kind == MemoryFault)
+    interp->Word(address); // reports it the way the interpreter does
+  interp->Fault(kind == DivideFault ? "division by zero" :
+                kind == OverflowFault ? "arithmetic overflow" :
+                kind == StackFault ? "stack overflow" : "bad method address");
+}
+
+
+/* Method: Run
+ * -----------
+ * Lays out the entry trampoline, the code for every operation and one
+ * stub per kind of fault, patches the jumps, then maps the code
+ * executable and calls into it. Every Decaf call also takes 8 bytes of
+ * host stack for the return address, so the code runs on a stack of its
+ * own, big enough that the Decaf stack always overflows first.
+ */
+void Jit::Run(int main)
+{
+#if !defined(__x86_64__)
+  Failure("-jit needs an x86-64 host, use -run");
+#endif
+  Bytes(entryCode, sizeof(entryCode));
+  Imm64((uint64_t) &savedRsp);
+  Bytes(entryCall, sizeof(entryCall) - 2);
+  epilogue = code.size();
+  Bytes(entryCall + sizeof(entryCall) - 2, 2);
+  Imm64((uint64_t) &savedRsp);
+  Bytes(exitCode, sizeof(exitCode));
+
+  for (size_t i = 0; i < interp->ops.size(); i++) {
+    opStart.push_back(code.size());
+    Compile(interp->ops[i]);
+  }
+  size_t faultStub[NumFaults];
+  for (int kind = 0; kind < NumFaults; kind++) {
+    faultStub[kind] = code.size();
+    Byte(0x89), Byte(0xc2);                            // mov %eax, %edx
+    Byte(0xbe), Imm32(kind);                           // mov $kind, %esi
+    CallHelper((void *) Fault);
+  }
+  for (size_t j = 0; j < jumps.size(); j++)
+    Patch32(jumps[j].first, opStart[jumps[j].second] - (jumps[j].first + 4));
+  for (size_t j = 0; j < faultJumps.size(); j++)
+    Patch32(faultJumps[j].first, faultStub[faultJumps[j].second] - (faultJumps[j].first + 4));
+
+  void *buffer = mmap(NULL, code.size(), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED)
+    Failure("Jit: cannot map code buffer");
+  memcpy(buffer, &code[0], code.size());
+  if (mprotect(buffer, code.size(), PROT_READ | PROT_EXEC) != 0)
+    Failure("Jit: cannot make code executable");
+
+  size_t stackSize = interp->memSize + (1 << 20);
+  void *stack = mmap(NULL, stackSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (stack == MAP_FAILED)
+    Failure("Jit: cannot map stack");
+
+  std::vector<uint64_t> addresses(opStart.size());
+  for (size_t i = 0; i < opStart.size(); i++)
+    addresses[i] = (uint64_t) buffer + opStart[i];
+  typedef void (*Entry)(char *mem, uint32_t *heapTop, uint64_t *addresses,
+                        uint32_t sp, void *main, char *stackTop);
+  ((Entry) buffer)(interp->mem, &interp->heapTop, &addresses[0],
+                   interp->memSize - 4, (char *) buffer + opStart[main],
+                   (char *) stack + stackSize);
+  munmap(stack, stackSize);
+  munmap(buffer, code.size());
+}
@@ -0,0 +1,60 @@
+/* File: jit.h
+ * -----------
+ * The Jit is the baseline compiler behind dcc -jit: instead of
+ * interpreting the operations the Interpreter decoded, it strings
+ * together pre-assembled x86-64 machine code templates, one per
+ * operation, patches in the frame offsets, immediates and branch
+ * targets, and runs the result from an mmap'd buffer straight away.
+ *
+ * The generated code keeps the Interpreter's memory and frame layout, so
+ * the two are interchangeable and the built-ins are shared. While it
+ * runs, %r12 holds the base of Decaf memory, %ebx the fp, %r13d the sp,
+ * %r14 the table of native addresses for each operation (for calls
+ * through a vtable) and %r15 points at the heap top. Decaf calls are
+ * native calls, so the return address lives on the host stack instead
+ * of in the frame.
+ */
+
+#ifndef _H_jit
+#define _H_jit
+
+#include "interp.h"
+#include <stdint.h>
+#include <vector>
+
+class Jit {
+  public:
+    Jit(Interpreter *interp);
+
+    // Compiles every operation and runs the program from op main.
+    void Run(int main);
+
+  private:
+    typedef enum { MemoryFault, DivideFault, StackFault, MethodFault,
+                   OverflowFault, NumFaults } FaultKind;
+
+    Interpreter *interp;
+    std::vector<uint8_t> code;
+    std::vector<size_t> opStart;                     // offset of each op
+    std::vector<std::pair<size_t, int> > jumps;      // rel32 at -> op
+    std::vector<std::pair<size_t, int> > faultJumps; // rel32 at -> kind
+    size_t epilogue;
+
+    void Bytes(const uint8_t *bytes, int n);
+    void Byte(uint8_t b)        { code.push_back(b); }
+    void Imm32(int32_t v);
+    void Imm64(uint64_t v);
+    void Patch32(size_t at, int32_t v);
+    void Slot(uint8_t opcode, int reg, int32_t field, bool global);
+    void JumpToOp(const uint8_t *opcode, int n, int op);
+    void JumpToFault(const uint8_t *opcode, int n, FaultKind kind);
+    void CallHelper(void *helper);
+    void CheckAddress();
+    void Compile(const Interpreter::Op &op);
+
+    static int32_t Builtin(Interpreter *interp, int code, uint32_t sp);
+    static void Print(Interpreter *interp, int32_t address);
+    static void Fault(Interpreter *interp, int kind, uint32_t address);
+};
+
+#endif
@@ -0,0 +1,286 @@
+/* File: layout.cc
+ * ---------------
+ * Implementation of the BlockLayout class.
+ */
+
+#include "layout.h"
+#include "codegen.h"
+#include "hashtable.h"
+#include "utility.h"
+#include <algorithm>
+#include <map>
+
+using std::vector;
+
+BlockLayout::BlockLayout(const ProfileData *p) : profile(p) {}
+
+/* Method: Run
+ * -----------
+ * A Profiler that emits nothing is walked over the code first, exactly
+ * as the -profile build walked it, so that its counters line up with
+ * the recorded ones.
+ */
+void BlockLayout::Run(List<Instruction *> *code) {
+    Profiler numbering(false);
+    for (int i = 0; profile && i < code->NumElements(); i++) {
+        numbering.Before(code, i);
+        numbering.After(code, i);
+    }
+
+    vector<Instruction *> out;
+    bool changed = false;
+    for (int i = 0; i < code->NumElements(); i++) {
+        out.push_back(code->Nth(i));
+        if (!dynamic_cast<BeginFunc *>(code->Nth(i)))
+            continue;
+        int end = i + 1;
+        while (end < code->NumElements() && !dynamic_cast<EndFunc *>(code->Nth(end)))
+            end++;
+        if (Layout(code, i, end, numbering, out))
+            changed = true;
+        else
+            for (int j = i + 1; j < end; j++) out.push_back(code->Nth(j));
+        i = end - 1;
+    }
+    if (!changed)
+        return;
+    code->Clear();
+    for (size_t i = 0; i < out.size(); i++) code->Append(out[i]);
+}
+
+static int64_t CountAt(const ProfileData *profile, const Profiler &numbering, int i) {
+    if (!profile)
+        return 1; // estimated later
+    int c = numbering.BlockCounter(i);
+    return c < 0 ? -1 : profile->Count(numbering.GetCounters()[c]);
+}
+
+void BlockLayout::StartBlock(int first, int64_t count) {
+    Block b = {first, first - 1, count, NULL, false, -1, -1, NULL, NULL, NULL};
+    blocks.push_back(b);
+}
+
+/* Method: Layout
+ * --------------
+ * Lays out the body of the function between code->Nth(begin), its
+ * BeginFunc, and code->Nth(end), its EndFunc, appending it to out.
+ * Returns false without touching out if the code would not change.
+ * The block after the last one is the function's exit, the epilogue of
+ * its EndFunc, and always stays last.
+ */
+bool BlockLayout::Layout(List<Instruction *> *code, int begin, int end,
+                         const Profiler &numbering, vector<Instruction *> &out) {
+    int64_t entry = CountAt(profile, numbering, begin);
+    if (entry <= 0)
+        return false;
+
+    blocks.clear();
+    std::map<const char *, int, ltstr> labels;
+    StartBlock(begin + 1, entry);
+    bool open = true;
+    int64_t count = 0;
+    for (int j = begin + 1; j < end; j++) {
+        Instruction *instr = code->Nth(j);
+        if (Label *l = dynamic_cast<Label *>(instr)) {
+            if (!open || blocks.back().first < j)
+                StartBlock(j, 0);
+            blocks.back().label = l->GetLabel();
+            blocks.back().count = CountAt(profile, numbering, j);
+            labels[l->GetLabel()] = blocks.size() - 1;
+        } else if (!open) {
+            StartBlock(j, count);
+        }
+        open = true;
+        Block &b = blocks.back();
+        b.last = j;
+        b.next = blocks.size(); // the block after it, or the exit
+        if (dynamic_cast<Goto *>(instr) || dynamic_cast<Return *>(instr))
+            b.next = -1;
+        if (dynamic_cast<Goto *>(instr) || dynamic_cast<IfZ *>(instr) ||
+            dynamic_cast<IfNZ *>(instr) || dynamic_cast<Return *>(instr)) {
+            if (!dynamic_cast<Return *>(instr))
+                b.branch = instr;
+            // a fall-through after a branch has a counter of its own,
+            // code after a goto or return is unreachable
+            count = b.next < 0 ? 0 : CountAt(profile, numbering, j);
+            open = false;
+        }
+    }
+    if (open && blocks.back().last < blocks.back().first)
+        blocks.back().next = blocks.size(); // empty entry falls to the exit
+
+    int exit = blocks.size();
+    StartBlock(end, 0);
+    for (int b = 0; b < exit; b++) {
+        const char *target = NULL;
+        if (Goto *g = dynamic_cast<Goto *>(blocks[b].branch))
+            target = g->GetLabel();
+        else if (IfZ *z = dynamic_cast<IfZ *>(blocks[b].branch))
+            target = z->GetLabel();
+        else if (IfNZ *nz = dynamic_cast<IfNZ *>(blocks[b].branch))
+            target = nz->GetLabel();
+        if (target && labels.count(target))
+            blocks[b].target = labels[target];
+    }
+    if (!profile)
+        Estimate();
+
+    placed.assign(blocks.size(), false);
+    placed[exit] = true;
+    order.clear();
+    Chain(0, false);
+    for (int b = 0; b < exit; b++)
+        if (blocks[b].count > 0) Chain(b, false);
+    for (int b = 0; b < exit; b++)
+        Chain(b, true);
+    order.push_back(exit);
+
+    bool changed = false;
+    for (size_t k = 0; k < order.size(); k++)
+        if (order[k] != (int) k) changed = true;
+
+    for (int k = 0; k < exit; k++) {
+        Block &b = blocks[order[k]];
+        int follow = order[k + 1];
+        int target = b.target < 0 ? -1 : Thread(b.target);
+        b.replace = b.branch;
+        if (dynamic_cast<Goto *>(b.branch)) {
+            if (b.target == follow || target == follow)
+                b.replace = NULL;
+            else if (target != b.target)
+                b.replace = Branch(b.branch, LabelOf(target), false);
+        } else if (b.branch) {
+            if (b.next == follow) {
+                if (target != b.target)
+                    b.replace = Branch(b.branch, LabelOf(target), false);
+            } else if (b.target == follow || target == follow) {
+                b.replace = Branch(b.branch, LabelOf(Thread(b.next)), true);
+            } else {
+                if (target != b.target)
+                    b.replace = Branch(b.branch, LabelOf(target), false);
+                b.jumpAfter = LabelOf(Thread(b.next));
+            }
+        } else if (b.next >= 0 && b.next != follow) {
+            b.jumpAfter = LabelOf(Thread(b.next));
+        }
+        if (b.replace != b.branch || b.jumpAfter)
+            changed = true;
+    }
+    if (!changed)
+        return false;
+
+    for (size_t k = 0; k < order.size(); k++) {
+        Block &b = blocks[order[k]];
+        int line = b.first < end ? code->Nth(b.first)->GetLine() : 0;
+        if (b.newLabel) {
+            out.push_back(new Label(b.label));
+            out.back()->SetLine(line);
+        }
+        for (int j = b.first; j <= b.last; j++) {
+            Instruction *instr = code->Nth(j);
+            if (instr != b.branch)
+                out.push_back(instr);
+            else if (b.replace)
+                out.push_back(b.replace);
+        }
+        if (b.jumpAfter) {
+            out.push_back(new Goto(b.jumpAfter));
+            out.back()->SetLine(b.last >= b.first ? code->Nth(b.last)->GetLine() : line);
+        }
+    }
+    Label *fn = begin > 0 ? dynamic_cast<Label *>(code->Nth(begin - 1)) : NULL;
+    PrintDebug("layout", "%s: %d blocks laid out", fn ? fn->GetLabel() : "?", exit);
+    return true;
+}
+
+/* Method: Chain
+ * -------------
+ * Places b and then, as long as there is one, its hottest successor
+ * not yet placed. Until cold is set, blocks that never ran are not
+ * followed.
+ */
+void BlockLayout::Chain(int b, bool cold) {
+    while (b >= 0 && !placed[b]) {
+        placed[b] = true;
+        order.push_back(b);
+        int succ[2] = {blocks[b].next, blocks[b].target}, best = -1;
+        for (int s = 0; s < 2; s++) {
+            int c = succ[s];
+            if (c < 0 || placed[c] || (!cold && blocks[c].count <= 0))
+                continue;
+            if (best < 0 || blocks[c].count > blocks[best].count)
+                best = c;
+        }
+        b = best;
+    }
+}
+
+/* Method: Estimate
+ * -----------------
+ * Without a profile the counts are guessed from the shape of the code:
+ * a backward branch closes a loop, and each loop around a block makes
+ * it eight times hotter. A block that leaves its loop by a goto or a
+ * return (a break, say) is taken once per loop rather than once per
+ * iteration, and a block nothing reaches never runs.
+ */
+void BlockLayout::Estimate() {
+    int exit = blocks.size() - 1;
+    vector<int> depth(exit, 0);
+    vector<bool> reached(exit, false);
+    reached[0] = true;
+    for (int b = 0; b < exit; b++) {
+        int t = blocks[b].target, n = blocks[b].next;
+        if (t >= 0 && t <= b)
+            for (int x = t; x <= b; x++) depth[x]++;
+        if (t >= 0 && t < exit) reached[t] = true;
+        if (n >= 0 && n < exit) reached[n] = true;
+    }
+    for (int b = 0; b < exit; b++) {
+        int d = depth[b];
+        if (blocks[b].next < 0 && d > 0 &&
+            (blocks[b].target < 0 || depth[blocks[b].target] < d))
+            d--;
+        blocks[b].count = reached[b] ? (int64_t) 1 << (3 * std::min(d, 8)) : 0;
+    }
+}
+
+/* Method: Thread
+ * --------------
+ * Where a branch to b ends up: b itself, unless all b does is jump on
+ * to another block of the function.
+ */
+int BlockLayout::Thread(int b) {
+    for (int hops = 0; hops < 8; hops++) {
+        Block &blk = blocks[b];
+        int size = blk.last - blk.first + 1 - (blk.label && !blk.newLabel);
+        if (size != 1 || !dynamic_cast<Goto *>(blk.branch) ||
+            blk.target < 0 || blk.target == b)
+            break;
+        b = blk.target;
+    }
+    return b;
+}
+
+// A conditional branch or goto like branch, to label; invert turns an
+// IfZ into an IfNZ and back.
+Instruction *BlockLayout::Branch(Instruction *branch, const char *label, bool invert) {
+    Instruction *result;
+    if (IfZ *z = dynamic_cast<IfZ *>(branch))
+        result = invert ? (Instruction *) new IfNZ(z->GetTest(), label)
+                        : (Instruction *) new IfZ(z->GetTest(), label);
+    else if (IfNZ *nz = dynamic_cast<IfNZ *>(branch))
+        result = invert ? (Instruction *) new IfZ(nz->GetTest(), label)
+                        : (Instruction *) new IfNZ(nz->GetTest(), label);
+    else
+        result = new Goto(label);
+    result->SetLine(branch->GetLine());
+    return result;
+}
+
+const char *BlockLayout::LabelOf(int b) {
+    if (!blocks[b].label) {
+        blocks[b].label = CodeGenerator::instance->NewLabel();
+        blocks[b].newLabel = true;
+    }
+    return blocks[b].label;
+}
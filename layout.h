@@ -0,0 +1,67 @@
+/* File: layout.h
+ * --------------
+ * BlockLayout reorders the basic blocks of each function so that the
+ * likely path falls through. It works on the Tac, before any of the
+ * backends see it, so every target gets the same layout. With -O the
+ * block counts are estimated from the loop structure; with
+ * -fprofile-use=file they come from a profile recorded by a -profile
+ * build, whose blocks are numbered the way the Profiler numbers its
+ * counters.
+ *
+ * Starting at the entry, the layout follows the hottest successor not
+ * yet placed, which makes the common path the fall-through; the
+ * remaining executed blocks start chains of their own, and blocks that
+ * never ran go last, out of the way of the hot code. Branches are then
+ * fixed up: a goto to the block that now follows it goes away, a
+ * conditional branch whose target now follows it is inverted, a
+ * fall-through that no longer falls into the right block gets a goto,
+ * and a branch to a block that only jumps on goes straight there.
+ *
+ * Functions the profile has no counts for, or that never ran, are left
+ * as they are.
+ */
+
+#ifndef _H_layout
+#define _H_layout
+
+#include "list.h"
+#include "tac.h"
+#include "profile.h"
+#include <stdint.h>
+#include <vector>
+
+class BlockLayout {
+  public:
+    // Without a profile the block counts are estimated (see Estimate).
+    BlockLayout(const ProfileData *profile = NULL);
+
+    void Run(List<Instruction *> *code);
+
+  private:
+    struct Block {
+        int first, last;         // instructions, last < first if empty
+        int64_t count;
+        const char *label;       // label the block starts with, if any
+        bool newLabel;           // label made up for a branch to it
+        int target, next;        // branch target, fall-through (-1: none)
+        Instruction *branch;     // ends the block (Goto, IfZ, ...), or NULL
+        Instruction *replace;    // what to emit for branch, NULL: drop it
+        const char *jumpAfter;   // goto to emit after the block, or NULL
+    };
+
+    const ProfileData *profile;
+    std::vector<Block> blocks;    // of the current function, then its exit
+    std::vector<bool> placed;
+    std::vector<int> order;
+
+    bool Layout(List<Instruction *> *code, int begin, int end,
+                const Profiler &numbering, std::vector<Instruction *> &out);
+    void StartBlock(int first, int64_t count);
+    void Estimate();
+    void Chain(int b, bool cold);
+    int Thread(int b);
+    Instruction *Branch(Instruction *branch, const char *label, bool invert);
+    const char *LabelOf(int b);
+};
+
+#endif
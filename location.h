@@ -9,26 +9,41 @@
 
 #ifndef YYLTYPE
 
+#include <stdint.h>
+
 /* Typedef: yyltype
  * ----------------
  * Defines the struct type that is used by the scanner to store
- * position information about each lexeme scanned.
+ * position information about each lexeme scanned. A location is just
+ * the offsets into the source of its first and last characters; the
+ * line and columns are worked out from the scanner's line table when
+ * they are needed (see GetSourcePos in scanner.h), which is mostly for
+ * reporting errors. A node without a location has first == NoOffset.
  */
 typedef struct yyltype
 {
-    int timestamp;                 // you can ignore this field
-    int first_line, first_column;
-    int last_line, last_column;      
-    char *text;                    // you can also ignore this field
+    uint32_t first, last;
 } yyltype;
 
 #define YYLTYPE yyltype
 
-inline bool operator< (const yyltype &pos1, const yyltype &pos2) {
+static const uint32_t NoOffset = 0xffffffff;
+
+/* Struct: SourcePos
+ * -----------------
+ * The line and columns a location starts and ends at, as reported in
+ * error messages. The last column is on the line the location ends on.
+ */
+struct SourcePos
+{
+    int line;
+    int first_column, last_column;
+};
+
+inline bool operator< (const SourcePos &pos1, const SourcePos &pos2) {
     int diff;
-    if ((diff = pos1.first_line - pos2.first_line)) return diff < 0;
+    if ((diff = pos1.line - pos2.line)) return diff < 0;
     if ((diff = pos1.first_column - pos2.first_column)) return diff < 0;
-    if ((diff = pos1.last_line - pos2.last_line)) return diff < 0;
     if ((diff = pos1.last_column - pos2.last_column)) return diff < 0;
     return false;
 }
@@ -49,10 +64,8 @@ extern struct yyltype yylloc;
 inline yyltype Join(yyltype first, yyltype last)
 {
   yyltype combined;
-  combined.first_column = first.first_column;
-  combined.first_line = first.first_line;
-  combined.last_column = last.last_column;
-  combined.last_line = last.last_line;
+  combined.first = first.first;
+  combined.last = last.last;
   return combined;
 }
 
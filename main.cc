@@ -9,6 +9,7 @@
 #include "utility.h"
 #include "errors.h"
 #include "parser.h"
+#include "mips.h"
 
 void SysCallCodeGen();
 
@@ -30,164 +31,168 @@ int main(int argc, char *argv[])
     yyparse();
     if (ReportError::NumErrors() > 0)
 	ReportError::PrintErrors();
-    if (ReportError::NumErrors() == 0)
+    if (ReportError::NumErrors() == 0 && IsTarget("mips") && !IsOptionOn("run") && !IsOptionOn("jit"))
 	SysCallCodeGen();
+    Mips::FlushScheduler();
     return (ReportError::NumErrors() == 0? 0 : -1);
 }
 
 void SysCallCodeGen()
 {
-    printf("  _PrintInt:\n");
-    printf("	  subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
-    printf("	  sw $fp, 8($sp)	# save fp\n");
-    printf("	  sw $ra, 4($sp)	# save ra\n");
-    printf("	  addiu $fp, $sp, 8	# set up new fp\n");
-    printf("	  lw $a0, 4($fp)	# fill a from $fp+4\n");
-    printf("	# LCall _PrintInt\n");
-    printf("	  li $v0, 1\n");
-    printf("	  syscall\n");
-    printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp		# pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)	# restore saved ra\n");
-    printf("	  lw $fp, 0($fp)	# restore saved fp\n");
-    printf("	  jr $ra		# return from function\n");
-    printf("\n");
-    printf("  _ReadInteger:\n");
-    printf("	  subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
-    printf("	  sw $fp, 8($sp)	# save fp\n");
-    printf("	  sw $ra, 4($sp)	# save ra\n");
-    printf("	  addiu $fp, $sp, 8	# set up new fp\n");
-    printf("	  li $v0, 5\n");
-    printf("	  syscall\n");
-    printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp		# pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)	# restore saved ra\n");
-    printf("	  lw $fp, 0($fp)	# restore saved fp\n");
-    printf("	  jr $ra		# return from function\n");
-    printf("\n");
-    printf("\n");
-    printf("  _PrintBool:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
-    printf("	  li $v0, 4\n");
-    printf("	  beq $a0, $0, PrintBoolFalse\n");
-    printf("	  la $a0, _PrintBoolTrueString\n");
-    printf("	  j PrintBoolEnd\n");
-    printf("  PrintBoolFalse:\n");
-    printf(" 	  la $a0, _PrintBoolFalseString\n");
-    printf("  PrintBoolEnd:\n");
-    printf("	  syscall\n");
-    printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
-    printf("	  jr $ra                # return from function\n");
-    printf("\n");
-    printf("      .data			# create string constant marked with label\n");
-    printf("      _PrintBoolTrueString: .asciiz \"true\"\n");
-    printf("      .text\n");
-    printf("\n");
-    printf("      .data			# create string constant marked with label\n");
-    printf("      _PrintBoolFalseString: .asciiz \"false\"\n");
-    printf("      .text\n");
-    printf("\n");
-    printf("  _PrintString:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
-    printf("	  li $v0, 4\n");
-    printf("	  syscall\n");
-    printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
-    printf("	  jr $ra                # return from function\n");
-    printf("\n");
-    printf("  _Alloc:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra,fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
-    printf("	  li $v0, 9\n");
-    printf("	  syscall\n");
-    printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
-    printf("	  jr $ra                # return from function\n");
-    printf("\n");
-    printf("  _Halt:\n");
-    printf("	  li $v0, 10\n");
-    printf("	  syscall\n");
-    printf("	# EndFunc\n");
-    printf("\n");
-    printf("\n");
-    printf("  _StringEqual:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
-    printf("	  lw $a1, 8($fp)        # fill a from $fp+8\n");
-    printf("	  beq $a0,$a1,Lrunt10\n");
-    printf("  Lrunt12:\n");
-    printf("	  lbu  $v0,($a0)\n");
-    printf("	  lbu  $a2,($a1)\n");
-    printf("	  bne $v0,$a2,Lrunt11\n");
-    printf("	  addiu $a0,$a0,1\n");
-    printf("	  addiu $a1,$a1,1\n");
-    printf("	  bne $v0,$0,Lrunt12\n");
-    printf("      li  $v0,1\n");
-    printf("      j Lrunt10\n");
-    printf("  Lrunt11:\n");
-    printf("	  li  $v0,0\n");
-    printf("  Lrunt10:\n");
-    printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
-    printf("	  jr $ra                # return from function\n");
-    printf("\n");
-    printf("\n");
-    printf("\n");
-    printf("  _ReadLine:\n");
-    printf("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
-    printf("	  sw $fp, 8($sp)        # save fp\n");
-    printf("	  sw $ra, 4($sp)        # save ra\n");
-    printf("	  addiu $fp, $sp, 8     # set up new fp\n");
-    printf("	  li $a0, 101\n");
-    printf("	  li $v0, 9\n");
-    printf("	  syscall\n");
-    printf("	  addi $a0, $v0, 0\n");
-    printf("	  li $v0, 8\n");
-    printf("	  li $a1,101 \n");
-    printf("	  syscall\n");
-    printf("	  addiu $v0,$a0,0       # pointer to begin of string\n");
-    printf("  Lrunt21:\n");
-    printf("	  lb $a1,($a0)          # load character at pointer\n");
-    printf("	  addiu $a0,$a0,1       # forward pointer\n");
-    printf("	  bnez $a1,Lrunt21      # loop until end of string is reached\n");
-    printf("	  lb $a1,-2($a0)        # load character before end of string\n");
-    printf("	  li $a2,10             # newline character");
-    printf("	  bneq $a1,$a2,Lrunt20  # do not remove last character if not newline\n");
-    printf("	  sb $0,-2($a0)         # Add the terminating character in its place\n");
-    printf("  Lrunt20:\n");
-    printf("	# EndFunc\n");
-    printf("	# (below handles reaching end of fn body with no explicit return)\n");
-    printf("	  move $sp, $fp         # pop callee frame off stack\n");
-    printf("	  lw $ra, -4($fp)       # restore saved ra\n");
-    printf("	  lw $fp, 0($fp)        # restore saved fp\n");
-    printf("	  jr $ra                # return from function\n");
+    Mips::Output("  _PrintInt:\n");
+    Mips::Output("	  subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
+    Mips::Output("	  sw $fp, 8($sp)	# save fp\n");
+    Mips::Output("	  sw $ra, 4($sp)	# save ra\n");
+    Mips::Output("	  addiu $fp, $sp, 8	# set up new fp\n");
+    Mips::Output("	  lw $a0, 4($fp)	# fill a from $fp+4\n");
+    Mips::Output("	# LCall _PrintInt\n");
+    Mips::Output("	  li $v0, 1\n");
+    Mips::Output("	  syscall\n");
+    Mips::Output("	# EndFunc\n");
+    Mips::Output("	# (below handles reaching end of fn body with no explicit return)\n");
+    Mips::Output("	  move $sp, $fp		# pop callee frame off stack\n");
+    Mips::Output("	  lw $ra, -4($fp)	# restore saved ra\n");
+    Mips::Output("	  lw $fp, 0($fp)	# restore saved fp\n");
+    Mips::Output("	  jr $ra		# return from function\n");
+    Mips::Output("\n");
+    Mips::Output("  _ReadInteger:\n");
+    Mips::Output("	  subu $sp, $sp, 8	# decrement sp to make space to save ra,fp\n");
+    Mips::Output("	  sw $fp, 8($sp)	# save fp\n");
+    Mips::Output("	  sw $ra, 4($sp)	# save ra\n");
+    Mips::Output("	  addiu $fp, $sp, 8	# set up new fp\n");
+    Mips::Output("	  li $v0, 5\n");
+    Mips::Output("	  syscall\n");
+    Mips::Output("	# EndFunc\n");
+    Mips::Output("	# (below handles reaching end of fn body with no explicit return)\n");
+    Mips::Output("	  move $sp, $fp		# pop callee frame off stack\n");
+    Mips::Output("	  lw $ra, -4($fp)	# restore saved ra\n");
+    Mips::Output("	  lw $fp, 0($fp)	# restore saved fp\n");
+    Mips::Output("	  jr $ra		# return from function\n");
+    Mips::Output("\n");
+    Mips::Output("\n");
+    Mips::Output("  _PrintBool:\n");
+    Mips::Output("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+    Mips::Output("	  sw $fp, 8($sp)        # save fp\n");
+    Mips::Output("	  sw $ra, 4($sp)        # save ra\n");
+    Mips::Output("	  addiu $fp, $sp, 8     # set up new fp\n");
+    Mips::Output("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
+    Mips::Output("	  li $v0, 4\n");
+    Mips::Output("	  beq $a0, $0, PrintBoolFalse\n");
+    Mips::Output("	  la $a0, _PrintBoolTrueString\n");
+    Mips::Output("	  j PrintBoolEnd\n");
+    Mips::Output("  PrintBoolFalse:\n");
+    Mips::Output(" 	  la $a0, _PrintBoolFalseString\n");
+    Mips::Output("  PrintBoolEnd:\n");
+    Mips::Output("	  syscall\n");
+    Mips::Output("	# EndFunc\n");
+    Mips::Output("	# (below handles reaching end of fn body with no explicit return)\n");
+    Mips::Output("	  move $sp, $fp         # pop callee frame off stack\n");
+    Mips::Output("	  lw $ra, -4($fp)       # restore saved ra\n");
+    Mips::Output("	  lw $fp, 0($fp)        # restore saved fp\n");
+    Mips::Output("	  jr $ra                # return from function\n");
+    Mips::Output("\n");
+    Mips::Output("      .data			# create string constant marked with label\n");
+    Mips::Output("      _PrintBoolTrueString: .asciiz \"true\"\n");
+    Mips::Output("      .text\n");
+    Mips::Output("\n");
+    Mips::Output("      .data			# create string constant marked with label\n");
+    Mips::Output("      _PrintBoolFalseString: .asciiz \"false\"\n");
+    Mips::Output("      .text\n");
+    Mips::Output("\n");
+    Mips::Output("  _PrintString:\n");
+    Mips::Output("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+    Mips::Output("	  sw $fp, 8($sp)        # save fp\n");
+    Mips::Output("	  sw $ra, 4($sp)        # save ra\n");
+    Mips::Output("	  addiu $fp, $sp, 8     # set up new fp\n");
+    Mips::Output("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
+    Mips::Output("	  li $v0, 4\n");
+    Mips::Output("	  syscall\n");
+    Mips::Output("	# EndFunc\n");
+    Mips::Output("	# (below handles reaching end of fn body with no explicit return)\n");
+    Mips::Output("	  move $sp, $fp         # pop callee frame off stack\n");
+    Mips::Output("	  lw $ra, -4($fp)       # restore saved ra\n");
+    Mips::Output("	  lw $fp, 0($fp)        # restore saved fp\n");
+    Mips::Output("	  jr $ra                # return from function\n");
+    Mips::Output("\n");
+    Mips::Output("  _Alloc:\n");
+    Mips::Output("	  subu $sp, $sp, 8      # decrement sp to make space to save ra,fp\n");
+    Mips::Output("	  sw $fp, 8($sp)        # save fp\n");
+    Mips::Output("	  sw $ra, 4($sp)        # save ra\n");
+    Mips::Output("	  addiu $fp, $sp, 8     # set up new fp\n");
+    Mips::Output("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
+    Mips::Output("	  li $v0, 9\n");
+    Mips::Output("	  syscall\n");
+    Mips::Output("	# EndFunc\n");
+    Mips::Output("	# (below handles reaching end of fn body with no explicit return)\n");
+    Mips::Output("	  move $sp, $fp         # pop callee frame off stack\n");
+    Mips::Output("	  lw $ra, -4($fp)       # restore saved ra\n");
+    Mips::Output("	  lw $fp, 0($fp)        # restore saved fp\n");
+    Mips::Output("	  jr $ra                # return from function\n");
+    Mips::Output("\n");
+    Mips::Output("  _Halt:\n");
+    if (IsOptionOn("profile"))
+	Mips::Output("	  jal _ProfileDump\n");
+    Mips::Output("	  li $v0, 10\n");
+    Mips::Output("	  syscall\n");
+    Mips::Output("	# EndFunc\n");
+    Mips::Output("\n");
+    Mips::Output("\n");
+    Mips::Output("  _StringEqual:\n");
+    Mips::Output("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+    Mips::Output("	  sw $fp, 8($sp)        # save fp\n");
+    Mips::Output("	  sw $ra, 4($sp)        # save ra\n");
+    Mips::Output("	  addiu $fp, $sp, 8     # set up new fp\n");
+    Mips::Output("	  lw $a0, 4($fp)        # fill a from $fp+4\n");
+    Mips::Output("	  lw $a1, 8($fp)        # fill a from $fp+8\n");
+    Mips::Output("	  li  $v0,1             # the same string, as pooled literals are\n");
+    Mips::Output("	  beq $a0,$a1,Lrunt10\n");
+    Mips::Output("  Lrunt12:\n");
+    Mips::Output("	  lbu  $v0,($a0)\n");
+    Mips::Output("	  lbu  $a2,($a1)\n");
+    Mips::Output("	  bne $v0,$a2,Lrunt11\n");
+    Mips::Output("	  addiu $a0,$a0,1\n");
+    Mips::Output("	  addiu $a1,$a1,1\n");
+    Mips::Output("	  bne $v0,$0,Lrunt12\n");
+    Mips::Output("      li  $v0,1\n");
+    Mips::Output("      j Lrunt10\n");
+    Mips::Output("  Lrunt11:\n");
+    Mips::Output("	  li  $v0,0\n");
+    Mips::Output("  Lrunt10:\n");
+    Mips::Output("	# EndFunc\n");
+    Mips::Output("	# (below handles reaching end of fn body with no explicit return)\n");
+    Mips::Output("	  move $sp, $fp         # pop callee frame off stack\n");
+    Mips::Output("	  lw $ra, -4($fp)       # restore saved ra\n");
+    Mips::Output("	  lw $fp, 0($fp)        # restore saved fp\n");
+    Mips::Output("	  jr $ra                # return from function\n");
+    Mips::Output("\n");
+    Mips::Output("\n");
+    Mips::Output("\n");
+    Mips::Output("  _ReadLine:\n");
+    Mips::Output("	  subu $sp, $sp, 8      # decrement sp to make space to save ra, fp\n");
+    Mips::Output("	  sw $fp, 8($sp)        # save fp\n");
+    Mips::Output("	  sw $ra, 4($sp)        # save ra\n");
+    Mips::Output("	  addiu $fp, $sp, 8     # set up new fp\n");
+    Mips::Output("	  li $a0, 101\n");
+    Mips::Output("	  li $v0, 9\n");
+    Mips::Output("	  syscall\n");
+    Mips::Output("	  addi $a0, $v0, 0\n");
+    Mips::Output("	  li $v0, 8\n");
+    Mips::Output("	  li $a1,101 \n");
+    Mips::Output("	  syscall\n");
+    Mips::Output("	  addiu $v0,$a0,0       # pointer to begin of string\n");
+    Mips::Output("  Lrunt21:\n");
+    Mips::Output("	  lb $a1,($a0)          # load character at pointer\n");
+    Mips::Output("	  addiu $a0,$a0,1       # forward pointer\n");
+    Mips::Output("	  bnez $a1,Lrunt21      # loop until end of string is reached\n");
+    Mips::Output("	  lb $a1,-2($a0)        # load character before end of string\n");
+    Mips::Output("	  li $a2,10             # newline character");
+    Mips::Output("	  bneq $a1,$a2,Lrunt20  # do not remove last character if not newline\n");
+    Mips::Output("	  sb $0,-2($a0)         # Add the terminating character in its place\n");
+    Mips::Output("  Lrunt20:\n");
+    Mips::Output("	# EndFunc\n");
+    Mips::Output("	# (below handles reaching end of fn body with no explicit return)\n");
+    Mips::Output("	  move $sp, $fp         # pop callee frame off stack\n");
+    Mips::Output("	  lw $ra, -4($fp)       # restore saved ra\n");
+    Mips::Output("	  lw $fp, 0($fp)        # restore saved fp\n");
+    Mips::Output("	  jr $ra                # return from function\n");
 }
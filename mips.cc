@@ -21,6 +21,7 @@
  */
 
 #include "mips.h"
+#include "sched.h"
 #include <stdarg.h>
 #include <string.h>
 
@@ -84,10 +85,40 @@ void Mips::Emit(const char *fmt, ...)
   va_start(args, fmt);
   vsprintf(buf, fmt, args);
   va_end(args);
-  if (buf[strlen(buf) - 1] != ':') printf("\t"); // don't tab in labels
-  if (buf[0] != '#') printf("  ");   // outdent comments a little
-  printf("%s", buf);
-  if (buf[strlen(buf)-1] != '\n') printf("\n"); // end with a newline
+  char line[1040] = "";
+  if (buf[strlen(buf) - 1] != ':') strcat(line, "\t"); // don't tab in labels
+  if (buf[0] != '#') strcat(line, "  ");   // outdent comments a little
+  strcat(line, buf);
+  if (buf[strlen(buf)-1] != '\n') strcat(line, "\n"); // end with a newline
+  Output(line);
+}
+
+Scheduler *Mips::scheduler = NULL;
+int Mips::sourceLine = 0;
+
+/* Method: Output
+ * --------------
+ * Writes assembly text, through the scheduler if there is one.
+ */
+void Mips::Output(const char *text)
+{
+  if (scheduler) scheduler->Add(text);
+  else printf("%s", text);
+}
+
+void Mips::SourceLine(int line)
+{
+  if (line == sourceLine) return;
+  sourceLine = line;
+  Emit("# line %d", line);
+}
+
+void Mips::FlushScheduler()
+{
+  if (!scheduler) return;
+  scheduler->Flush();
+  delete scheduler;
+  scheduler = NULL;
 }
 
 
@@ -106,22 +137,25 @@ void Mips::EmitLoadConstant(Location *dst, int val)
   SpillRegister(dst, reg);
 }
 
+/* Method: StringLabel
+ * -------------------
+ * Returns the data label for a (quoted) string literal from the
+ * program-wide StringPool. Identical literals share one label.
+ */
+const char *Mips::StringLabel(const char *str)
+{
+  return strings.Label(str);
+}
+
 /* Method: EmitLoadStringConstant
  * ------------------------------
- * Used to assign a variable a pointer to string constant. Emits
- * assembly directives to create a new null-terminated string in the
- * data segment and assigns it a unique label. Slaves dst into a register
- * and loads that label address into the register.
+ * Used to assign a variable a pointer to string constant. The string
+ * itself goes into the pool (see EmitStringPool), so all we emit here
+ * is the load of its label address into the register.
  */
 void Mips::EmitLoadStringConstant(Location *dst, const char *str)
 {
-  static int strNum = 1;
-  char label[16];
-  sprintf(label, "_string%d", strNum++);
-  Emit(".data\t\t\t# create string constant marked with label");
-  Emit("%s: .asciiz %s", label, str);
-  Emit(".text");
-  EmitLoadLabel(dst, label);
+  EmitLoadLabel(dst, StringLabel(str));
 }
 
 
@@ -212,6 +246,51 @@ void Mips::EmitBinaryOp(BinaryOp::OpCode code, Location *dst,
 }
 
 
+/* Method: EmitBinaryOpImm
+ * -----------------------
+ * Same as EmitBinaryOp, but the second operand is a constant. When the
+ * constant fits the 16-bit immediate field we select the I-type form
+ * (addi, slti, andi, ori), multiplication by a power of two becomes a
+ * shift, and equality tests use sltiu. Anything else falls back to
+ * loading the constant into rt and emitting the register form.
+ */
+void Mips::EmitBinaryOpImm(BinaryOp::OpCode code, Location *dst,
+				 Location *op1, int imm)
+{
+  Register reg = rd;
+  Register reg1 = rs;
+  bool fitsSigned = imm >= -32768 && imm <= 32767;
+  bool fitsUnsigned = imm >= 0 && imm <= 65535;
+  const char *d = regs[reg].name, *s = regs[reg1].name;
+  FillRegister(op1, reg1);
+  if (code == BinaryOp::Add && fitsSigned) {
+    Emit("addi %s, %s, %d", d, s, imm);
+  } else if (code == BinaryOp::Sub && imm > -32768 && imm <= 32768) {
+    Emit("addi %s, %s, %d", d, s, -imm);
+  } else if (code == BinaryOp::Mul && imm > 0 && (imm & (imm - 1)) == 0) {
+    int shift = 0;
+    while ((1 << shift) != imm) shift++;
+    Emit("sll %s, %s, %d", d, s, shift);
+  } else if (code == BinaryOp::Less && fitsSigned) {
+    Emit("slti %s, %s, %d", d, s, imm);
+  } else if (code == BinaryOp::Eq && imm == 0) {
+    Emit("sltiu %s, %s, 1", d, s);
+  } else if (code == BinaryOp::Eq && fitsUnsigned) {
+    Emit("xori %s, %s, %d", d, s, imm);
+    Emit("sltiu %s, %s, 1", d, d);
+  } else if (code == BinaryOp::And && fitsUnsigned) {
+    Emit("andi %s, %s, %d", d, s, imm);
+  } else if (code == BinaryOp::Or && fitsUnsigned) {
+    Emit("ori %s, %s, %d", d, s, imm);
+  } else {
+    Register reg2 = rt;
+    Emit("li %s, %d\t\t# load constant operand", regs[reg2].name, imm);
+    Emit("%s %s, %s, %s\t", NameForTac(code), d, s, regs[reg2].name);
+  }
+  SpillRegister(dst, reg);
+}
+
+
 /* Method: EmitLabel
  * -----------------
  * Used to emit label marker. Before a label, we spill all registers since
@@ -254,6 +333,20 @@ void Mips::EmitIfZ(Location *test, const char *label)
 }
 
 
+/* Method: EmitIfNZ
+ * ----------------
+ * Same as above but branches when the test var is non-zero (bnez).
+ * Used to reach the shared runtime error stubs from check sites.
+ */
+void Mips::EmitIfNZ(Location *test, const char *label)
+{
+  Register reg = rs;
+  FillRegister(test, reg);
+  Emit("bnez %s, %s\t# branch if %s is non-zero ", regs[reg].name, label,
+	 test->GetName());
+}
+
+
 /* Method: EmitParam
  * -----------------
  * Used to push a parameter on the stack in anticipation of upcoming
@@ -401,6 +494,30 @@ void Mips::EmitVTable(const char *label, List<const char*> *methodLabels)
 }
 
 
+/* Method: EmitErrorStub
+ * ----------------------
+ * Used to lay out one shared runtime error routine. Check sites branch
+ * here rather than carrying their own copy of the message and calls,
+ * so the error path is out of line and emitted once per program. The
+ * message lives in the string pool. We are about to halt, so it is
+ * printed and the program exits directly via syscalls, no frame needed.
+ */
+void Mips::EmitErrorStub(const char *label, const char *message)
+{
+  char *quoted = new char[strlen(message) + 3];
+  sprintf(quoted, "\"%s\"", message);
+  Emit("%s:", label);
+  Emit("la $a0, %s\t# load error message", StringLabel(Intern(quoted)));
+  Emit("li $v0, 4\t\t# print_string");
+  Emit("syscall");
+  if (IsOptionOn("profile"))
+    Emit("jal _ProfileDump\t# write out the profile");
+  Emit("li $v0, 10\t\t# exit");
+  Emit("syscall");
+  delete[] quoted;
+}
+
+
 /* Method: EmitPreamble
  * --------------------
  * Used to emit the starting sequence needed for a program. Not much
@@ -416,6 +533,23 @@ void Mips::EmitPreamble()
 }
 
 
+/* Method: EmitStringPool
+ * -----------------------
+ * Used at the end of the program to lay out every pooled string literal
+ * in a single data section, rather than switching sections at each use.
+ */
+void Mips::EmitStringPool()
+{
+  if (strings.NumStrings() == 0)
+    return;
+  Emit(".data\t\t\t# string constants");
+  for (int i = 0; i < strings.NumStrings(); i++) {
+    Emit("%s: .asciiz %s", strings.NthLabel(i), strings.Nth(i));
+  }
+  Emit(".text");
+}
+
+
 /* Method: NameForTac
  * ------------------
  * Returns the appropriate MIPS instruction (add, seq, etc.) for
@@ -20,7 +20,10 @@
 
 #include "tac.h"
 #include "list.h"
+#include "hashtable.h"
+#include "strpool.h"
 class Location;
+class Scheduler;
 
 
 class Mips {
@@ -45,7 +48,12 @@ class Mips {
     void SpillRegister(Location *dst, Register reg);
 
     void EmitCallInstr(Location *dst, const char *fn, bool isL);
+
+    StringPool strings; // literals laid out by EmitStringPool
     
+    static Scheduler *scheduler;
+    static int sourceLine;
+
     static const char *mipsName[BinaryOp::NumOps];
     static const char *NameForTac(BinaryOp::OpCode code);
 
@@ -54,7 +62,23 @@ class Mips {
     Mips();
 
     static void Emit(const char *fmt, ...);
+
+    // All assembly text goes out through Output. When a scheduler is
+    // installed it gets the text instead of stdout; FlushScheduler writes
+    // out what it still holds and removes it.
+    static void Output(const char *text);
+    static void SetScheduler(Scheduler *s) { scheduler = s; }
+    static void FlushScheduler();
+
+    // Marks the code that follows as generated for the given source
+    // line with a "# line N" comment, which dsim uses to attribute its
+    // counters. Does nothing if the line hasn't changed.
+    static void SourceLine(int line);
     
+    // Returns the data label for a string literal, adding it to the
+    // pool on first use
+    const char *StringLabel(const char *str);
+
     void EmitLoadConstant(Location *dst, int val);
     void EmitLoadStringConstant(Location *dst, const char *str);
     void EmitLoadLabel(Location *dst, const char *label);
@@ -65,10 +89,13 @@ class Mips {
 
     void EmitBinaryOp(BinaryOp::OpCode code, Location *dst, 
 			    Location *op1, Location *op2);
+    void EmitBinaryOpImm(BinaryOp::OpCode code, Location *dst,
+			    Location *op1, int imm);
 
     void EmitLabel(const char *label);
     void EmitGoto(const char *label);
     void EmitIfZ(Location *test, const char*label);
+    void EmitIfNZ(Location *test, const char*label);
     void EmitReturn(Location *returnVal);
 
     void EmitBeginFunction(int frameSize);
@@ -80,8 +107,10 @@ class Mips {
     void EmitPopParams(int bytes);
 
     void EmitVTable(const char *label, List<const char*> *methodLabels);
+    void EmitErrorStub(const char *label, const char *message);
 
     void EmitPreamble();
+    void EmitStringPool();
 
 };
 
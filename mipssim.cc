@@ -0,0 +1,876 @@
+/* File: mipssim.cc
+ * ----------------
+ * Implementation of the MipsSim class: a two-pass assembler for the
+ * SPIM dialect dcc emits, followed by a straightforward interpreter
+ * over the pre-decoded instructions.
+ */
+
+#include "mipssim.h"
+#include "pipeline.h"
+#include <algorithm>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+using std::string;
+using std::vector;
+
+static const char *regNames[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"};
+
+MipsSim::MipsSim()
+    : dataEnd(DataBase), heapEnd(DataBase), lastPage(0), lastBase(NULL),
+      srcLine(0), faulted(false), delayed(false), cycles(0), stalls(0),
+      pipeline(NULL) {
+    memset(regs, 0, sizeof(regs));
+}
+
+static string Trim(const string &s) {
+    size_t b = 0, e = s.size();
+    while (b < e && isspace((unsigned char)s[b])) b++;
+    while (e > b && isspace((unsigned char)s[e - 1])) e--;
+    return s.substr(b, e - b);
+}
+
+static bool ParseInt(const string &s, int32_t &val) {
+    if (s.empty()) return false;
+    char *end;
+    long long v = strtoll(s.c_str(), &end, 0);
+    if (*end != '\0') return false;
+    val = (int32_t)v;
+    return true;
+}
+
+static bool FitsSigned16(int32_t v) { return v >= -32768 && v <= 32767; }
+
+int MipsSim::RegNum(const string &name) {
+    if (name.size() < 2 || name[0] != '$') return -1;
+    string r = name.substr(1);
+    if (isdigit((unsigned char)r[0])) {
+        int n = atoi(r.c_str());
+        return (n >= 0 && n < 32) ? n : -1;
+    }
+    for (int i = 0; i < 32; i++)
+        if (r == regNames[i]) return i;
+    return -1;
+}
+
+bool MipsSim::ParseMem(const string &s, int32_t &off, uint8_t &base) {
+    size_t open = s.find('('), close = s.find(')');
+    if (open == string::npos || close == string::npos || close < open)
+        return false;
+    string offStr = Trim(s.substr(0, open));
+    off = 0;
+    if (!offStr.empty() && !ParseInt(offStr, off)) return false;
+    int r = RegNum(Trim(s.substr(open + 1, close - open - 1)));
+    if (r < 0) return false;
+    base = r;
+    return true;
+}
+
+/* Method: Byte
+ * ------------
+ * Returns a pointer to the byte at addr, allocating the backing page
+ * on first touch. Memory is sparse, so text, data, heap and stack can
+ * sit at their usual SPIM addresses.
+ */
+uint8_t *MipsSim::Byte(uint32_t addr) {
+    uint32_t page = addr >> PageBits;
+    if (page != lastPage || lastBase == NULL) {
+        vector<uint8_t> &p = pages[page];
+        if (p.empty()) p.resize(1 << PageBits, 0);
+        lastPage = page;
+        lastBase = &p[0];
+    }
+    return lastBase + (addr & ((1 << PageBits) - 1));
+}
+
+/* Method: Mapped
+ * --------------
+ * Faults on an access below the data segment or above the stack, such
+ * as through a null pointer or at a negative offset from one, rather
+ * than letting Byte quietly map a zeroed page there.
+ */
+bool MipsSim::Mapped(uint32_t addr, const char *access) {
+    if (addr >= DataSegment && addr <= StackTop + 3) return true;
+    // null plus a field offset, or the length word at null - 4
+    bool null = addr < 4096 || addr >= -4096u;
+    Fault("%s (%s 0x%08x)", null ? "null dereference" : "bad address",
+          access, addr);
+    return false;
+}
+
+int32_t MipsSim::LoadWord(uint32_t addr) {
+    if (!Mapped(addr, "word load from")) return 0;
+    if (addr & 3) {
+        Fault("unaligned word load from 0x%08x", addr);
+        return 0;
+    }
+    int32_t v;
+    memcpy(&v, Byte(addr), 4);
+    return v;
+}
+
+void MipsSim::StoreWord(uint32_t addr, int32_t val) {
+    if (!Mapped(addr, "word store to")) return;
+    if (addr & 3) {
+        Fault("unaligned word store to 0x%08x", addr);
+        return;
+    }
+    memcpy(Byte(addr), &val, 4);
+}
+
+void MipsSim::Fault(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fflush(stdout);
+    fprintf(stderr, "dsim: runtime error: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    faulted = true;
+}
+
+/* Method: Load
+ * ------------
+ * First pass assembles every line, recording label addresses and the
+ * operands that refer to labels; the second pass (Resolve) patches
+ * those references once every label is known.
+ */
+bool MipsSim::Load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "dsim: cannot open %s\n", path);
+        return false;
+    }
+    funcs.push_back("<start>");
+    bool inText = true, ok = true;
+    char buf[4096];
+    int lineNum = 0;
+    while (fgets(buf, sizeof(buf), fp)) {
+        lineNum++;
+        if (!AssembleLine(buf, lineNum, inText)) {
+            ok = false;
+            break;
+        }
+    }
+    fclose(fp);
+    if (!ok || !Resolve()) return false;
+    heapEnd = (dataEnd + 7) & ~7u;
+    funcCounters.resize(funcs.size());
+    return true;
+}
+
+bool MipsSim::AssembleLine(char *raw, int lineNum, bool &inText) {
+    // dcc marks where the code for each source line starts
+    char *p = raw;
+    while (isspace((unsigned char)*p)) p++;
+    if (strncmp(p, "# line ", 7) == 0) {
+        srcLine = atoi(p + 7);
+        return true;
+    }
+
+    // strip the comment, respecting string literals
+    string line;
+    bool inStr = false;
+    for (char *p = raw; *p && *p != '\n'; p++) {
+        if (*p == '"' && (p == raw || p[-1] != '\\')) inStr = !inStr;
+        if (*p == '#' && !inStr) break;
+        line.push_back(*p);
+    }
+    line = Trim(line);
+
+    // any number of leading labels
+    for (;;) {
+        size_t colon = string::npos;
+        for (size_t i = 0; i < line.size(); i++) {
+            if (line[i] == ':') { colon = i; break; }
+            if (!(isalnum((unsigned char)line[i]) || line[i] == '_' ||
+                  line[i] == '.' || line[i] == '$'))
+                break;
+        }
+        if (colon == string::npos || colon == 0) break;
+        string name = line.substr(0, colon);
+        if (labels.count(name)) {
+            fprintf(stderr, "dsim: line %d: duplicate label %s\n", lineNum,
+                    name.c_str());
+            return false;
+        }
+        if (inText) {
+            labels[name] = TextBase + 4 * text.size();
+            // labels that start a function are recognised after the
+            // fact in Resolve, so remember the text index for now
+        } else {
+            labels[name] = dataEnd;
+        }
+        line = Trim(line.substr(colon + 1));
+    }
+    if (line.empty()) return true;
+
+    size_t sp = 0;
+    while (sp < line.size() && !isspace((unsigned char)line[sp])) sp++;
+    string mnem = line.substr(0, sp);
+    string rest = Trim(line.substr(sp));
+
+    if (mnem[0] == '.') {
+        if (mnem == ".text") {
+            inText = true;
+        } else if (mnem == ".data") {
+            inText = false;
+        } else if (mnem == ".globl") {
+        } else if (mnem == ".align") {
+            int n = atoi(rest.c_str());
+            uint32_t a = 1u << n;
+            if (!inText) dataEnd = (dataEnd + a - 1) & ~(a - 1);
+        } else if (mnem == ".space") {
+            dataEnd += atoi(rest.c_str());
+        } else if (mnem == ".word") {
+            dataEnd = (dataEnd + 3) & ~3u;
+            size_t start = 0;
+            while (start <= rest.size()) {
+                size_t comma = rest.find(',', start);
+                string item = Trim(rest.substr(start, comma == string::npos
+                                                          ? string::npos
+                                                          : comma - start));
+                if (!item.empty()) {
+                    int32_t v;
+                    if (ParseInt(item, v)) {
+                        StoreWord(dataEnd, v);
+                    } else {
+                        WordFixup f = {dataEnd, item, lineNum};
+                        wordFixups.push_back(f);
+                    }
+                    dataEnd += 4;
+                }
+                if (comma == string::npos) break;
+                start = comma + 1;
+            }
+        } else if (mnem == ".asciiz" || mnem == ".ascii") {
+            size_t q = rest.find('"');
+            if (q == string::npos) {
+                fprintf(stderr, "dsim: line %d: bad string\n", lineNum);
+                return false;
+            }
+            for (size_t i = q + 1; i < rest.size() && rest[i] != '"'; i++) {
+                char c = rest[i];
+                if (c == '\\' && i + 1 < rest.size()) {
+                    char e = rest[++i];
+                    c = e == 'n' ? '\n' : e == 't' ? '\t' : e == '0' ? '\0' : e;
+                }
+                *Byte(dataEnd++) = c;
+            }
+            if (mnem == ".asciiz") *Byte(dataEnd++) = 0;
+        } else {
+            fprintf(stderr, "dsim: line %d: unknown directive %s\n", lineNum,
+                    mnem.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    if (!inText) {
+        fprintf(stderr, "dsim: line %d: instruction in data segment\n",
+                lineNum);
+        return false;
+    }
+
+    vector<string> args;
+    size_t start = 0;
+    while (start < rest.size()) {
+        size_t comma = rest.find(',', start);
+        args.push_back(Trim(rest.substr(
+            start, comma == string::npos ? string::npos : comma - start)));
+        if (comma == string::npos) break;
+        start = comma + 1;
+    }
+    return AssembleInsn(mnem, args, lineNum);
+}
+
+struct Mnemonic {
+    const char *name;
+    MipsSim::OpCode op;
+    char form; // r: rd,rs,rt|imm  i: rt,rs,imm  m: rt,off(rs)  b: rs,rt,L
+               // z: rs,L  l: L  j: rs  n: none  1: rd,imm  2: rd,rs
+};
+
+static const Mnemonic mnemonics[] = {
+    {"add", MipsSim::OpAdd, 'r'},    {"addu", MipsSim::OpAddu, 'r'},
+    {"sub", MipsSim::OpSub, 'r'},    {"subu", MipsSim::OpSubu, 'r'},
+    {"mul", MipsSim::OpMul, 'r'},    {"div", MipsSim::OpDiv, 'r'},
+    {"rem", MipsSim::OpRem, 'r'},    {"and", MipsSim::OpAnd, 'r'},
+    {"or", MipsSim::OpOr, 'r'},      {"xor", MipsSim::OpXor, 'r'},
+    {"nor", MipsSim::OpNor, 'r'},    {"slt", MipsSim::OpSlt, 'r'},
+    {"sltu", MipsSim::OpSltu, 'r'},  {"seq", MipsSim::OpSeq, 'r'},
+    {"sne", MipsSim::OpSne, 'r'},    {"sle", MipsSim::OpSle, 'r'},
+    {"sgt", MipsSim::OpSgt, 'r'},    {"sge", MipsSim::OpSge, 'r'},
+    {"sllv", MipsSim::OpSllv, 'r'},  {"srlv", MipsSim::OpSrlv, 'r'},
+    {"srav", MipsSim::OpSrav, 'r'},
+    {"addi", MipsSim::OpAddi, 'i'},  {"addiu", MipsSim::OpAddiu, 'i'},
+    {"slti", MipsSim::OpSlti, 'i'},  {"sltiu", MipsSim::OpSltiu, 'i'},
+    {"andi", MipsSim::OpAndi, 'i'},  {"ori", MipsSim::OpOri, 'i'},
+    {"xori", MipsSim::OpXori, 'i'},  {"sll", MipsSim::OpSll, 'i'},
+    {"srl", MipsSim::OpSrl, 'i'},    {"sra", MipsSim::OpSra, 'i'},
+    {"lui", MipsSim::OpLui, '1'},    {"li", MipsSim::OpLi, '1'},
+    {"la", MipsSim::OpLa, 'a'},      {"move", MipsSim::OpMove, '2'},
+    {"neg", MipsSim::OpNeg, '2'},    {"negu", MipsSim::OpNeg, '2'},
+    {"lw", MipsSim::OpLw, 'm'},      {"sw", MipsSim::OpSw, 'm'},
+    {"lb", MipsSim::OpLb, 'm'},      {"lbu", MipsSim::OpLbu, 'm'},
+    {"sb", MipsSim::OpSb, 'm'},
+    {"b", MipsSim::OpB, 'l'},        {"j", MipsSim::OpJ, 'l'},
+    {"jal", MipsSim::OpJal, 'l'},    {"beq", MipsSim::OpBeq, 'b'},
+    {"bne", MipsSim::OpBne, 'b'},    {"beqz", MipsSim::OpBeqz, 'z'},
+    {"bnez", MipsSim::OpBnez, 'z'},  {"bltz", MipsSim::OpBltz, 'z'},
+    {"bgez", MipsSim::OpBgez, 'z'},  {"blez", MipsSim::OpBlez, 'z'},
+    {"bgtz", MipsSim::OpBgtz, 'z'},  {"jalr", MipsSim::OpJalr, 'j'},
+    {"jr", MipsSim::OpJr, 'j'},      {"syscall", MipsSim::OpSyscall, 'n'},
+    {"nop", MipsSim::OpNop, 'n'},    {NULL, MipsSim::NumOpCodes, 0}};
+
+bool MipsSim::AssembleInsn(const string &mnem, vector<string> &args,
+                           int lineNum) {
+    const Mnemonic *m = mnemonics;
+    while (m->name && mnem != m->name) m++;
+    if (!m->name) {
+        fprintf(stderr, "dsim: line %d: unsupported instruction %s\n",
+                lineNum, mnem.c_str());
+        return false;
+    }
+    Insn in;
+    in.op = m->op;
+    in.rd = in.rs = in.rt = 0;
+    in.imm = 0;
+    in.weight = 1;
+    in.func = 0;
+    in.line = lineNum;
+    in.srcLine = srcLine;
+    in.addr = 0;
+    bool ok = true;
+    int r;
+#define REG(field, idx)                                                        \
+    (ok = ok && (int) args.size() > (idx) && (r = RegNum(args[idx])) >= 0,    \
+     in.field = ok ? r : 0)
+    switch (m->form) {
+    case 'r': {
+        REG(rd, 0);
+        REG(rs, 1);
+        if (!ok || args.size() != 3) break;
+        int rt = RegNum(args[2]);
+        if (rt >= 0) {
+            in.rt = rt;
+        } else {
+            // three-operand form with an immediate: map to the I-type
+            // equivalent where one exists
+            int32_t v;
+            if (!ParseInt(args[2], v)) { ok = false; break; }
+            switch (in.op) {
+            case OpAdd: in.op = OpAddi; break;
+            case OpAddu: in.op = OpAddiu; break;
+            case OpSubu: in.op = OpAddiu; v = -(uint32_t) v; break;
+            case OpAnd: in.op = OpAndi; break;
+            case OpOr: in.op = OpOri; break;
+            case OpXor: in.op = OpXori; break;
+            case OpSlt: in.op = OpSlti; break;
+            case OpSltu: in.op = OpSltiu; break;
+            case OpSub:
+                if (v != INT32_MIN) { in.op = OpAddi; v = -v; break; }
+                // -INT_MIN doesn't fit, so it traps like the register form
+                // fall through
+            default: {
+                // no I-type equivalent: the assembler loads the constant
+                // into $at first, which we model as a hidden li
+                Insn li = in;
+                li.op = OpLi;
+                li.rt = 1;
+                li.imm = v;
+                li.weight = 0;
+                text.push_back(li);
+                in.rt = 1;
+                in.weight = FitsSigned16(v) ? 1 : 2;
+                break;
+            }
+            }
+            if (in.rt != 1) {
+                // I-type form writes rt
+                in.rt = in.rd;
+                in.imm = v;
+                if (!FitsSigned16(v)) in.weight = 3;
+            }
+        }
+        break;
+    }
+    case 'i': {
+        REG(rt, 0);
+        REG(rs, 1);
+        ok = ok && args.size() == 3 && ParseInt(args[2], in.imm);
+        break;
+    }
+    case 'm': {
+        REG(rt, 0);
+        ok = ok && args.size() == 2 && ParseMem(args[1], in.imm, in.rs);
+        break;
+    }
+    case '1': {
+        REG(rt, 0);
+        ok = ok && args.size() == 2 && ParseInt(args[1], in.imm);
+        if (ok && in.op == OpLi && !(in.imm >= -32768 && in.imm <= 65535))
+            in.weight = 2;
+        break;
+    }
+    case '2': {
+        REG(rt, 0);
+        REG(rs, 1);
+        break;
+    }
+    case 'a': {
+        REG(rt, 0);
+        ok = ok && args.size() == 2;
+        if (ok) {
+            Fixup f = {(int) text.size(), args[1], true, lineNum};
+            fixups.push_back(f);
+        }
+        in.weight = 2;
+        break;
+    }
+    case 'l': {
+        ok = args.size() == 1;
+        if (ok) {
+            Fixup f = {(int) text.size(), args[0], false, lineNum};
+            fixups.push_back(f);
+        }
+        break;
+    }
+    case 'b': {
+        REG(rs, 0);
+        REG(rt, 1);
+        ok = ok && args.size() == 3;
+        if (ok) {
+            Fixup f = {(int) text.size(), args[2], false, lineNum};
+            fixups.push_back(f);
+        }
+        break;
+    }
+    case 'z': {
+        REG(rs, 0);
+        ok = ok && args.size() == 2;
+        if (ok) {
+            Fixup f = {(int) text.size(), args[1], false, lineNum};
+            fixups.push_back(f);
+        }
+        break;
+    }
+    case 'j': {
+        REG(rs, 0);
+        break;
+    }
+    case 'n':
+        ok = args.empty() || (args.size() == 1 && args[0].empty());
+        break;
+    }
+#undef REG
+    if (!ok) {
+        fprintf(stderr, "dsim: line %d: bad operands for %s\n", lineNum,
+                mnem.c_str());
+        return false;
+    }
+    if (in.op == OpMul) in.weight = 2;
+    if (in.op == OpDiv || in.op == OpRem) in.weight = 4;
+    if (in.op == OpSeq || in.op == OpSne || in.op == OpSle || in.op == OpSge)
+        in.weight = 2;
+    text.push_back(in);
+    return true;
+}
+
+/* Method: Resolve
+ * ---------------
+ * Patches label operands and works out which text labels are function
+ * entries: main, every jal target and every label stored in a .word
+ * (vtable slot). Each instruction is then attributed to the nearest
+ * preceding function entry for the per-function breakdown.
+ */
+bool MipsSim::Resolve() {
+    std::map<uint32_t, string> entries;
+    for (size_t i = 0; i < fixups.size(); i++) {
+        Fixup &f = fixups[i];
+        if (!labels.count(f.label)) {
+            fprintf(stderr, "dsim: line %d: undefined label %s\n", f.line,
+                    f.label.c_str());
+            return false;
+        }
+        uint32_t addr = labels[f.label];
+        Insn &in = text[f.insn];
+        if (f.isAddress) {
+            in.imm = addr;
+        } else {
+            in.imm = (addr - TextBase) / 4;
+            if (in.op == OpJal) entries[addr] = f.label;
+        }
+    }
+    for (size_t i = 0; i < wordFixups.size(); i++) {
+        WordFixup &f = wordFixups[i];
+        if (!labels.count(f.label)) {
+            fprintf(stderr, "dsim: line %d: undefined label %s\n", f.line,
+                    f.label.c_str());
+            return false;
+        }
+        uint32_t addr = labels[f.label];
+        StoreWord(f.addr, addr);
+        if (addr >= TextBase && addr < TextBase + 4 * text.size())
+            entries[addr] = f.label;
+    }
+    if (!labels.count("main")) {
+        fprintf(stderr, "dsim: no main label\n");
+        return false;
+    }
+    entries[labels["main"]] = "main";
+
+    int cur = 0;
+    uint32_t native = TextBase;
+    std::map<uint32_t, string>::iterator next = entries.begin();
+    for (size_t i = 0; i < text.size(); i++) {
+        uint32_t addr = TextBase + 4 * i;
+        while (next != entries.end() && next->first <= addr) {
+            funcs.push_back(next->second);
+            cur = funcs.size() - 1;
+            ++next;
+        }
+        text[i].func = cur;
+        text[i].addr = native;
+        native += 4 * text[i].weight;
+    }
+    return true;
+}
+
+/* Method: Syscall
+ * ---------------
+ * The SPIM system services used by the Decaf runtime.
+ */
+void MipsSim::Syscall() {
+    switch (regs[2]) {
+    case 1: // print_int
+        printf("%d", regs[4]);
+        break;
+    case 4: { // print_string
+        uint32_t a = regs[4];
+        char c;
+        if (!Mapped(a, "print_string from")) break;
+        while ((c = *Byte(a++)) != 0) putchar(c);
+        break;
+    }
+    case 5: { // read_int, a whole line like SPIM
+        char buf[256];
+        regs[2] = fgets(buf, sizeof(buf), stdin) ? atoi(buf) : 0;
+        break;
+    }
+    case 8: { // read_string into a0, at most a1 - 1 chars
+        uint32_t a = regs[4];
+        int n = regs[5], i = 0;
+        int c = 0;
+        if (!Mapped(a, "read_string into")) break;
+        while (i < n - 1 && (c = getchar()) != EOF) {
+            *Byte(a + i++) = c;
+            if (c == '\n') break;
+        }
+        *Byte(a + i) = 0;
+        break;
+    }
+    case 9: { // sbrk
+        uint32_t old = heapEnd;
+        heapEnd += (regs[4] + 3) & ~3;
+        regs[2] = old;
+        break;
+    }
+    case 10: // exit
+        break;
+    default:
+        Fault("unsupported syscall %d", regs[2]);
+    }
+}
+
+/* Method: Trapping
+ * ----------------
+ * Writes the exact result of a signed add or sub to reg, or traps like
+ * SPIM when it does not fit in 32 bits.
+ */
+void MipsSim::Trapping(int reg, int64_t result) {
+    if (result != (int32_t) result)
+        Fault("arithmetic overflow");
+    else
+        regs[reg] = (int32_t) result;
+}
+
+uint32_t MipsSim::Branch(uint32_t pc, uint32_t target, int64_t &delayedTarget) {
+    if (!delayed)
+        return target;
+    delayedTarget = target;
+    return pc + 1;
+}
+
+void MipsSim::SetLoaded(int reg, int32_t val, int &loadReg, int32_t &loadVal) {
+    if (delayed) {
+        loadReg = reg;
+        loadVal = val;
+    } else {
+        regs[reg] = val;
+    }
+}
+
+// result latencies, the same as in the Scheduler's machine model
+int MipsSim::Latency(OpCode op) {
+    switch (op) {
+    case OpLw: case OpLb: case OpLbu: return 2;
+    case OpMul: return 12;
+    case OpDiv: case OpRem: return 35;
+    default: return 1;
+    }
+}
+
+void MipsSim::Operands(const Insn &in, int *src, int &nsrc, int &dst) {
+    nsrc = 0;
+    dst = -1;
+    if (in.op <= OpSrav) {
+        dst = in.rd; src[nsrc++] = in.rs; src[nsrc++] = in.rt;
+    } else if (in.op <= OpSra || in.op == OpMove || in.op == OpNeg ||
+               in.op == OpLw || in.op == OpLb || in.op == OpLbu) {
+        dst = in.rt; src[nsrc++] = in.rs;
+    } else if (in.op == OpLui || in.op == OpLi || in.op == OpLa) {
+        dst = in.rt;
+    } else if (in.op == OpSw || in.op == OpSb || in.op == OpBeq || in.op == OpBne) {
+        src[nsrc++] = in.rs; src[nsrc++] = in.rt;
+    } else if (in.op >= OpBeqz && in.op <= OpBgtz) {
+        src[nsrc++] = in.rs;
+    } else if (in.op == OpJalr || in.op == OpJr) {
+        src[nsrc++] = in.rs;
+    } else if (in.op == OpSyscall) {
+        src[nsrc++] = 2; src[nsrc++] = 4; src[nsrc++] = 5;
+    }
+}
+
+int MipsSim::Run() {
+    regs[28] = GlobalPointer;
+    regs[29] = StackTop & ~7u;
+    regs[30] = regs[29];
+    uint32_t end = text.size();
+    regs[31] = TextBase + 4 * end; // returning from main halts
+    uint32_t pc = (labels["main"] - TextBase) / 4;
+
+    int64_t delayedTarget = -1; // taken branch waiting for its delay slot
+    int loadReg = 0;             // load waiting for its delay slot
+    int32_t loadVal = 0;
+    uint64_t cycle = 0;
+    uint64_t ready[32] = {0};
+
+    while (pc < end && !faulted) {
+        const Insn &in = text[pc];
+        Counters &fc = funcCounters[in.func];
+        uint32_t next = pc + 1;
+        int pendReg = loadReg;
+        int32_t pendVal = loadVal;
+        loadReg = 0;
+        int64_t slotTarget = delayedTarget;
+        delayedTarget = -1;
+        {
+            // scoreboard timing: single issue, interlocked
+            int src[3], nsrc = 0, dst = -1;
+            Operands(in, src, nsrc, dst);
+            uint64_t issue = cycle;
+            for (int k = 0; k < nsrc; k++)
+                if (ready[src[k]] > issue) { stalls += ready[src[k]] - issue; issue = ready[src[k]]; }
+            cycle = issue + in.weight;
+            if (dst > 0 && in.weight) ready[dst] = issue + in.weight - 1 + Latency(in.op);
+        }
+        if (in.weight) fc.insns++;
+        fc.native += in.weight;
+        int32_t *R = regs;
+        int64_t dataAddr = -1; // for the pipeline model
+        bool taken = false;
+        switch (in.op) {
+        case OpAdd: Trapping(in.rd, (int64_t) R[in.rs] + R[in.rt]); break;
+        case OpAddu: R[in.rd] = (uint32_t) R[in.rs] + (uint32_t) R[in.rt]; break;
+        case OpSub: Trapping(in.rd, (int64_t) R[in.rs] - R[in.rt]); break;
+        case OpSubu: R[in.rd] = (uint32_t) R[in.rs] - (uint32_t) R[in.rt]; break;
+        case OpMul: R[in.rd] = (uint32_t) R[in.rs] * (uint32_t) R[in.rt]; break;
+        case OpDiv:
+        case OpRem:
+            if (R[in.rt] == 0) {
+                Fault("division by zero");
+                break;
+            }
+            if (R[in.rs] == INT32_MIN && R[in.rt] == -1)
+                R[in.rd] = in.op == OpDiv ? INT32_MIN : 0;
+            else
+                R[in.rd] = in.op == OpDiv ? R[in.rs] / R[in.rt]
+                                          : R[in.rs] % R[in.rt];
+            break;
+        case OpAnd: R[in.rd] = R[in.rs] & R[in.rt]; break;
+        case OpOr: R[in.rd] = R[in.rs] | R[in.rt]; break;
+        case OpXor: R[in.rd] = R[in.rs] ^ R[in.rt]; break;
+        case OpNor: R[in.rd] = ~(R[in.rs] | R[in.rt]); break;
+        case OpSlt: R[in.rd] = R[in.rs] < R[in.rt]; break;
+        case OpSltu: R[in.rd] = (uint32_t) R[in.rs] < (uint32_t) R[in.rt]; break;
+        case OpSeq: R[in.rd] = R[in.rs] == R[in.rt]; break;
+        case OpSne: R[in.rd] = R[in.rs] != R[in.rt]; break;
+        case OpSle: R[in.rd] = R[in.rs] <= R[in.rt]; break;
+        case OpSgt: R[in.rd] = R[in.rs] > R[in.rt]; break;
+        case OpSge: R[in.rd] = R[in.rs] >= R[in.rt]; break;
+        case OpSllv: R[in.rd] = (uint32_t) R[in.rs] << (R[in.rt] & 31); break;
+        case OpSrlv: R[in.rd] = (uint32_t) R[in.rs] >> (R[in.rt] & 31); break;
+        case OpSrav: R[in.rd] = R[in.rs] >> (R[in.rt] & 31); break;
+        case OpAddi: Trapping(in.rt, (int64_t) R[in.rs] + in.imm); break;
+        case OpAddiu: R[in.rt] = (uint32_t) R[in.rs] + (uint32_t) in.imm; break;
+        case OpSlti: R[in.rt] = R[in.rs] < in.imm; break;
+        case OpSltiu: R[in.rt] = (uint32_t) R[in.rs] < (uint32_t) in.imm; break;
+        case OpAndi: R[in.rt] = R[in.rs] & (in.imm & 0xffff); break;
+        case OpOri: R[in.rt] = R[in.rs] | (in.imm & 0xffff); break;
+        case OpXori: R[in.rt] = R[in.rs] ^ (in.imm & 0xffff); break;
+        case OpSll: R[in.rt] = (uint32_t) R[in.rs] << (in.imm & 31); break;
+        case OpSrl: R[in.rt] = (uint32_t) R[in.rs] >> (in.imm & 31); break;
+        case OpSra: R[in.rt] = R[in.rs] >> (in.imm & 31); break;
+        case OpLui: R[in.rt] = (uint32_t) in.imm << 16; break;
+        case OpLi: case OpLa: R[in.rt] = in.imm; break;
+        case OpMove: R[in.rt] = R[in.rs]; break;
+        case OpNeg: R[in.rt] = -(uint32_t) R[in.rs]; break;
+        case OpLw:
+            fc.loads++;
+            dataAddr = (uint32_t) R[in.rs] + (uint32_t) in.imm;
+            SetLoaded(in.rt, LoadWord(dataAddr), loadReg, loadVal);
+            break;
+        case OpSw:
+            fc.stores++;
+            dataAddr = (uint32_t) R[in.rs] + (uint32_t) in.imm;
+            StoreWord(dataAddr, R[in.rt]);
+            break;
+        case OpLb:
+            fc.loads++;
+            dataAddr = (uint32_t) R[in.rs] + (uint32_t) in.imm;
+            if (Mapped(dataAddr, "byte load from"))
+                SetLoaded(in.rt, (int8_t) *Byte(dataAddr), loadReg, loadVal);
+            break;
+        case OpLbu:
+            fc.loads++;
+            dataAddr = (uint32_t) R[in.rs] + (uint32_t) in.imm;
+            if (Mapped(dataAddr, "byte load from"))
+                SetLoaded(in.rt, *Byte(dataAddr), loadReg, loadVal);
+            break;
+        case OpSb:
+            fc.stores++;
+            dataAddr = (uint32_t) R[in.rs] + (uint32_t) in.imm;
+            if (Mapped(dataAddr, "byte store to"))
+                *Byte(dataAddr) = (uint8_t) R[in.rt];
+            break;
+        case OpB: case OpJ:
+            taken = true;
+            next = Branch(pc, in.imm, delayedTarget);
+            break;
+        case OpBeq: case OpBne: case OpBeqz: case OpBnez: case OpBltz:
+        case OpBgez: case OpBlez: case OpBgtz: {
+            bool take;
+            int32_t v = R[in.rs];
+            switch (in.op) {
+            case OpBeq: take = v == R[in.rt]; break;
+            case OpBne: take = v != R[in.rt]; break;
+            case OpBeqz: take = v == 0; break;
+            case OpBnez: take = v != 0; break;
+            case OpBltz: take = v < 0; break;
+            case OpBgez: take = v >= 0; break;
+            case OpBlez: take = v <= 0; break;
+            default: take = v > 0; break;
+            }
+            fc.branches++;
+            if (take) {
+                fc.taken++;
+                taken = true;
+                next = Branch(pc, in.imm, delayedTarget);
+            }
+            break;
+        }
+        case OpJal:
+            fc.calls++;
+            taken = true;
+            R[31] = TextBase + 4 * (pc + (delayed ? 2 : 1));
+            next = Branch(pc, in.imm, delayedTarget);
+            break;
+        case OpJalr: {
+            fc.calls++;
+            taken = true;
+            uint32_t target = R[in.rs];
+            R[31] = TextBase + 4 * (pc + (delayed ? 2 : 1));
+            next = Branch(pc, (target - TextBase) / 4, delayedTarget);
+            break;
+        }
+        case OpJr:
+            taken = true;
+            next = Branch(pc, ((uint32_t) R[in.rs] - TextBase) / 4, delayedTarget);
+            break;
+        case OpSyscall:
+            if (R[2] == 10) {
+                next = end;
+                break;
+            }
+            Syscall();
+            break;
+        case OpNop:
+        case NumOpCodes:
+            break;
+        }
+        if (pipeline)
+            pipeline->Issue(in, dataAddr, taken);
+        if (pendReg) R[pendReg] = pendVal;
+        R[0] = 0;
+        if (slotTarget >= 0)
+            next = slotTarget;
+        if (next > end) {
+            Fault("jump to bad address 0x%08x", TextBase + 4 * next);
+            break;
+        }
+        pc = next;
+    }
+    cycles = cycle;
+    fflush(stdout);
+    return faulted ? 1 : 0;
+}
+
+/* Method: PrintStats
+ * ------------------
+ * Dumps the totals followed by one row per function that executed
+ * anything, hottest first.
+ */
+void MipsSim::PrintStats(FILE *out) {
+    Counters t;
+    vector<std::pair<uint64_t, int> > order;
+    for (size_t i = 0; i < funcCounters.size(); i++) {
+        Counters &c = funcCounters[i];
+        t.insns += c.insns;
+        t.native += c.native;
+        t.loads += c.loads;
+        t.stores += c.stores;
+        t.branches += c.branches;
+        t.taken += c.taken;
+        t.calls += c.calls;
+        if (c.insns) order.push_back(std::make_pair(c.native, (int) i));
+    }
+    std::sort(order.rbegin(), order.rend());
+    fprintf(out, "instructions %llu\n", (unsigned long long) t.insns);
+    fprintf(out, "native       %llu\n", (unsigned long long) t.native);
+    fprintf(out, "loads        %llu\n", (unsigned long long) t.loads);
+    fprintf(out, "stores       %llu\n", (unsigned long long) t.stores);
+    fprintf(out, "branches     %llu (%llu taken)\n",
+            (unsigned long long) t.branches, (unsigned long long) t.taken);
+    fprintf(out, "calls        %llu\n", (unsigned long long) t.calls);
+    fprintf(out, "cycles       %llu (%llu stalls)\n", (unsigned long long) cycles,
+            (unsigned long long) stalls);
+    fprintf(out, "%-24s %12s %12s %10s %10s %10s\n", "function", "insns",
+            "native", "loads", "stores", "branches");
+    for (size_t i = 0; i < order.size(); i++) {
+        Counters &c = funcCounters[order[i].second];
+        fprintf(out, "%-24s %12llu %12llu %10llu %10llu %10llu\n",
+                funcs[order[i].second].c_str(), (unsigned long long) c.insns,
+                (unsigned long long) c.native, (unsigned long long) c.loads,
+                (unsigned long long) c.stores,
+                (unsigned long long) c.branches);
+    }
+    if (pipeline)
+        pipeline->PrintStats(out, funcs);
+}
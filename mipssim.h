@@ -0,0 +1,138 @@
+/* File: mipssim.h
+ * ---------------
+ * A small MIPS32 simulator for the assembly that dcc emits. It loads
+ * the text produced by the Mips class and SysCallCodeGen (the SPIM
+ * assembler dialect, including the pseudo-instructions we use), runs
+ * it, and implements the SPIM syscalls for printing, reading and sbrk.
+ *
+ * Besides running programs, the simulator counts what the program did:
+ * dynamic instructions (both as written and as expanded into native
+ * MIPS instructions), loads, stores, taken/untaken branches, calls and
+ * a per-function breakdown, plus a cycle count from a simple in-order
+ * interlocked timing model. That makes compiler optimizations
+ * measurable deterministically without an external SPIM. A Pipeline
+ * (see pipeline.h) can be attached for a detailed timing model.
+ */
+
+#ifndef _H_mipssim
+#define _H_mipssim
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Pipeline;
+
+class MipsSim {
+public:
+    typedef enum {
+        OpAdd, OpAddu, OpSub, OpSubu, OpMul, OpDiv, OpRem, OpAnd, OpOr,
+        OpXor, OpNor, OpSlt, OpSltu, OpSeq, OpSne, OpSle, OpSgt, OpSge,
+        OpSllv, OpSrlv, OpSrav,
+        OpAddi, OpAddiu, OpSlti, OpSltiu, OpAndi, OpOri, OpXori, OpSll,
+        OpSrl, OpSra, OpLui, OpLi, OpLa, OpMove, OpNeg,
+        OpLw, OpSw, OpLb, OpLbu, OpSb,
+        OpB, OpJ, OpBeq, OpBne, OpBeqz, OpBnez, OpBltz, OpBgez, OpBlez,
+        OpBgtz, OpJal, OpJalr, OpJr,
+        OpSyscall, OpNop,
+        NumOpCodes
+    } OpCode;
+
+    // One pre-decoded instruction. Register fields index the register
+    // file directly, imm carries immediates, memory offsets and resolved
+    // branch targets (as an instruction index).
+    struct Insn {
+        OpCode op;
+        uint8_t rd, rs, rt;
+        int32_t imm;
+        int weight;   // native instructions this statement expands to
+        int func;     // index into funcs of the enclosing function
+        int line;     // text line in the assembly file
+        int srcLine;  // Decaf source line from the last "# line" marker
+        uint32_t addr; // address of its first native instruction
+    };
+
+    // Dynamic counters, kept per function and for the whole run.
+    struct Counters {
+        uint64_t insns, native, loads, stores, branches, taken, calls;
+        Counters() : insns(0), native(0), loads(0), stores(0), branches(0),
+                     taken(0), calls(0) {}
+    };
+
+    MipsSim();
+
+    // Assembles the file; returns false and prints a message on error.
+    bool Load(const char *path);
+
+    // Runs from main until the exit syscall or the end of the program.
+    // Returns the process exit status (0, or 1 on a runtime fault).
+    int Run();
+
+    void PrintStats(FILE *out);
+
+    // Delayed branches and loads: the instruction after a branch always
+    // executes, and a loaded value is not visible to the next instruction.
+    void SetDelayed(bool on) { delayed = on; }
+
+    // Feeds every executed instruction to p, which PrintStats reports on.
+    void SetPipeline(Pipeline *p) { pipeline = p; }
+
+    // Result latency of op in cycles, and the registers in reads (at most
+    // 3) and writes (-1 if none).
+    static int Latency(OpCode op);
+    static void Operands(const Insn &in, int *src, int &nsrc, int &dst);
+
+private:
+    static const uint32_t TextBase = 0x00400000, DataBase = 0x10010000,
+                          GlobalPointer = 0x10008000, StackTop = 0x7ffffffc;
+    // a program may only load or store from the start of the gp-addressable
+    // part of the data segment up to the top of the stack
+    static const uint32_t DataSegment = GlobalPointer - 0x8000;
+    static const int PageBits = 12;
+
+    std::vector<Insn> text;
+    std::vector<std::string> funcs;
+    std::vector<Counters> funcCounters;
+    Counters total;
+
+    std::map<std::string, uint32_t> labels;   // label -> address
+    std::map<uint32_t, std::vector<uint8_t> > pages;
+    uint32_t dataEnd, heapEnd;
+    uint32_t lastPage;    // one-entry cache in front of pages
+    uint8_t *lastBase;
+    int32_t regs[32];
+
+    // assembler state
+    struct Fixup { int insn; std::string label; bool isAddress; int line; };
+    std::vector<Fixup> fixups;
+    struct WordFixup { uint32_t addr; std::string label; int line; };
+    std::vector<WordFixup> wordFixups;
+
+    bool AssembleLine(char *line, int lineNum, bool &inText);
+    bool AssembleInsn(const std::string &mnem,
+                      std::vector<std::string> &args, int lineNum);
+    bool Resolve();
+    int RegNum(const std::string &name);
+    bool ParseMem(const std::string &s, int32_t &off, uint8_t &base);
+
+    uint8_t *Byte(uint32_t addr);
+    bool Mapped(uint32_t addr, const char *access);
+    int32_t LoadWord(uint32_t addr);
+    void StoreWord(uint32_t addr, int32_t val);
+    void Fault(const char *fmt, ...);
+    int srcLine;
+    bool faulted;
+    bool delayed;
+    uint64_t cycles, stalls;
+    Pipeline *pipeline;
+
+    void Trapping(int reg, int64_t result);
+    uint32_t Branch(uint32_t pc, uint32_t target, int64_t &delayedTarget);
+    void SetLoaded(int reg, int32_t val, int &loadReg, int32_t &loadVal);
+
+    void Syscall();
+};
+
+#endif
@@ -11,6 +11,18 @@
 
 void yyerror(const char *msg); // standard error-handling routine
 
+// A rule's location runs from its first symbol's to its last's; an
+// empty rule sits at the end of what came before it. (yacc's default
+// works on line and column fields, which yyltype doesn't have.)
+#define YYLLOC_DEFAULT(Current, Rhs, N)                          \
+    do {                                                         \
+        if (N) {                                                 \
+            (Current).first = YYRHSLOC(Rhs, 1).first;            \
+            (Current).last = YYRHSLOC(Rhs, N).last;              \
+        } else                                                   \
+            (Current).first = (Current).last = YYRHSLOC(Rhs, 0).last; \
+    } while (0)
+
 %}
 
  
@@ -22,7 +34,7 @@ void yyerror(const char *msg); // standard error-handling routine
     bool boolConstant;
     char *stringConstant;
     double doubleConstant;
-    char identifier[MaxIdentLen+1]; // +1 for terminating null
+    const char *identifier; // interned, see intern.h
     Decl *decl;
     List<Decl*> *declList;
     Type *type;
@@ -103,6 +115,7 @@ Program   :    DeclList            {
                                           program->Check(); 
                                       if (ReportError::NumErrors() == 0) 
                                           program->Emit(); 
+                                      Arena::ast.Release();
                                     }
           ;
 
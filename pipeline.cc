@@ -0,0 +1,192 @@
+/* File: pipeline.cc
+ * -----------------
+ * Implementation of the Cache and Pipeline classes.
+ */
+
+#include "pipeline.h"
+#include <algorithm>
+#include <string.h>
+
+using std::string;
+using std::vector;
+
+static const char *causeNames[Pipeline::NumCauses] = {
+    "load-use", "mul/div", "control", "icache", "dcache"};
+
+static int Log2(uint32_t n) {
+    int bits = 0;
+    while ((1u << bits) < n) bits++;
+    return bits;
+}
+
+static bool PowerOfTwo(int n) { return n > 0 && (n & (n - 1)) == 0; }
+
+Cache::Cache(Config c) : config(c), clock(0) {
+    lineBits = Log2(c.line);
+    sets = c.size / (c.line * c.ways);
+    tags.resize(sets * c.ways, 0);
+    used.resize(sets * c.ways, 0);
+}
+
+bool Cache::Valid(Config c) {
+    return PowerOfTwo(c.size) && PowerOfTwo(c.line) && PowerOfTwo(c.ways) &&
+           c.line >= 4 && c.size >= c.line * c.ways;
+}
+
+/* Method: Access
+ * --------------
+ * Set-associative with LRU replacement: the way holding the tag is a
+ * hit, otherwise the least recently used (or an empty) way is refilled.
+ */
+bool Cache::Access(uint32_t addr) {
+    uint32_t line = addr >> lineBits;
+    uint32_t set = line & (sets - 1), tag = line / sets;
+    uint32_t first = set * config.ways, victim = first;
+    clock++;
+    for (uint32_t w = first; w < first + config.ways; w++) {
+        if (used[w] && tags[w] == tag) {
+            used[w] = clock;
+            return true;
+        }
+        if (used[w] < used[victim]) victim = w;
+    }
+    tags[victim] = tag;
+    used[victim] = clock;
+    return false;
+}
+
+
+Pipeline::Counters::Counters()
+    : cycles(0), native(0), fetches(0), fetchMisses(0), accesses(0),
+      accessMisses(0) {
+    memset(stalls, 0, sizeof(stalls));
+}
+
+uint64_t Pipeline::Counters::Stalls() const {
+    uint64_t n = 0;
+    for (int c = 0; c < NumCauses; c++) n += stalls[c];
+    return n;
+}
+
+Pipeline::Pipeline(Cache::Config i, Cache::Config d, int penalty, bool delay)
+    : icache(i), dcache(d), missPenalty(penalty), delayed(delay), cycle(0) {
+    memset(ready, 0, sizeof(ready));
+    for (int r = 0; r < 32; r++) readyCause[r] = LoadUse;
+}
+
+void Pipeline::Stall(Counters &f, Counters &l, Cause cause, uint64_t n) {
+    cycle += n;
+    total.stalls[cause] += n;
+    f.stalls[cause] += n;
+    l.stalls[cause] += n;
+}
+
+/* Method: Issue
+ * -------------
+ * One instruction as written may stand for several native ones (a
+ * pseudo-instruction); they are fetched one after the other and issue
+ * back to back, so only the first can wait on an operand. A value is
+ * available Latency() cycles after the instruction producing it issues
+ * its last native instruction, plus any data cache miss it took.
+ */
+void Pipeline::Issue(const MipsSim::Insn &in, int64_t dataAddr, bool taken) {
+    if (in.weight == 0) return; // hidden part of the next instruction
+    if (in.func >= (int) perFunc.size()) perFunc.resize(in.func + 1);
+    Counters &f = perFunc[in.func], &l = perLine[in.srcLine];
+    uint64_t start = cycle;
+
+    for (int k = 0; k < in.weight; k++) {
+        total.fetches++, f.fetches++, l.fetches++;
+        if (!icache.Access(in.addr + 4 * k)) {
+            total.fetchMisses++, f.fetchMisses++, l.fetchMisses++;
+            Stall(f, l, ICacheMiss, missPenalty);
+        }
+    }
+
+    int src[3], nsrc, dst;
+    MipsSim::Operands(in, src, nsrc, dst);
+    for (int k = 0; k < nsrc; k++)
+        if (src[k] != 0 && ready[src[k]] > cycle)
+            Stall(f, l, readyCause[src[k]], ready[src[k]] - cycle);
+    cycle += in.weight;
+
+    if (dataAddr >= 0) {
+        total.accesses++, f.accesses++, l.accesses++;
+        if (!dcache.Access(dataAddr)) {
+            total.accessMisses++, f.accessMisses++, l.accessMisses++;
+            Stall(f, l, DCacheMiss, missPenalty);
+        }
+    }
+    if (dst > 0) {
+        ready[dst] = cycle - 1 + MipsSim::Latency(in.op);
+        readyCause[dst] = dataAddr >= 0 ? LoadUse : MulDiv;
+    }
+    if (taken && !delayed)
+        Stall(f, l, Control, 1);
+
+    total.native += in.weight, f.native += in.weight, l.native += in.weight;
+    total.cycles += cycle - start;
+    f.cycles += cycle - start;
+    l.cycles += cycle - start;
+}
+
+static double Percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+void Pipeline::PrintRow(FILE *out, const char *name, const Counters &c) {
+    fprintf(out, "%-24s %12llu %6.2f %10llu %8.2f%% %8.2f%%\n", name,
+            (unsigned long long) c.cycles,
+            c.native ? (double) c.cycles / c.native : 0.0,
+            (unsigned long long) c.Stalls(),
+            Percent(c.fetchMisses, c.fetches),
+            Percent(c.accessMisses, c.accesses));
+}
+
+/* Method: PrintStats
+ * ------------------
+ * The totals, then the functions and source lines that executed
+ * anything, each hottest first.
+ */
+void Pipeline::PrintStats(FILE *out, const vector<string> &funcs) {
+    fprintf(out, "pipeline     %llu cycles, CPI %.2f\n",
+            (unsigned long long) total.cycles,
+            total.native ? (double) total.cycles / total.native : 0.0);
+    fprintf(out, "stalls      ");
+    for (int c = 0; c < NumCauses; c++)
+        fprintf(out, " %s %llu", causeNames[c],
+                (unsigned long long) total.stalls[c]);
+    fprintf(out, "\n");
+    fprintf(out, "icache       %llu fetches, %llu misses (%.2f%%)\n",
+            (unsigned long long) total.fetches,
+            (unsigned long long) total.fetchMisses,
+            Percent(total.fetchMisses, total.fetches));
+    fprintf(out, "dcache       %llu accesses, %llu misses (%.2f%%)\n",
+            (unsigned long long) total.accesses,
+            (unsigned long long) total.accessMisses,
+            Percent(total.accessMisses, total.accesses));
+
+    vector<std::pair<uint64_t, int> > order;
+    for (size_t i = 0; i < perFunc.size(); i++)
+        if (perFunc[i].native) order.push_back(std::make_pair(perFunc[i].cycles, (int) i));
+    std::sort(order.rbegin(), order.rend());
+    fprintf(out, "%-24s %12s %6s %10s %9s %9s\n", "function", "cycles", "CPI",
+            "stalls", "i-miss", "d-miss");
+    for (size_t i = 0; i < order.size(); i++)
+        PrintRow(out, funcs[order[i].second].c_str(), perFunc[order[i].second]);
+
+    order.clear();
+    for (std::map<int, Counters>::iterator i = perLine.begin(); i != perLine.end(); ++i)
+        order.push_back(std::make_pair(i->second.cycles, i->first));
+    std::sort(order.rbegin(), order.rend());
+    fprintf(out, "%-24s %12s %6s %10s %9s %9s\n", "source line", "cycles", "CPI",
+            "stalls", "i-miss", "d-miss");
+    for (size_t i = 0; i < order.size(); i++) {
+        char name[32];
+        if (order[i].second)
+            snprintf(name, sizeof(name), "line %d", order[i].second);
+        else
+            snprintf(name, sizeof(name), "(runtime)");
+        PrintRow(out, name, perLine[order[i].second]);
+    }
+}
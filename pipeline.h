@@ -0,0 +1,89 @@
+/* File: pipeline.h
+ * ----------------
+ * A timing model for the MIPS simulator (dsim -pipeline). It follows
+ * the instructions MipsSim executes through a classic in-order 5-stage
+ * pipeline with full forwarding and branches resolved in ID, in front
+ * of set-associative L1 instruction and data caches. It does not
+ * affect what the program computes, only what it is charged.
+ *
+ * The hazards it models are the ones our generated code runs into:
+ * load-use (a loaded value is one cycle late), the long mul/div
+ * latencies (the same as in the Scheduler's machine model), the bubble
+ * after a taken branch or jump (hidden by the delay slot under -delayed)
+ * and cache misses, which stall for a fixed penalty. Cycles, stalls by
+ * cause and miss rates are kept for the whole run, per function and per
+ * Decaf source line (from the "# line" markers dcc emits).
+ */
+
+#ifndef _H_pipeline
+#define _H_pipeline
+
+#include "mipssim.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Cache {
+public:
+    // sizes in bytes, all powers of two
+    struct Config { int size, line, ways; };
+
+    Cache(Config config);
+
+    // Looks up the line holding addr, filling it on a miss (stores
+    // allocate too). Returns true on a hit.
+    bool Access(uint32_t addr);
+
+    // Whether config describes a cache this class can model.
+    static bool Valid(Config config);
+
+private:
+    Config config;
+    int lineBits;
+    uint32_t sets;
+    std::vector<uint32_t> tags;    // sets * ways, tag of the line held
+    std::vector<uint64_t> used;    // last access time, 0 = empty
+    uint64_t clock;
+};
+
+class Pipeline {
+public:
+    typedef enum { LoadUse, MulDiv, Control, ICacheMiss, DCacheMiss,
+                   NumCauses } Cause;
+
+    Pipeline(Cache::Config icache, Cache::Config dcache, int missPenalty,
+             bool delayed);
+
+    // Accounts for one executed instruction: dataAddr is the address a
+    // load or store touched (-1 for others), taken whether control
+    // transferred somewhere other than the next instruction.
+    void Issue(const MipsSim::Insn &in, int64_t dataAddr, bool taken);
+
+    void PrintStats(FILE *out, const std::vector<std::string> &funcs);
+
+private:
+    struct Counters {
+        uint64_t cycles, native, stalls[NumCauses];
+        uint64_t fetches, fetchMisses, accesses, accessMisses;
+        Counters();
+        uint64_t Stalls() const;
+    };
+
+    Cache icache, dcache;
+    int missPenalty;
+    bool delayed;
+    uint64_t cycle;
+    uint64_t ready[32];        // cycle each register's value is available
+    Cause readyCause[32];      // what to blame for waiting on it
+
+    Counters total;
+    std::vector<Counters> perFunc;
+    std::map<int, Counters> perLine;
+
+    void Stall(Counters &f, Counters &l, Cause cause, uint64_t n);
+    static void PrintRow(FILE *out, const char *name, const Counters &c);
+};
+
+#endif
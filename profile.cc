@@ -0,0 +1,162 @@
+/* File: profile.cc
+ * ----------------
+ * Implementation of the Profiler class. The instrumentation only uses
+ * $k0 and $k1, which nothing else in the generated code touches, so it
+ * can go anywhere without disturbing register contents.
+ */
+
+#include "profile.h"
+#include "mips.h"
+#include <stdio.h>
+#include <string.h>
+
+using std::string;
+
+Profiler::Profiler(bool e) : emit(e), lastLabel("") {}
+
+// FNV-1a
+static uint32_t Hash(const string &s) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < s.size(); i++)
+        h = (h ^ (unsigned char) s[i]) * 16777619u;
+    return h;
+}
+
+void Profiler::AddCounter(char kind, const char *callee, int line) {
+    string which = string(1, kind) + (callee ? callee : "");
+    char ordinal[16];
+    sprintf(ordinal, "%d", ordinals[which]++);
+    Counter c = {function, kind, Hash(function + ' ' + which + ' ' + ordinal),
+                 line};
+    int offset = 4 * counters.size();
+    counters.push_back(c);
+    if (!emit) return;
+    Mips::Emit("la $k0, _profile\t# profile counter %d", offset / 4);
+    Mips::Emit("lw $k1, %d($k0)", offset);
+    Mips::Emit("addiu $k1, $k1, 1");
+    Mips::Emit("sw $k1, %d($k0)", offset);
+}
+
+void Profiler::EmitDumpCall() {
+    if (!emit) return;
+    Mips::Emit("jal _ProfileDump\t# write out the profile");
+}
+
+void Profiler::Before(List<Instruction *> *code, int i) {
+    Instruction *instr = code->Nth(i);
+    if (LCall *lc = dynamic_cast<LCall *>(instr))
+        AddCounter('c', lc->GetLabel(), instr->GetLine());
+    else if (dynamic_cast<ACall *>(instr))
+        AddCounter('c', "*", instr->GetLine());
+    else if ((dynamic_cast<Return *>(instr) || dynamic_cast<EndFunc *>(instr)) &&
+             function == "main")
+        EmitDumpCall();
+}
+
+/* Method: After
+ * -------------
+ * A function's own label is followed by its BeginFunc, which gets the
+ * entry counter once the frame is set up; every other label starts a
+ * block.
+ */
+void Profiler::After(List<Instruction *> *code, int i) {
+    Instruction *instr = code->Nth(i);
+    if (Label *l = dynamic_cast<Label *>(instr)) {
+        lastLabel = l->GetLabel();
+        if (i + 1 >= code->NumElements() ||
+            !dynamic_cast<BeginFunc *>(code->Nth(i + 1)))
+            AddCounter('b', NULL, instr->GetLine());
+        else
+            return;
+    } else if (dynamic_cast<BeginFunc *>(instr)) {
+        function = lastLabel;
+        ordinals.clear();
+        AddCounter('e', NULL, instr->GetLine());
+    } else if (dynamic_cast<IfZ *>(instr) || dynamic_cast<IfNZ *>(instr)) {
+        AddCounter('f', NULL, instr->GetLine());
+    } else {
+        return;
+    }
+    blockCounters[i] = counters.size() - 1;
+}
+
+int Profiler::BlockCounter(int i) const {
+    std::map<int, int>::const_iterator it = blockCounters.find(i);
+    return it == blockCounters.end() ? -1 : it->second;
+}
+
+/* Method: EmitRuntime
+ * -------------------
+ * _ProfileDump walks a null-terminated table of descriptor strings in
+ * step with the counters, printing each descriptor and then its count.
+ */
+void Profiler::EmitRuntime() {
+    Mips::Emit("_ProfileDump:");
+    Mips::Emit("la $a0, _profile_header");
+    Mips::Emit("li $v0, 4\t\t# print_string");
+    Mips::Emit("syscall");
+    Mips::Emit("la $k0, _profile_names");
+    Mips::Emit("la $k1, _profile");
+    Mips::Emit("_ProfileDumpNext:");
+    Mips::Emit("lw $a0, 0($k0)");
+    Mips::Emit("beqz $a0, _ProfileDumpDone");
+    Mips::Emit("li $v0, 4\t\t# print_string");
+    Mips::Emit("syscall");
+    Mips::Emit("lw $a0, 0($k1)");
+    Mips::Emit("li $v0, 1\t\t# print_int");
+    Mips::Emit("syscall");
+    Mips::Emit("la $a0, _profile_newline");
+    Mips::Emit("li $v0, 4\t\t# print_string");
+    Mips::Emit("syscall");
+    Mips::Emit("addiu $k0, $k0, 4");
+    Mips::Emit("addiu $k1, $k1, 4");
+    Mips::Emit("b _ProfileDumpNext");
+    Mips::Emit("_ProfileDumpDone:");
+    Mips::Emit("jr $ra");
+
+    Mips::Emit(".data");
+    Mips::Emit(".align 2");
+    Mips::Emit("_profile: .space %d", 4 * counters.size() + 4);
+    Mips::Emit("_profile_names:");
+    for (size_t i = 0; i < counters.size(); i++)
+        Mips::Emit(".word _profile_name%d", (int) i);
+    Mips::Emit(".word 0");
+    for (size_t i = 0; i < counters.size(); i++) {
+        Counter &c = counters[i];
+        Mips::Emit("_profile_name%d: .asciiz \"%s %c %08x %d \"", (int) i,
+                   c.function.c_str(), c.kind, c.key, c.line);
+    }
+    Mips::Emit("_profile_header: .asciiz \"\\n#dcc-profile\\n\"");
+    Mips::Emit("_profile_newline: .asciiz \"\\n\"");
+    Mips::Emit(".text");
+}
+
+
+bool ProfileData::Read(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+        return false;
+    char line[1024], function[512], kind;
+    unsigned key;
+    long long count;
+    int srcLine;
+    while (fgets(line, sizeof(line), in)) {
+        if (strncmp(line, "#dcc-profile", 12) == 0) {
+            counts.clear(); // only the last dump counts
+            continue;
+        }
+        if (sscanf(line, "%511s %c %x %d %lld", function, &kind, &key,
+                   &srcLine, &count) != 5)
+            continue;
+        if (count < 0) count += 1LL << 32; // the counters are 32-bit words
+        counts[std::make_pair(string(function), (uint32_t) key)] += count;
+    }
+    fclose(in);
+    return true;
+}
+
+int64_t ProfileData::Count(const Profiler::Counter &c) const {
+    std::map<std::pair<string, uint32_t>, int64_t>::const_iterator it =
+        counts.find(std::make_pair(c.function, c.key));
+    return it == counts.end() ? -1 : it->second;
+}
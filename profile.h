@@ -0,0 +1,88 @@
+/* File: profile.h
+ * ---------------
+ * The Profiler instruments the MIPS code for dcc -profile. While the
+ * Tac is being translated it is told about every instruction, before
+ * and after, and adds a counter increment at the entry of each function,
+ * after each label and conditional branch (the start of a basic block)
+ * and before each call. The counters are one array in the data segment.
+ * When the program halts or main returns, a small runtime routine dumps
+ * them to stdout after a newline and a "#dcc-profile" line, one counter
+ * per line:
+ *
+ *     <function label> <kind> <key> <source line> <count>
+ *
+ * kind is e (function entry), b (block after a label), f (fall-through
+ * after a branch) or c (call site). key is a hash of the function, the
+ * kind, the callee and the counter's ordinal among the function's
+ * counters of the same kind and callee. It has no line numbers or
+ * temp names in it, so a profile still matches after small edits to
+ * the source.
+ *
+ * dcc -fprofile-use=file reads such a dump back with ProfileData. A
+ * Profiler made with emit false walks the Tac the same way without
+ * emitting anything, which numbers the counters so the recorded counts
+ * can be matched to the blocks they were taken in.
+ */
+
+#ifndef _H_profile
+#define _H_profile
+
+#include "list.h"
+#include "tac.h"
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Profiler {
+  public:
+    struct Counter {
+        std::string function;
+        char kind;
+        uint32_t key;
+        int line;
+    };
+
+    Profiler(bool emit = true);
+
+    // Called around the translation of code->Nth(i).
+    void Before(List<Instruction *> *code, int i);
+    void After(List<Instruction *> *code, int i);
+
+    // Emits the dump routine and the counter data. Call once after the
+    // program has been translated.
+    void EmitRuntime();
+
+    const std::vector<Counter> &GetCounters() const { return counters; }
+
+    // The block counter After(code, i) added (an index into
+    // GetCounters()), or -1 if it added none.
+    int BlockCounter(int i) const;
+
+  private:
+    bool emit;
+    std::vector<Counter> counters;
+    std::map<int, int> blockCounters;           // instr index -> counter
+    std::string function;                       // label of current fn
+    std::map<std::string, int> ordinals;        // kind+callee -> next
+    const char *lastLabel;
+
+    void AddCounter(char kind, const char *callee, int line);
+    void EmitDumpCall();
+};
+
+class ProfileData {
+  public:
+    // Reads a dump written by a -profile build: the lines after the
+    // last "#dcc-profile" line, or the whole file if there is none.
+    // Returns false if the file can't be opened.
+    bool Read(const char *path);
+
+    // The recorded count for c, or -1 if the profile doesn't have it.
+    int64_t Count(const Profiler::Counter &c) const;
+
+  private:
+    std::map<std::pair<std::string, uint32_t>, int64_t> counts;
+};
+
+#endif
@@ -0,0 +1,141 @@
+/* File: runtime/c.c
+ * -----------------
+ * The built-in routines for programs compiled with -target=c (see
+ * csource.h), the counterparts of the MIPS runtime printed by main.cc.
+ *
+ * Decaf memory is one zeroed arena addressed by 32-bit offsets. It grows
+ * by reallocation, which is fine since the program only ever holds
+ * offsets into it; offset 0 is never handed out so it can stand for null.
+ * Built-ins take their parameters like Decaf functions, as an array.
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+char *decaf_mem;
+uint32_t decaf_top = 8; /* everything below is allocated */
+static uint32_t memSize;
+
+void decaf_start(void);
+
+int32_t decaf_alloc(int32_t bytes)
+{
+  uint32_t size = (bytes + 7) & ~7u;
+  if (decaf_top + size > memSize) {
+    uint32_t grown = memSize ? memSize : 1 << 20;
+    while (decaf_top + size > grown)
+      grown *= 2;
+    decaf_mem = realloc(decaf_mem, grown);
+    if (decaf_mem == NULL) {
+      fprintf(stderr, "Decaf runtime: out of memory\n");
+      exit(1);
+    }
+    memset(decaf_mem + memSize, 0, grown - memSize);
+    memSize = grown;
+  }
+  decaf_top += size;
+  return decaf_top - size;
+}
+
+int32_t decaf_string(const char *s)
+{
+  int32_t p = decaf_alloc(strlen(s) + 1);
+  strcpy(decaf_mem + p, s);
+  return p;
+}
+
+void decaf_fail(const char *message)
+{
+  fputs(message, stdout);
+  exit(0);
+}
+
+/* stops on something the MIPS code would have crashed on, like -run */
+void decaf_fault(const char *message)
+{
+  fflush(stdout);
+  fprintf(stderr, "Decaf runtime error: %s\n", message);
+  exit(1);
+}
+
+int32_t f_PrintInt(int32_t *params)
+{
+  printf("%d", params[0]);
+  return 0;
+}
+
+int32_t f_PrintString(int32_t *params)
+{
+  fputs(decaf_mem + params[0], stdout);
+  return 0;
+}
+
+int32_t f_PrintBool(int32_t *params)
+{
+  fputs(params[0] ? "true" : "false", stdout);
+  return 0;
+}
+
+int32_t f_Alloc(int32_t *params)
+{
+  return decaf_alloc(params[0]);
+}
+
+int32_t f_StringEqual(int32_t *params)
+{
+  return strcmp(decaf_mem + params[0], decaf_mem + params[1]) == 0;
+}
+
+int32_t f_Halt(int32_t *params)
+{
+  exit(0);
+}
+
+/* Like the SPIM read_string syscall, at most 100 characters; the
+ * newline is dropped. */
+int32_t f_ReadLine(int32_t *params)
+{
+  int32_t p = decaf_alloc(101);
+  char *buf = decaf_mem + p;
+  if (fgets(buf, 101, stdin) != NULL && strchr(buf, '\n'))
+    *strchr(buf, '\n') = '\0';
+  return p;
+}
+
+int32_t f_ReadInteger(int32_t *params)
+{
+  char line[256];
+  if (fgets(line, sizeof(line), stdin) == NULL)
+    return 0;
+  return atoi(line);
+}
+
+/* A bad address (null minus a few bytes, or a stack overflow) lands
+ * outside the arena. Report it like -run does rather than die with the
+ * program's output still buffered. */
+static void decaf_segv(int sig, siginfo_t *info, void *context)
+{
+  uint32_t offset = (char *) info->si_addr - decaf_mem;
+  decaf_fault(offset < 8 || offset >= 0u - 8 ? "null dereference" : "bad address");
+}
+
+int main(void)
+{
+  static char altStack[1 << 16];
+  stack_t ss;
+  struct sigaction sa;
+  ss.ss_sp = altStack;
+  ss.ss_size = sizeof(altStack);
+  ss.ss_flags = 0;
+  sigaltstack(&ss, NULL);
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = decaf_segv;
+  sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigaction(SIGSEGV, &sa, NULL);
+
+  decaf_start();
+  return 0;
+}
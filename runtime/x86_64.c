@@ -0,0 +1,138 @@
+/* File: runtime/x86_64.c
+ * ----------------------
+ * The built-in routines for programs compiled with -target=x86-64 (see
+ * x86.h), the counterparts of the MIPS runtime printed by main.cc.
+ *
+ * Decaf code calls _PrintInt and friends with its own convention, 4-byte
+ * parameters on the stack, so each routine has a small assembly entry
+ * that moves them into the System V argument registers, realigns the
+ * stack and calls the C version. Decaf values are 32 bits, so the heap
+ * and every string handed back to Decaf are allocated below 2GB.
+ */
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define DECAF_ENTRY(name, impl)                                         \
+  __asm__(".text\n"                                                     \
+          ".globl " name "\n"                                           \
+          name ":\n"                                                    \
+          "\tpushq %rbp\n"                                              \
+          "\tmovq %rsp, %rbp\n"                                         \
+          "\tandq $-16, %rsp\n"                                         \
+          "\tmovl 16(%rbp), %edi\n"                                     \
+          "\tmovl 20(%rbp), %esi\n"                                     \
+          "\tcall " impl "\n"                                           \
+          "\tleave\n"                                                   \
+          "\tret\n")
+
+DECAF_ENTRY("_PrintInt", "rt_PrintInt");
+DECAF_ENTRY("_PrintString", "rt_PrintString");
+DECAF_ENTRY("_PrintBool", "rt_PrintBool");
+DECAF_ENTRY("_Alloc", "rt_Alloc");
+DECAF_ENTRY("_ReadLine", "rt_ReadLine");
+DECAF_ENTRY("_ReadInteger", "rt_ReadInteger");
+DECAF_ENTRY("_StringEqual", "rt_StringEqual");
+DECAF_ENTRY("_Halt", "rt_Halt");
+DECAF_ENTRY("_Overflow", "rt_Overflow");
+DECAF_ENTRY("_DivideByZero", "rt_DivideByZero");
+
+#define CHUNK (16 << 20)
+
+static char *heap, *heapEnd;
+
+/* Bump allocation out of zeroed chunks mapped in the low 2GB, which is
+ * what the SPIM heap gives us as well. */
+static char *Allocate(int size)
+{
+  size = (size + 7) & ~7;
+  if (heap == NULL || heapEnd - heap < size) {
+    size_t bytes = size > CHUNK ? (size_t) size : CHUNK;
+    heap = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (heap == MAP_FAILED) {
+      fprintf(stderr, "Decaf runtime: out of memory\n");
+      exit(1);
+    }
+    heapEnd = heap + bytes;
+  }
+  heap += size;
+  return heap - size;
+}
+
+static char *String(uint32_t s)
+{
+  return (char *) (uintptr_t) s;
+}
+
+void rt_PrintInt(int n) { printf("%d", n); }
+void rt_PrintString(uint32_t s) { fputs(String(s), stdout); }
+void rt_PrintBool(int b) { fputs(b ? "true" : "false", stdout); }
+uint32_t rt_Alloc(int size) { return (uint32_t) (uintptr_t) Allocate(size); }
+int rt_StringEqual(uint32_t a, uint32_t b) { return strcmp(String(a), String(b)) == 0; }
+void rt_Halt(void) { exit(0); }
+
+/* The generated code jumps to these on something MIPS would trap on,
+ * reported the way dcc -run does. */
+static void Fault(const char *message)
+{
+  fflush(stdout);
+  fprintf(stderr, "Decaf runtime error: %s\n", message);
+  exit(1);
+}
+
+void rt_Overflow(void) { Fault("arithmetic overflow"); }
+void rt_DivideByZero(void) { Fault("division by zero"); }
+
+/* A load or store through null (give or take a field offset or the
+ * array length at -4) hits the first or last page of the 32-bit Decaf
+ * address space, where nothing is ever mapped. */
+static void Segv(int sig, siginfo_t *info, void *context)
+{
+  uint32_t address = (uint32_t) (uintptr_t) info->si_addr;
+  Fault(address < 4096 || address >= -4096u ? "null dereference"
+                                            : "bad address");
+}
+
+/* Like the SPIM read_string syscall, at most 100 characters; the
+ * newline is dropped. */
+uint32_t rt_ReadLine(void)
+{
+  char *buf = Allocate(101);
+  if (fgets(buf, 101, stdin) != NULL && strchr(buf, '\n'))
+    *strchr(buf, '\n') = '\0';
+  return (uint32_t) (uintptr_t) buf;
+}
+
+int rt_ReadInteger(void)
+{
+  char line[256];
+  if (fgets(line, sizeof(line), stdin) == NULL)
+    return 0;
+  return atoi(line);
+}
+
+extern void __decaf_main(void);
+
+int main(void)
+{
+  static char altStack[1 << 16];
+  stack_t ss;
+  struct sigaction sa;
+  ss.ss_sp = altStack;
+  ss.ss_size = sizeof(altStack);
+  ss.ss_flags = 0;
+  sigaltstack(&ss, NULL);
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = Segv;
+  sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigaction(SIGSEGV, &sa, NULL);
+
+  __decaf_main();
+  return 0;
+}
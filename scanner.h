@@ -9,6 +9,7 @@
 #define _H_scanner
 
 #include <stdio.h>
+#include "location.h"
 
 #define MaxIdentLen 31    // Maximum length for identifiers
 
@@ -21,5 +22,7 @@ void yyrestart(FILE *fp); // ditto
 
 void InitScanner();                 // Defined in scanner.l user subroutines
 const char *GetLineNumbered(int n); // ditto
+int GetLineOf(uint32_t offset);     // ditto, line of a source offset
+SourcePos GetSourcePos(const yyltype &loc); // ditto
  
 #endif
@@ -0,0 +1,415 @@
+/* File: sched.cc
+ * --------------
+ * Implementation of the Scheduler class: parsing the assembly text into
+ * instructions with their register and memory effects, building the
+ * dependence graph of a block and list scheduling it.
+ */
+
+#include "sched.h"
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using std::string;
+using std::vector;
+
+
+/* The machine model
+ * -----------------
+ * A single-issue pipeline with interlocks and R3000-class latencies:
+ * a loaded value is ready one cycle late, multiply and divide results
+ * (which the mul/div/rem pseudo-instructions read back from lo) take
+ * 12 and 35 cycles. Everything else is ready for the next instruction.
+ * The form letter says how the operands are used:
+ *   r: rd, rs, rt-or-imm  i: rd, imm  m: rd, rs  l: rd, mem  s: rs, mem
+ *   b: rs, rt, label  z: rs, label  j: label  c: jal  R: jr  C: jalr
+ *   y: syscall  n: nop
+ * Pseudo-instructions that expand to more than one machine instruction
+ * are marked so they are never put in a delay slot.
+ */
+static const struct {
+    const char *name;
+    char form;
+    int latency;
+    bool pseudo;
+} machineModel[] = {
+    {"add", 'r', 1, false},   {"addu", 'r', 1, false},
+    {"sub", 'r', 1, false},   {"subu", 'r', 1, false},
+    {"mul", 'r', 12, true},   {"div", 'r', 35, true},
+    {"rem", 'r', 35, true},   {"and", 'r', 1, false},
+    {"or", 'r', 1, false},    {"xor", 'r', 1, false},
+    {"nor", 'r', 1, false},   {"slt", 'r', 1, false},
+    {"sltu", 'r', 1, false},  {"seq", 'r', 1, true},
+    {"sne", 'r', 1, true},    {"sle", 'r', 1, true},
+    {"sgt", 'r', 1, true},    {"sge", 'r', 1, true},
+    {"sllv", 'r', 1, false},  {"srlv", 'r', 1, false},
+    {"srav", 'r', 1, false},  {"addi", 'r', 1, false},
+    {"addiu", 'r', 1, false}, {"slti", 'r', 1, false},
+    {"sltiu", 'r', 1, false}, {"andi", 'r', 1, false},
+    {"ori", 'r', 1, false},   {"xori", 'r', 1, false},
+    {"sll", 'r', 1, false},   {"srl", 'r', 1, false},
+    {"sra", 'r', 1, false},   {"li", 'i', 1, false},
+    {"lui", 'i', 1, false},   {"la", 'i', 1, true},
+    {"move", 'm', 1, false},  {"neg", 'm', 1, false},
+    {"negu", 'm', 1, false},  {"lw", 'l', 2, false},
+    {"lb", 'l', 2, false},    {"lbu", 'l', 2, false},
+    {"sw", 's', 1, false},    {"sb", 's', 1, false},
+    {"beq", 'b', 1, false},   {"bne", 'b', 1, false},
+    {"beqz", 'z', 1, false},  {"bnez", 'z', 1, false},
+    {"bltz", 'z', 1, false},  {"bgez", 'z', 1, false},
+    {"blez", 'z', 1, false},  {"bgtz", 'z', 1, false},
+    {"b", 'j', 1, false},     {"j", 'j', 1, false},
+    {"jal", 'c', 1, false},   {"jr", 'R', 1, false},
+    {"jalr", 'C', 1, false},  {"syscall", 'y', 1, false},
+    {"nop", 'n', 1, false},
+};
+static const int NumMachineOps = sizeof(machineModel) / sizeof(machineModel[0]);
+
+static const char *const regNames[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"};
+static const int V0 = 2, A0 = 4, A1 = 5, A2 = 6, GP = 28, SP = 29, FP = 30,
+                 RA = 31;
+
+static string Trim(const string &s) {
+    size_t b = s.find_first_not_of(" \t\n");
+    if (b == string::npos)
+        return "";
+    size_t e = s.find_last_not_of(" \t\n");
+    return s.substr(b, e - b + 1);
+}
+
+// register number for $name or $n, -1 if s is not a register
+static int RegNum(const string &s) {
+    if (s.size() < 2 || s[0] != '$')
+        return -1;
+    string name = s.substr(1);
+    if (isdigit(name[0]))
+        return atoi(name.c_str()) & 31;
+    for (int i = 0; i < 32; i++)
+        if (name == regNames[i])
+            return i;
+    return -1;
+}
+
+static uint32_t Mask(int reg) {
+    return reg > 0 ? 1u << reg : 0; // $zero never carries a dependence
+}
+
+static bool FitsImmediate(const string &s) {
+    char *end;
+    long v = strtol(s.c_str(), &end, 0);
+    return *end == '\0' && v >= -32768 && v <= 65535;
+}
+
+
+Scheduler::Scheduler(bool r, bool d) : reorder(r), delaySlots(d) {}
+
+void Scheduler::Add(const char *text) {
+    partial += text;
+    size_t nl;
+    while ((nl = partial.find('\n')) != string::npos) {
+        Line(partial.substr(0, nl + 1));
+        partial.erase(0, nl + 1);
+    }
+}
+
+void Scheduler::Flush() {
+    if (!partial.empty())
+        Line(partial + "\n");
+    partial.clear();
+    EndBlock(NULL);
+    printf("%s", comments.c_str());
+    comments.clear();
+}
+
+/* Method: Parse
+ * -------------
+ * Works out what one line of assembly reads, writes and whether it ends
+ * the block. Comments (everything after a # outside a string) are not
+ * looked at.
+ */
+void Scheduler::Parse(const string &line, Insn &insn) {
+    insn.text = line;
+    insn.isInsn = false;
+    insn.endsBlock = true;
+    insn.hasDelaySlot = insn.singleNative = false;
+    insn.defs = insn.uses = 0;
+    insn.latency = 1;
+    insn.mem = NotMemory;
+    insn.memClass = Heap;
+    insn.base = insn.baseVersion = insn.offset = insn.size = 0;
+
+    bool quoted = false;
+    size_t end = 0;
+    for (; end < line.size() && (quoted || line[end] != '#'); end++)
+        if (line[end] == '"')
+            quoted = !quoted;
+    string code = Trim(line.substr(0, end));
+    if (code.empty() || code[0] == '.' || code.find(':') != string::npos)
+        return; // label or directive
+
+    size_t sp = code.find_first_of(" \t");
+    string mnemonic = code.substr(0, sp);
+    vector<string> args;
+    if (sp != string::npos) {
+        string rest = code.substr(sp);
+        for (size_t start = 0; start <= rest.size();) {
+            size_t comma = rest.find(',', start);
+            if (comma == string::npos)
+                comma = rest.size();
+            args.push_back(Trim(rest.substr(start, comma - start)));
+            start = comma + 1;
+        }
+    }
+    int op = 0;
+    while (op < NumMachineOps && mnemonic != machineModel[op].name)
+        op++;
+    if (op == NumMachineOps)
+        return; // unknown: leave it where it is
+
+    char form = machineModel[op].form;
+    static const char *const minArgs = "r3i2m2l2s2b3z2j1c1R1C1y0n0";
+    const char *f = strchr(minArgs, form);
+    if (f == NULL || (int) args.size() < f[1] - '0')
+        return;
+    insn.isInsn = true;
+    insn.endsBlock = strchr("bzjcRCy", form) != NULL;
+    insn.hasDelaySlot = insn.endsBlock && form != 'y';
+    insn.latency = machineModel[op].latency;
+    insn.singleNative = !machineModel[op].pseudo;
+
+    string memArg;
+    switch (form) {
+    case 'r':
+        insn.defs = Mask(RegNum(args[0]));
+        insn.uses = Mask(RegNum(args[1]));
+        if (RegNum(args[2]) >= 0)
+            insn.uses |= Mask(RegNum(args[2]));
+        else if (!FitsImmediate(args[2]))
+            insn.singleNative = false;
+        break;
+    case 'i':
+        insn.defs = Mask(RegNum(args[0]));
+        if (!FitsImmediate(args[1]))
+            insn.singleNative = false;
+        break;
+    case 'm':
+        insn.defs = Mask(RegNum(args[0]));
+        insn.uses = Mask(RegNum(args[1]));
+        break;
+    case 'l':
+        insn.defs = Mask(RegNum(args[0]));
+        insn.mem = LoadMem;
+        memArg = args[1];
+        break;
+    case 's':
+        insn.uses = Mask(RegNum(args[0]));
+        insn.mem = StoreMem;
+        memArg = args[1];
+        break;
+    case 'b':
+        insn.uses = Mask(RegNum(args[0])) | Mask(RegNum(args[1]));
+        break;
+    case 'z': case 'R':
+        insn.uses = Mask(RegNum(args[0]));
+        break;
+    case 'C':
+        insn.uses = Mask(RegNum(args[0]));
+        insn.defs = Mask(RA);
+        break;
+    case 'c':
+        insn.defs = Mask(RA);
+        break;
+    case 'y':
+        insn.uses = Mask(V0) | Mask(A0) | Mask(A1) | Mask(A2);
+        insn.defs = Mask(V0);
+        break;
+    }
+    if (insn.mem != NotMemory) {
+        insn.size = (mnemonic == "lb" || mnemonic == "lbu" || mnemonic == "sb") ? 1 : 4;
+        size_t open = memArg.find('(');
+        if (open == string::npos) { // a label: a global the assembler expands
+            insn.memClass = Global;
+            insn.base = -1;
+            insn.singleNative = false;
+            return;
+        }
+        insn.base = RegNum(Trim(memArg.substr(open + 1, memArg.find(')') - open - 1)));
+        string off = Trim(memArg.substr(0, open));
+        insn.offset = off.empty() ? 0 : atoi(off.c_str());
+        if (!off.empty() && !FitsImmediate(off))
+            insn.singleNative = false;
+        insn.uses |= Mask(insn.base);
+        if (insn.base == FP || insn.base == SP)
+            insn.memClass = Stack;
+        else if (insn.base == GP)
+            insn.memClass = Global;
+    }
+}
+
+void Scheduler::Line(const string &line) {
+    string code = Trim(line);
+    if (code.empty() || code[0] == '#') {
+        comments += line;
+        return;
+    }
+    Insn insn;
+    Parse(line, insn);
+    insn.comments = comments;
+    comments.clear();
+    if (!insn.endsBlock) {
+        block.push_back(insn);
+        return;
+    }
+    EndBlock(&insn);
+}
+
+/* Method: MayAlias
+ * ----------------
+ * The stack, the globals and the heap never overlap, and two accesses
+ * off the same base register value overlap only if their byte ranges do.
+ * Anything else is assumed to overlap.
+ */
+bool Scheduler::MayAlias(const Insn &a, const Insn &b) {
+    if (a.memClass != b.memClass)
+        return false;
+    if (a.base < 0 || a.base != b.base || a.baseVersion != b.baseVersion)
+        return true;
+    return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+/* Method: Schedule
+ * ----------------
+ * Cycle by cycle list scheduling: of the instructions whose predecessors
+ * have issued and whose operands are ready, issue the one with the
+ * longest latency-weighted path to the end of the block (earliest in the
+ * original order on ties). When nothing is ready the pipeline stalls.
+ */
+vector<int> Scheduler::Schedule(vector<vector<int> > &succs,
+                                vector<vector<int> > &lats) {
+    int n = block.size();
+    vector<int> height(n), preds(n, 0), earliest(n, 0), order;
+    for (int i = n - 1; i >= 0; i--) {
+        height[i] = block[i].latency;
+        for (int k = 0; k < succs[i].size(); k++) {
+            height[i] = std::max(height[i], lats[i][k] + height[succs[i][k]]);
+            preds[succs[i][k]]++;
+        }
+    }
+    vector<bool> done(n, false);
+    for (int cycle = 0; order.size() < n;) {
+        int best = -1, soonest = -1;
+        for (int i = 0; i < n; i++) {
+            if (done[i] || preds[i] > 0)
+                continue;
+            if (earliest[i] <= cycle && (best < 0 || height[i] > height[best]))
+                best = i;
+            if (soonest < 0 || earliest[i] < earliest[soonest])
+                soonest = i;
+        }
+        if (best < 0) {
+            cycle = earliest[soonest]; // stall
+            continue;
+        }
+        done[best] = true;
+        order.push_back(best);
+        for (int k = 0; k < succs[best].size(); k++) {
+            int s = succs[best][k];
+            preds[s]--;
+            earliest[s] = std::max(earliest[s], cycle + lats[best][k]);
+        }
+        cycle++;
+    }
+    return order;
+}
+
+/* Method: EndBlock
+ * ----------------
+ * Builds the dependence graph of the buffered block, schedules it and
+ * prints it followed by the terminator (NULL at the end of the output).
+ * With delay slots on, a branch's slot gets the last instruction of the
+ * block that nothing else depends on, is not a load, and neither feeds
+ * nor is changed by the branch itself; otherwise a nop.
+ */
+void Scheduler::EndBlock(Insn *terminator) {
+    int n = block.size();
+    vector<vector<int> > succs(n), lats(n);
+    int version[32];
+    for (int r = 0; r < 32; r++)
+        version[r] = -1;
+    for (int j = 0; j < n; j++) {
+        Insn &b = block[j];
+        if (b.mem != NotMemory && b.base >= 0)
+            b.baseVersion = version[b.base];
+        for (int i = 0; i < j; i++) {
+            Insn &a = block[i];
+            int lat = -1;
+            if (a.defs & b.uses)
+                lat = a.latency;
+            else if ((a.uses & b.defs) || (a.defs & b.defs))
+                lat = 1;
+            else if ((a.mem == StoreMem || b.mem == StoreMem) &&
+                     a.mem != NotMemory && b.mem != NotMemory && MayAlias(a, b))
+                lat = 1;
+            if (lat >= 0) {
+                succs[i].push_back(j);
+                lats[i].push_back(lat);
+            }
+        }
+        for (int r = 0; r < 32; r++)
+            if (b.defs & Mask(r))
+                version[r] = j;
+    }
+
+    vector<int> order;
+    if (reorder) {
+        order = Schedule(succs, lats);
+    } else {
+        for (int i = 0; i < n; i++)
+            order.push_back(i);
+    }
+
+    int filler = -1;
+    bool slot = delaySlots && terminator && terminator->hasDelaySlot;
+    if (slot) {
+        for (int k = order.size() - 1; k >= 0 && filler < 0; k--) {
+            Insn &c = block[order[k]];
+            if (c.singleNative && c.mem != LoadMem && succs[order[k]].empty() &&
+                !(c.defs & terminator->uses) &&
+                !((c.defs | c.uses) & terminator->defs)) {
+                filler = order[k];
+                order.erase(order.begin() + k);
+            }
+        }
+    }
+
+    for (int k = 0; k < order.size(); k++) {
+        Insn &insn = block[order[k]];
+        printf("%s%s", insn.comments.c_str(), insn.text.c_str());
+        if (!delaySlots || insn.mem != LoadMem)
+            continue;
+        // a delayed load's result is not there for the next instruction
+        bool used;
+        if (k + 1 < order.size())
+            used = block[order[k + 1]].uses & insn.defs;
+        else
+            used = !terminator || !terminator->isInsn || (terminator->uses & insn.defs);
+        if (used)
+            printf("\t  nop\t\t# load delay slot\n");
+    }
+    if (filler >= 0)
+        printf("%s", block[filler].comments.c_str());
+    if (terminator) {
+        printf("%s%s", terminator->comments.c_str(), terminator->text.c_str());
+        if (slot && filler >= 0)
+            printf("%s", block[filler].text.c_str());
+        else if (slot)
+            printf("\t  nop\t\t# branch delay slot\n");
+    }
+    block.clear();
+}
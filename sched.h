@@ -0,0 +1,66 @@
+/* File: sched.h
+ * -------------
+ * The Scheduler reorders the final MIPS assembly within each basic block
+ * so that a pipelined machine stalls less. When it is installed (see
+ * Mips::SetScheduler), everything printed through Mips::Output is
+ * buffered until the end of the block (a label, directive, branch, jump,
+ * call or syscall), then a list scheduler picks the issue order using
+ * the latencies of the machine model in sched.cc. Loads and multiplies
+ * get their consumers moved away from them, critical path first.
+ *
+ * With delay slots on, the output is also made correct for a machine
+ * with delayed branches and delayed loads (spim -delayed_branches
+ * -delayed_loads): the slot after each branch or jump is filled with an
+ * independent instruction from the block when there is one, and a nop
+ * separates a load from an immediate use of its result.
+ */
+
+#ifndef _H_sched
+#define _H_sched
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class Scheduler {
+  public:
+    // reorder turns list scheduling on, delaySlots the delayed branch
+    // and load handling.
+    Scheduler(bool reorder, bool delaySlots);
+
+    // Takes any amount of assembly text, as printed by Mips::Output.
+    void Add(const char *text);
+
+    // Writes out whatever is still buffered.
+    void Flush();
+
+  private:
+    typedef enum { NotMemory, LoadMem, StoreMem } MemAccess;
+    typedef enum { Stack, Global, Heap } MemClass;
+
+    struct Insn {
+        std::string comments; // comment lines that preceded it
+        std::string text;     // the line itself
+        bool isInsn;          // false for labels, directives, unknown text
+        bool endsBlock, hasDelaySlot, singleNative;
+        uint32_t defs, uses;  // register masks
+        int latency;
+        MemAccess mem;
+        MemClass memClass;
+        int base, baseVersion, offset, size;
+    };
+
+    bool reorder, delaySlots;
+    std::string partial;  // unfinished line
+    std::string comments; // comment lines waiting for the next instruction
+    std::vector<Insn> block;
+
+    void Line(const std::string &line);
+    void Parse(const std::string &line, Insn &insn);
+    void EndBlock(Insn *terminator);
+    std::vector<int> Schedule(std::vector<std::vector<int> > &succs,
+                              std::vector<std::vector<int> > &lats);
+    bool MayAlias(const Insn &a, const Insn &b);
+};
+
+#endif
@@ -5,12 +5,11 @@
 /* StackNode* StackNode::namedTypeTable = new StackNode(NULL); */
 
 Decl *StackNode::GetSymbol(const char *symbol) {
-    StackNode *tmp = this;
-    Decl *rv = tmp->symbols->Lookup(symbol);
-    if (rv != NULL)
-        return rv;
-    if (parent)
-        return parent->GetSymbol(symbol);
+    for (StackNode *tmp = this; tmp; tmp = tmp->parent) {
+        Decl *rv = tmp->LookupHere(symbol);
+        if (rv != NULL)
+            return rv;
+    }
     return NULL;
 }
 
@@ -24,12 +23,8 @@ Decl *StackNode::AddSymbol(const char *symbol, Decl *decl) {
     return NULL;
 }
 
-Decl *ClassStackNode::GetSymbol(const char *symbol) {
-    Decl *rv = classDecl->GetFields(symbol);
-    if (rv)
-        return rv;
-    Assert(parent != NULL);
-    return parent->GetSymbol(symbol);
+Decl *ClassStackNode::LookupHere(const char *symbol) {
+    return classDecl->GetFields(symbol);
 }
 
 StackNode* StackNode::root = NULL;
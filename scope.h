@@ -18,7 +18,12 @@ public:
         symbols = new Hashtable<Decl *>();
     }
 
-    virtual Decl *GetSymbol(const char *symbol);
+    // Looks symbol up here and then in the enclosing scopes.
+    Decl *GetSymbol(const char *symbol);
+    // Looks symbol up in this scope only.
+    virtual Decl *LookupHere(const char *symbol) {
+        return symbols->Lookup(symbol);
+    }
 
     Decl *AddSymbol(const char *symbol, Decl *decl);
 
@@ -38,7 +43,8 @@ public:
         Assert(classDecl != NULL);
     }
 
-    Decl *GetSymbol(const char *symbol);
+    // the class's own and inherited members
+    Decl *LookupHere(const char *symbol);
 };
 
 class Context{
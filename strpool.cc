@@ -0,0 +1,23 @@
+/* File: strpool.cc
+ * ----------------
+ * Implementation of the StringPool class.
+ */
+
+#include "strpool.h"
+#include <stdio.h>
+#include <string.h>
+
+StringPool::StringPool() : next(1) {}
+
+const char *StringPool::Label(const char *str)
+{
+  const char *label = labels.Lookup(str);
+  if (label == NULL) {
+    char buf[16];
+    sprintf(buf, "_string%d", next++);
+    label = strdup(buf);
+    labels.Enter(str, label);
+    strings.Append(str);
+  }
+  return label;
+}
@@ -0,0 +1,33 @@
+/* File: strpool.h
+ * ---------------
+ * The StringPool is the program-wide pool of string literals a backend
+ * lays out in its data once, rather than at each use. The literals are
+ * keyed by their quoted text, so identical ones share a label, and are
+ * listed in first-use order. Mips, X86 and CSource each keep one.
+ */
+
+#ifndef _H_strpool
+#define _H_strpool
+
+#include "hashtable.h"
+#include "list.h"
+
+class StringPool {
+  public:
+    StringPool();
+
+    // Returns the label of the (quoted, interned) literal str, giving
+    // it a new unique one the first time it is seen.
+    const char *Label(const char *str);
+
+    int NumStrings() { return strings.NumElements(); }
+    const char *Nth(int i) { return strings.Nth(i); } // quoted literal
+    const char *NthLabel(int i) { return labels.Lookup(strings.Nth(i)); }
+
+  private:
+    Hashtable<const char *> labels;
+    List<const char *> strings;
+    int next;
+};
+
+#endif
@@ -5,11 +5,12 @@
   
 #include "tac.h"
 #include "mips.h"
+#include "intern.h"
 #include <string.h>
 #include <deque>
 
 Location::Location(Segment s, int o, const char *name) :
-  variableName(strdup(name)), segment(s), offset(o){}
+  variableName(Intern(name)), segment(s), offset(o){}
 
  
 void Instruction::Print() {
@@ -18,11 +19,21 @@ void Instruction::Print() {
 }
 
 void Instruction::Emit(Mips *mips) {
+  Mips::SourceLine(line);
   if (*printed)
     mips->Emit("# %s", printed);   // emit TAC as comment into assembly
   EmitSpecific(mips);
 }
 
+int Instruction::Operands(Location *ops[3], Location *a, Location *b,
+			  Location *c) {
+  int n = 0;
+  if (a) ops[n++] = a;
+  if (b) ops[n++] = b;
+  if (c) ops[n++] = c;
+  return n;
+}
+
 LoadConstant::LoadConstant(Location *d, int v)
   : dst(d), val(v) {
   Assert(dst != NULL);
@@ -36,8 +47,10 @@ LoadStringConstant::LoadStringConstant(Location *d, const char *s)
   : dst(d) {
   Assert(dst != NULL && s != NULL);
   const char *quote = (*s == '"') ? "" : "\"";
-  str = new char[strlen(s) + 2*strlen(quote) + 1];
-  sprintf(str, "%s%s%s", quote, s, quote);
+  char *quoted = new char[strlen(s) + 2*strlen(quote) + 1];
+  sprintf(quoted, "%s%s%s", quote, s, quote);
+  str = Intern(quoted);
+  delete[] quoted;
   quote = (strlen(str) > 50) ? "...\"" : "";
   sprintf(printed, "%s = %.50s%s", dst->GetName(), str, quote);
 }
@@ -48,7 +61,7 @@ void LoadStringConstant::EmitSpecific(Mips *mips) {
      
 
 LoadLabel::LoadLabel(Location *d, const char *l)
-  : dst(d), label(strdup(l)) {
+  : dst(d), label(Intern(l)) {
   Assert(dst != NULL && label != NULL);
   sprintf(printed, "%s = %s", dst->GetName(), label);
 }
@@ -107,18 +120,27 @@ BinaryOp::OpCode BinaryOp::OpCodeForName(const char *name) {
 }
 
 BinaryOp::BinaryOp(OpCode c, Location *d, Location *o1, Location *o2)
-  : code(c), dst(d), op1(o1), op2(o2) {
+  : code(c), dst(d), op1(o1), op2(o2), imm(0) {
   Assert(dst != NULL && op1 != NULL && op2 != NULL);
   Assert(code >= 0 && code < NumOps);
   sprintf(printed, "%s = %s %s %s", dst->GetName(), op1->GetName(), opName[code], op2->GetName());
 }
+BinaryOp::BinaryOp(OpCode c, Location *d, Location *o1, int i)
+  : code(c), dst(d), op1(o1), op2(NULL), imm(i) {
+  Assert(dst != NULL && op1 != NULL);
+  Assert(code >= 0 && code < NumOps);
+  sprintf(printed, "%s = %s %s %d", dst->GetName(), op1->GetName(), opName[code], imm);
+}
 void BinaryOp::EmitSpecific(Mips *mips) {	  
-  mips->EmitBinaryOp(code, dst, op1, op2);
+  if (op2)
+    mips->EmitBinaryOp(code, dst, op1, op2);
+  else
+    mips->EmitBinaryOpImm(code, dst, op1, imm);
 }
 
 
 
-Label::Label(const char *l) : label(strdup(l)) {
+Label::Label(const char *l) : label(Intern(l)) {
   Assert(label != NULL);
   *printed = '\0';
 }
@@ -131,7 +153,7 @@ void Label::EmitSpecific(Mips *mips) {
 
 
  
-Goto::Goto(const char *l) : label(strdup(l)) {
+Goto::Goto(const char *l) : label(Intern(l)) {
   Assert(label != NULL);
   sprintf(printed, "Goto %s", label);
 }
@@ -141,7 +163,7 @@ void Goto::EmitSpecific(Mips *mips) {
 
 
 IfZ::IfZ(Location *te, const char *l)
-   : test(te), label(strdup(l)) {
+   : test(te), label(Intern(l)) {
   Assert(test != NULL && label != NULL);
   sprintf(printed, "IfZ %s Goto %s", test->GetName(), label);
 }
@@ -151,6 +173,17 @@ void IfZ::EmitSpecific(Mips *mips) {
 
 
 
+IfNZ::IfNZ(Location *te, const char *l)
+   : test(te), label(Intern(l)) {
+  Assert(test != NULL && label != NULL);
+  sprintf(printed, "IfNZ %s Goto %s", test->GetName(), label);
+}
+void IfNZ::EmitSpecific(Mips *mips) {
+  mips->EmitIfNZ(test, label);
+}
+
+
+
 BeginFunc::BeginFunc() {
   sprintf(printed,"BeginFunc (unassigned)");
   frameSize = -555; // used as sentinel to recognized unassigned value
@@ -204,7 +237,7 @@ void PopParams::EmitSpecific(Mips *mips) {
 
 
 LCall::LCall(const char *l, Location *d)
-  :  label(strdup(l)), dst(d) {
+  :  label(Intern(l)), dst(d) {
   sprintf(printed, "%s%sLCall %s", dst? dst->GetName(): "", dst?" = ":"", label);
 }
 void LCall::EmitSpecific(Mips *mips) {
@@ -225,7 +258,7 @@ void ACall::EmitSpecific(Mips *mips) {
 
 
 VTable::VTable(const char *l, List<const char *> *m)
-  : methodLabels(m), label(strdup(l)) {
+  : methodLabels(m), label(Intern(l)) {
   Assert(methodLabels != NULL && label != NULL);
   sprintf(printed, "VTable for class %s", l);
 }
@@ -241,3 +274,17 @@ void VTable::EmitSpecific(Mips *mips) {
 }
 
 
+ErrorStub::ErrorStub(const char *l, const char *m)
+  : label(Intern(l)), message(strdup(m)) {
+  Assert(label != NULL && message != NULL);
+  sprintf(printed, "ErrorStub %s", label);
+}
+
+void ErrorStub::Print() {
+  printf("%s:\n", label);
+  printf("\tPrintString \"%.50s\" ;\n", message);
+  printf("\tHalt ;\n");
+}
+void ErrorStub::EmitSpecific(Mips *mips) {
+  mips->EmitErrorStub(label, message);
+}
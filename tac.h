@@ -23,6 +23,7 @@
 #ifndef _H_tac
 #define _H_tac
 
+#include "arena.h"
 #include "list.h" // for VTable
 class Mips;
 
@@ -47,6 +48,11 @@ class Location
   public:
     Location(Segment seg, int offset, const char *name);
 
+    // Locations and Instructions live in Arena::ir until the final code
+    // generation is done
+    static void *operator new(size_t size) { return Arena::ir.Alloc(size); }
+    static void operator delete(void *) {}
+
     const char *GetName()           { return variableName; }
     Segment GetSegment()            { return segment; }
     int GetOffset()                 { return offset; }
@@ -60,11 +66,26 @@ class Location
 class Instruction {
     protected:
         char printed[128];
+        int line;         // source line it was generated for, 0 if none
 	  
     public:
+	Instruction() : line(0) {}
+	static void *operator new(size_t size) { return Arena::ir.Alloc(size); }
+	static void operator delete(void *) {}
 	virtual void Print();
 	virtual void EmitSpecific(Mips *mips) = 0;
 	virtual void Emit(Mips *mips);
+	const char *GetPrinted()        { return printed; }
+	int GetLine()                   { return line; }
+	void SetLine(int l)             { line = l; }
+
+	// Fills ops with the variables the instruction reads or writes
+	// (at most 3) and returns how many there are
+	virtual int GetOperands(Location *ops[3]) { return 0; }
+
+    protected:
+	static int Operands(Location *ops[3], Location *a,
+			    Location *b = NULL, Location *c = NULL);
 };
 
   
@@ -82,6 +103,7 @@ class Instruction {
   class Label;
   class Goto;
   class IfZ;
+  class IfNZ;
   class BeginFunc;
   class EndFunc;
   class Return;
@@ -90,6 +112,7 @@ class Instruction {
   class LCall;
   class ACall;
   class VTable;
+  class ErrorStub;
 
 
 
@@ -100,14 +123,20 @@ class LoadConstant: public Instruction {
   public:
     LoadConstant(Location *dst, int val);
     void EmitSpecific(Mips *mips);
+    Location *GetDst()              { return dst; }
+    int GetValue()                  { return val; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst); }
 };
 
 class LoadStringConstant: public Instruction {
     Location *dst;
-    char *str;
+    const char *str;  // quoted and interned
   public:
     LoadStringConstant(Location *dst, const char *s);
     void EmitSpecific(Mips *mips);
+    Location *GetDst()              { return dst; }
+    const char *GetString()         { return str; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst); }
 };
     
 class LoadLabel: public Instruction {
@@ -116,6 +145,9 @@ class LoadLabel: public Instruction {
   public:
     LoadLabel(Location *dst, const char *label);
     void EmitSpecific(Mips *mips);
+    Location *GetDst()              { return dst; }
+    const char *GetLabel()          { return label; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst); }
 };
 
 class Assign: public Instruction {
@@ -123,6 +155,9 @@ class Assign: public Instruction {
   public:
     Assign(Location *dst, Location *src);
     void EmitSpecific(Mips *mips);
+    Location *GetDst()              { return dst; }
+    Location *GetSrc()              { return src; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst, src); }
 };
 
 class Load: public Instruction {
@@ -131,6 +166,10 @@ class Load: public Instruction {
   public:
     Load(Location *dst, Location *src, int offset = 0);
     void EmitSpecific(Mips *mips);
+    Location *GetDst()              { return dst; }
+    Location *GetSrc()              { return src; }
+    int GetOffset()                 { return offset; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst, src); }
 };
 
 class Store: public Instruction {
@@ -139,6 +178,10 @@ class Store: public Instruction {
   public:
     Store(Location *d, Location *s, int offset = 0);
     void EmitSpecific(Mips *mips);
+    Location *GetDst()              { return dst; }
+    Location *GetSrc()              { return src; }
+    int GetOffset()                 { return offset; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst, src); }
 };
 
 class BinaryOp: public Instruction {
@@ -151,9 +194,17 @@ class BinaryOp: public Instruction {
   protected:
     OpCode code;
     Location *dst, *op1, *op2;
+    int imm; // right operand when op2 is NULL
   public:
     BinaryOp(OpCode c, Location *dst, Location *op1, Location *op2);
+    BinaryOp(OpCode c, Location *dst, Location *op1, int imm);
     void EmitSpecific(Mips *mips);
+    OpCode GetCode()                { return code; }
+    Location *GetDst()              { return dst; }
+    Location *GetOp1()              { return op1; }
+    Location *GetOp2()              { return op2; } // NULL if immediate
+    int GetImm()                    { return imm; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst, op1, op2); }
 };
 
 class Label: public Instruction {
@@ -162,6 +213,7 @@ class Label: public Instruction {
     Label(const char *label);
     void Print();
     void EmitSpecific(Mips *mips);
+    const char *GetLabel()          { return label; }
 };
 
 class Goto: public Instruction {
@@ -169,6 +221,7 @@ class Goto: public Instruction {
   public:
     Goto(const char *label);
     void EmitSpecific(Mips *mips);
+    const char *GetLabel()          { return label; }
 };
 
 class IfZ: public Instruction {
@@ -177,6 +230,20 @@ class IfZ: public Instruction {
   public:
     IfZ(Location *test, const char *label);
     void EmitSpecific(Mips *mips);
+    Location *GetTest()             { return test; }
+    const char *GetLabel()          { return label; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, test); }
+};
+
+class IfNZ: public Instruction {
+    Location *test;
+    const char *label;
+  public:
+    IfNZ(Location *test, const char *label);
+    void EmitSpecific(Mips *mips);
+    Location *GetTest()             { return test; }
+    const char *GetLabel()          { return label; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, test); }
 };
 
 class BeginFunc: public Instruction {
@@ -186,6 +253,7 @@ class BeginFunc: public Instruction {
     // used to backpatch the instruction with frame size once known
     void SetFrameSize(int numBytesForAllLocalsAndTemps);
     void EmitSpecific(Mips *mips);
+    int GetFrameSize()              { return frameSize; }
 };
 
 class EndFunc: public Instruction {
@@ -199,6 +267,8 @@ class Return: public Instruction {
   public:
     Return(Location *val);
     void EmitSpecific(Mips *mips);
+    Location *GetValue()            { return val; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, val); }
 };   
 
 class PushParam: public Instruction {
@@ -206,6 +276,8 @@ class PushParam: public Instruction {
   public:
     PushParam(Location *param);
     void EmitSpecific(Mips *mips);
+    Location *GetParam()            { return param; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, param); }
 }; 
 
 class PopParams: public Instruction {
@@ -213,6 +285,7 @@ class PopParams: public Instruction {
   public:
     PopParams(int numBytesOfParamsToRemove);
     void EmitSpecific(Mips *mips);
+    int GetNumBytes()               { return numBytes; }
 }; 
 
 class LCall: public Instruction {
@@ -221,6 +294,9 @@ class LCall: public Instruction {
   public:
     LCall(const char *labe, Location *result);
     void EmitSpecific(Mips *mips);
+    const char *GetLabel()          { return label; }
+    Location *GetDst()              { return dst; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst); }
 };
 
 class ACall: public Instruction {
@@ -228,6 +304,9 @@ class ACall: public Instruction {
   public:
     ACall(Location *meth, Location *result);
     void EmitSpecific(Mips *mips);
+    Location *GetMethodAddr()       { return methodAddr; }
+    Location *GetDst()              { return dst; }
+    int GetOperands(Location *ops[3]) { return Operands(ops, dst, methodAddr); }
 };
 
 class VTable: public Instruction {
@@ -237,6 +316,21 @@ class VTable: public Instruction {
     VTable(const char *labelForTable, List<const char *> *methodLabels);
     void Print();
     void EmitSpecific(Mips *mips);
+    const char *GetLabel()          { return label; }
+    List<const char *> *GetMethodLabels() { return methodLabels; }
+};
+
+  // Shared out-of-line target for a runtime check: prints the message
+  // and halts. Check sites reach it with a single IfNZ.
+class ErrorStub: public Instruction {
+    const char *label;
+    const char *message;
+ public:
+    ErrorStub(const char *label, const char *message);
+    void Print();
+    void EmitSpecific(Mips *mips);
+    const char *GetLabel()          { return label; }
+    const char *GetMessage()        { return message; }
 };
 
 
@@ -19,6 +19,7 @@ then
 exit 0
 fi
 
+mkdir -p out
 
 echo @@testing on samples/\*
 for i in $(ls samples/*.decaf | grep -v 't5\|badlink\|black\|fib\|sort'); do
@@ -28,7 +29,7 @@ for i in $(ls samples/*.decaf | grep -v 't5\|badlink\|black\|fib\|sort'); do
     # ./solution/dcccaenupdate < $i 2> samples/$f.out
     ./dcc < $i > out/$f.my.s
     # spim -f out/$f.my.s < samples/$f.in | tail -n +6 > out/$f.my.out
-    spim -f out/$f.my.s | tail -n +6 > out/$f.my.out
+    ./dsim out/$f.my.s > out/$f.my.out
     cat samples/$f.out | tail -n +2 > out/$f.cor.out
     diff -w out/$f.my.out out/$f.cor.out
 done
@@ -40,24 +41,97 @@ for i in $(ls samples/*.decaf | grep 't5\|black\|fib\|sort'); do
     # ./solution/dcccaenupdate < $i 2> samples/$f.out
     ./dcc < $i > out/$f.my.s
     # spim -f out/$f.my.s < samples/$f.in | tail -n +6 > out/$f.my.out
-    spim -f out/$f.my.s < samples/$f.in | tail -n +6 > out/$f.my.out
+    ./dsim out/$f.my.s < samples/$f.in > out/$f.my.out
     cat samples/$f.out | tail -n +2 > out/$f.cor.out
     diff -w out/$f.my.out out/$f.cor.out
 done
 
 
+# Each tests/$f.decaf is checked against tests/$f.out: the program's
+# output followed by its exit status and error report, or dcc's errors
+# for a program it rejects. A program that compiles is then
+# run through every optimization and backend, which must all print and
+# end the same way. tests/$f.in, if there, is its input.
+host=$(uname -m)
+
+# compile <flags>: dcc tests/$f.decaf into out/$f.my.s
+compile() {
+    ./dcc "$@" < tests/$f.decaf > out/$f.my.s 2> /dev/null
+}
+
+# ended <status>: append the exit status and any error report to
+# out/$f.my.out, on a line of their own. dsim's prefix and the detail
+# in parentheses are dropped so every mode words its faults the same.
+ended() {
+    [ -n "$(tail -c 1 out/$f.my.out)" ] && echo >> out/$f.my.out
+    echo "--- exit $1" >> out/$f.my.out
+    sed -e 's/^dsim: runtime error: /Decaf runtime error: /' \
+        -e 's/ (.*)$//' out/$f.my.err >> out/$f.my.out
+}
+
+# execute <program...>: run it on the test's input, recording its
+# output and how it ended in out/$f.my.out
+execute() {
+    { "$@" < $in > out/$f.my.out 2> out/$f.my.err; } 2> /dev/null
+    ended $?
+}
+
+# check <mode>: diff out/$f.my.out against tests/$f.out
+check() {
+    diff -w out/$f.my.out tests/$f.out > /dev/null ||
+        { echo "@@@ $f ($1) @@@"; diff -w out/$f.my.out tests/$f.out; }
+    rm -f out/$f.my.out
+}
+
+# mips <flags>: compile, then run in dsim ($SIMFLAGS for dsim)
+mips() {
+    compile "$@" && execute ./dsim $SIMFLAGS out/$f.my.s
+    check "$*"
+}
+
+# interp <flag>: run with -run or -jit
+interp() {
+    ./dcc $1 -input=$in < tests/$f.decaf > out/$f.my.out 2> out/$f.my.err
+    ended $?
+    check $1
+}
+
 echo @@testing on tests/\*
 for i in $(ls tests/*.decaf); do
-    echo @@@ $i @@@
     y=${i%.decaf}
     f=${y##*/}
-    # ./solution/dcccaenupdate < $i 2> samples/$f.out
-    ./dcc < $i > out/$f.my.s
-    ./solution/dcc-caen < $i > out/$f.cor.s
-    # spim -f out/$f.my.s < samples/$f.in | tail -n +6 > out/$f.my.out
-    # spim -f out/$f.my.s < samples/$f.in | tail -n +6 > out/$f.my.out
-    # cat samples/$f.out | tail -n +2 > out/$f.cor.out
-    diff -w out/$f.my.s out/$f.cor.s
+    in=/dev/null
+    [ -f tests/$f.in ] && in=tests/$f.in
+    if ! ./dcc < $i > out/$f.my.s 2> out/$f.my.err || [ -s out/$f.my.err ]; then
+        cp out/$f.my.err out/$f.my.out
+        check errors
+        continue
+    fi
+    execute ./dsim out/$f.my.s
+    check mips
+
+    mips -O
+    mips -unroll=4
+    mips -O -unroll=4
+    SIMFLAGS=-delayed mips -O -delay-slots
+
+    compile -profile && ./dsim out/$f.my.s < $in > out/$f.prof 2> /dev/null
+    mips -O -fprofile-use=out/$f.prof
+
+    interp -run
+
+    compile -target=c && mv out/$f.my.s out/$f.my.c &&
+        cc -w -O2 -o out/$f.my out/$f.my.c runtime/c.c &&
+        execute ./out/$f.my
+    check -target=c
+
+    [ "$host" = x86_64 ] || continue
+    interp -jit
+
+    compile -target=x86-64 &&
+        cc -no-pie -o out/$f.my out/$f.my.s runtime/x86_64.c &&
+        execute ./out/$f.my
+    check -target=x86-64
 done
 # for i in $(ls samples/*.decaf | grep 'badlink\'); do
 #     echo @@@ $i @@@
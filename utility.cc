@@ -10,6 +10,7 @@
 #include <string.h>
 
 static List<const char *> debugKeys;
+static List<const char *> options;
 static const int BufferSize = 2048;
 
 void Failure(const char *format, ...) {
@@ -57,23 +58,54 @@ void PrintDebug(const char *key, const char *format, ...) {
            buf[strlen(buf) - 1] != '\n' ? "\n" : "");
 }
 
-void ParseCommandLine(int argc, char *argv[]) {
-    if (argc == 1)
-        return;
-
-    if (strcmp(argv[1], "-d") != 0) { // first arg is not -d
-        printf("Usage:   -d <debug-key-1> <debug-key-2> ... \n");
-        exit(2);
+// looks up -name or -name=value, returns the matching entry or NULL
+static const char *FindOption(const char *name) {
+    int len = strlen(name);
+    for (int i = 0; i < options.NumElements(); i++) {
+        const char *opt = options.Nth(i);
+        if (!strncmp(opt, name, len) && (opt[len] == '\0' || opt[len] == '='))
+            return opt;
     }
+    return NULL;
+}
 
-    for (int i = 2; i < argc; i++)
-        SetDebugForKey(argv[i], true);
+bool IsOptionOn(const char *name) {
+    return FindOption(name) != NULL;
+}
+
+const char *GetOptionValue(const char *name) {
+    const char *opt = FindOption(name);
+    if (opt == NULL || opt[strlen(name)] != '=')
+        return NULL;
+    return opt + strlen(name) + 1;
 }
 
-bool isErrorTypeName(const char *tocheck) {
-    return strstr(tocheck, "#error") != NULL;
+static const char *targets[] = {"mips", "x86-64", "c"};
+static const int NumTargets = sizeof(targets) / sizeof(targets[0]);
+
+bool IsTarget(const char *name) {
+    const char *target = GetOptionValue("target");
+    return strcmp(target ? target : targets[0], name) == 0;
+}
+
+static void Usage() {
+    printf("Usage:   [-O] [-unroll=N] [-delay-slots] [-profile] [-fprofile-use=file] [-target=mips|x86-64|c] [-run|-jit [-input=file]] [-d <debug-key-1> <debug-key-2> ...] \n");
+    exit(2);
 }
 
-bool isArrayTypeName(const char *tocheck) {
-    return strstr(tocheck, "[]") != NULL;
+void ParseCommandLine(int argc, char *argv[]) {
+    int i = 1;
+    for (; i < argc && strcmp(argv[i], "-d") != 0; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0')
+            Usage();
+        options.Append(argv[i] + 1);
+    }
+    int t = 0;
+    while (t < NumTargets && !IsTarget(targets[t]))
+        t++;
+    if (t == NumTargets)
+        Usage();
+
+    for (i++; i < argc; i++)
+        SetDebugForKey(argv[i], true);
 }
@@ -65,16 +65,36 @@ void SetDebugForKey(const char *key, bool val);
  */
 bool IsDebugOn(const char *key);
 
+/* Function: IsOptionOn()
+ * Usage: if (IsOptionOn("O")) ...
+ * -------------------------------
+ * Return true/false based on whether the option was given on the
+ * command line (as -O, or -name=value for options that take a value).
+ */
+bool IsOptionOn(const char *name);
+
+/* Function: GetOptionValue()
+ * Usage: const char *file = GetOptionValue("fprofile-use");
+ * ---------------------------------------------------------
+ * Return the value of an option given as -name=value, or NULL if the
+ * option was not given or has no value.
+ */
+const char *GetOptionValue(const char *name);
+
+/* Function: IsTarget()
+ * Usage: if (IsTarget("x86-64")) ...
+ * ----------------------------------
+ * Return true/false based on whether this is the machine we generate
+ * code for, as chosen with -target=name (mips when not given).
+ */
+bool IsTarget(const char *name);
+
 /* Function: ParseCommandLine
  * --------------------------
- * Turn on the debugging flags from the command line.  Verifies that
- * first argument is -d, and then interpret all the arguments that follow
- * as being flags to turn on.
+ * Record the options and turn on the debugging flags from the command
+ * line. Options (-O and the like) come first, then optionally -d and
+ * all the arguments that follow it are interpreted as debug flags.
  */
 void ParseCommandLine(int argc, char *argv[]);
 
-bool isErrorTypeName(const char *tocheck);
-
-bool isArrayTypeName(const char *tocheck);
-
 #endif
@@ -0,0 +1,343 @@
+/* File: x86.cc
+ * ------------
+ * Implementation of the X86 class, the x86-64 counterpart of Mips.
+ *
+ * The frame mirrors the MIPS one so Tac offsets carry over unchanged:
+ * the caller pushes 4-byte parameters and calls, the callee pushes %rbp
+ * and points %rbp at it. The 8-byte return address and saved %rbp sit
+ * where MIPS keeps $ra and $fp, so parameters (positive fp offsets) are
+ * 12 bytes further from %rbp than from $fp and locals (negative offsets)
+ * 4 bytes closer.
+ */
+
+#include "x86.h"
+#include <stdarg.h>
+#include <string.h>
+
+X86::X86() {
+  globalBytes = 0;
+}
+
+
+/* Method: Emit
+ * ------------
+ * Same tidy formatting as Mips::Emit: labels flush left, everything
+ * else indented.
+ */
+void X86::Emit(const char *fmt, ...)
+{
+  va_list args;
+  char buf[1024];
+
+  va_start(args, fmt);
+  vsprintf(buf, fmt, args);
+  va_end(args);
+  if (buf[strlen(buf) - 1] != ':') printf("\t");
+  if (buf[0] != '#') printf("  ");
+  printf("%s", buf);
+  if (buf[strlen(buf) - 1] != '\n') printf("\n");
+}
+
+
+/* Method: StringLabel
+ * -------------------
+ * Returns the data label for a (quoted) string literal from the
+ * shared StringPool, like Mips::StringLabel.
+ */
+const char *X86::StringLabel(const char *str)
+{
+  return strings.Label(str);
+}
+
+
+/* Method: Symbol
+ * --------------
+ * Decaf's main is called by the C runtime's main, so it gets a name no
+ * Decaf label can have (those are main or start with a single _).
+ */
+const char *X86::Symbol(const char *label)
+{
+  return strcmp(label, "main") == 0 ? "__decaf_main" : label;
+}
+
+
+/* Method: Address
+ * ---------------
+ * Returns the operand text for a variable's slot, fp-relative locals
+ * and parameters off %rbp, globals in the __decaf_globals block. The
+ * result is good until a few more calls.
+ */
+const char *X86::Address(Location *var)
+{
+  static char bufs[4][64];
+  static int next = 0;
+  char *buf = bufs[next++ % 4];
+  int offset = var->GetOffset();
+  if (var->GetSegment() == gpRelative)
+    sprintf(buf, "__decaf_globals+%d(%%rip)", offset);
+  else
+    sprintf(buf, "%d(%%rbp)", offset > 0 ? offset + 12 : offset + 4);
+  return buf;
+}
+
+void X86::NoteGlobal(Location *var)
+{
+  if (var->GetSegment() == gpRelative && var->GetOffset() + 4 > globalBytes)
+    globalBytes = var->GetOffset() + 4;
+}
+
+
+void X86::EmitLoadConstant(Location *dst, int val)
+{
+  Emit("movl $%d, %s\t# load constant value %d", val, Address(dst), val);
+}
+
+void X86::EmitLoadLabel(Location *dst, const char *label)
+{
+  Emit("leaq %s(%%rip), %%rax\t# load label", Symbol(label));
+  Emit("movl %%eax, %s", Address(dst));
+}
+
+void X86::EmitCopy(Location *dst, Location *src)
+{
+  Emit("movl %s, %%eax", Address(src));
+  Emit("movl %%eax, %s", Address(dst));
+}
+
+void X86::EmitLoad(Location *dst, Location *reference, int offset)
+{
+  Emit("movl %s, %%eax", Address(reference));
+  Emit("movl %d(%%rax), %%eax\t# load with offset", offset);
+  Emit("movl %%eax, %s", Address(dst));
+}
+
+void X86::EmitStore(Location *reference, Location *value, int offset)
+{
+  Emit("movl %s, %%ecx", Address(value));
+  Emit("movl %s, %%eax", Address(reference));
+  Emit("movl %%ecx, %d(%%rax)\t# store with offset", offset);
+}
+
+
+/* Method: EmitBinaryOp
+ * --------------------
+ * op1 is loaded into %eax and op2 (when it is not an immediate) into
+ * %ecx. Division goes through %edx:%eax; comparisons set %al.
+ */
+void X86::EmitBinaryOp(BinaryOp::OpCode code, Location *dst, Location *op1,
+                       Location *op2, int imm)
+{
+  char rhs[64];
+  Emit("movl %s, %%eax", Address(op1));
+  if (op2) {
+    Emit("movl %s, %%ecx", Address(op2));
+    strcpy(rhs, "%ecx");
+  } else if (code == BinaryOp::Div || code == BinaryOp::Mod) {
+    Emit("movl $%d, %%ecx", imm); // idiv has no immediate form
+    strcpy(rhs, "%ecx");
+  } else {
+    sprintf(rhs, "$%d", imm);
+  }
+  switch (code) {
+  case BinaryOp::Add:
+  case BinaryOp::Sub: // trap on signed overflow like MIPS add and sub
+    Emit("%s %s, %%eax", code == BinaryOp::Add ? "addl" : "subl", rhs);
+    Emit("jo _Overflow");
+    break;
+  case BinaryOp::Mul: Emit("imull %s, %%eax", rhs); break;
+  case BinaryOp::And: Emit("andl %s, %%eax", rhs); break;
+  case BinaryOp::Or:  Emit("orl %s, %%eax", rhs); break;
+  case BinaryOp::Div:
+  case BinaryOp::Mod:
+    // idivl faults on a zero divisor and on INT_MIN / -1, so those are
+    // checked first unless the divisor is a constant that can't be either
+    if (op2 || imm == 0) {
+      Emit("testl %%ecx, %%ecx");
+      Emit("jz _DivideByZero");
+    }
+    if (op2 || imm == -1) {
+      Emit("cmpl $-1, %%ecx");
+      Emit("jne 1f");
+      Emit(code == BinaryOp::Div ? "negl %%eax" : "xorl %%eax, %%eax");
+      Emit("jmp 2f");
+      Emit("1:");
+    }
+    Emit("cltd");
+    Emit("idivl %%ecx");
+    if (code == BinaryOp::Mod)
+      Emit("movl %%edx, %%eax");
+    if (op2 || imm == -1)
+      Emit("2:");
+    break;
+  case BinaryOp::Eq:
+  case BinaryOp::Less:
+    Emit("cmpl %s, %%eax", rhs);
+    Emit("%s %%al", code == BinaryOp::Eq ? "sete" : "setl");
+    Emit("movzbl %%al, %%eax");
+    break;
+  default:
+    Failure("Unexpected Tac operator %d", code);
+  }
+  Emit("movl %%eax, %s", Address(dst));
+}
+
+void X86::EmitBranch(const char *jump, Location *test, const char *label)
+{
+  Emit("cmpl $0, %s", Address(test));
+  Emit("%s %s", jump, Symbol(label));
+}
+
+
+/* Method: EmitBeginFunction
+ * -------------------------
+ * Saves the caller's %rbp, sets up our own and makes room for the
+ * locals and temps, zeroed the way a fresh SPIM stack (and -run, and
+ * the C target) has them, so an unassigned object reads as null.
+ */
+void X86::EmitBeginFunction(int frameSize)
+{
+  Assert(frameSize >= 0);
+  Emit("pushq %%rbp\t\t# save fp");
+  Emit("movq %%rsp, %%rbp\t# set up new fp");
+  if (frameSize != 0)
+    Emit("subq $%d, %%rsp\t# make space for locals/temps", frameSize);
+  int off = 0;
+  for (; off + 8 <= frameSize; off += 8)
+    Emit("movq $0, %d(%%rsp)", off);
+  if (off < frameSize)
+    Emit("movl $0, %d(%%rsp)", off);
+}
+
+void X86::EmitReturn(Location *returnVal)
+{
+  if (returnVal != NULL)
+    Emit("movl %s, %%eax\t# assign return value into %%eax", Address(returnVal));
+  Emit("leave\t\t\t# pop frame, restore saved fp");
+  Emit("ret");
+}
+
+void X86::EmitParam(Location *arg)
+{
+  Emit("movl %s, %%eax", Address(arg));
+  Emit("subq $4, %%rsp\t\t# make space for param");
+  Emit("movl %%eax, (%%rsp)");
+}
+
+void X86::EmitCall(Location *result, const char *fn)
+{
+  Emit("call %s", fn);
+  if (result != NULL)
+    Emit("movl %%eax, %s\t# copy function return value", Address(result));
+}
+
+void X86::EmitVTable(const char *label, List<const char *> *methodLabels)
+{
+  Emit(".data");
+  Emit(".align 4");
+  Emit("%s:\t\t# label for class %s vtable", label, label);
+  for (int i = 0; i < methodLabels->NumElements(); i++)
+    Emit(".long %s", methodLabels->Nth(i));
+  Emit(".text");
+}
+
+void X86::EmitErrorStub(const char *label, const char *message)
+{
+  char *quoted = new char[strlen(message) + 3];
+  sprintf(quoted, "\"%s\"", message);
+  Emit("%s:", label);
+  Emit("leaq %s(%%rip), %%rax\t# load error message", StringLabel(Intern(quoted)));
+  Emit("subq $4, %%rsp");
+  Emit("movl %%eax, (%%rsp)");
+  Emit("call _PrintString");
+  Emit("call _Halt");
+  delete[] quoted;
+}
+
+
+/* Method: EmitInstruction
+ * -----------------------
+ * Dispatches one Tac instruction to the method above that translates it,
+ * after echoing the Tac as a comment the way Instruction::Emit does.
+ */
+void X86::EmitInstruction(Instruction *instr)
+{
+  if (*instr->GetPrinted())
+    Emit("# %s", instr->GetPrinted());
+
+  if (LoadConstant *lc = dynamic_cast<LoadConstant *>(instr)) {
+    EmitLoadConstant(lc->GetDst(), lc->GetValue());
+  } else if (LoadStringConstant *ls = dynamic_cast<LoadStringConstant *>(instr)) {
+    EmitLoadLabel(ls->GetDst(), StringLabel(ls->GetString()));
+  } else if (LoadLabel *ll = dynamic_cast<LoadLabel *>(instr)) {
+    EmitLoadLabel(ll->GetDst(), ll->GetLabel());
+  } else if (Assign *a = dynamic_cast<Assign *>(instr)) {
+    EmitCopy(a->GetDst(), a->GetSrc());
+  } else if (Load *l = dynamic_cast<Load *>(instr)) {
+    EmitLoad(l->GetDst(), l->GetSrc(), l->GetOffset());
+  } else if (Store *s = dynamic_cast<Store *>(instr)) {
+    EmitStore(s->GetDst(), s->GetSrc(), s->GetOffset());
+  } else if (BinaryOp *b = dynamic_cast<BinaryOp *>(instr)) {
+    EmitBinaryOp(b->GetCode(), b->GetDst(), b->GetOp1(), b->GetOp2(), b->GetImm());
+  } else if (Label *lab = dynamic_cast<Label *>(instr)) {
+    Emit("%s:", Symbol(lab->GetLabel()));
+  } else if (Goto *g = dynamic_cast<Goto *>(instr)) {
+    Emit("jmp %s\t\t# unconditional branch", Symbol(g->GetLabel()));
+  } else if (IfZ *z = dynamic_cast<IfZ *>(instr)) {
+    EmitBranch("je", z->GetTest(), z->GetLabel());
+  } else if (IfNZ *nz = dynamic_cast<IfNZ *>(instr)) {
+    EmitBranch("jne", nz->GetTest(), nz->GetLabel());
+  } else if (BeginFunc *bf = dynamic_cast<BeginFunc *>(instr)) {
+    EmitBeginFunction(bf->GetFrameSize());
+  } else if (dynamic_cast<EndFunc *>(instr)) {
+    Emit("# (below handles reaching end of fn body with no explicit return)");
+    EmitReturn(NULL);
+  } else if (Return *r = dynamic_cast<Return *>(instr)) {
+    EmitReturn(r->GetValue());
+  } else if (PushParam *p = dynamic_cast<PushParam *>(instr)) {
+    EmitParam(p->GetParam());
+  } else if (PopParams *pp = dynamic_cast<PopParams *>(instr)) {
+    if (pp->GetNumBytes() != 0)
+      Emit("addq $%d, %%rsp\t# pop params off stack", pp->GetNumBytes());
+  } else if (LCall *call = dynamic_cast<LCall *>(instr)) {
+    EmitCall(call->GetDst(), Symbol(call->GetLabel()));
+  } else if (ACall *ac = dynamic_cast<ACall *>(instr)) {
+    Emit("movl %s, %%eax", Address(ac->GetMethodAddr()));
+    EmitCall(ac->GetDst(), "*%rax");
+  } else if (VTable *vt = dynamic_cast<VTable *>(instr)) {
+    EmitVTable(vt->GetLabel(), vt->GetMethodLabels());
+  } else if (ErrorStub *es = dynamic_cast<ErrorStub *>(instr)) {
+    EmitErrorStub(es->GetLabel(), es->GetMessage());
+  } else {
+    Failure("X86: no translation for Tac '%s'", instr->GetPrinted());
+  }
+}
+
+
+/* Method: EmitProgram
+ * -------------------
+ * Translates every instruction, then lays out the string pool and
+ * reserves the global segment, whose size is the highest gp offset used.
+ */
+void X86::EmitProgram(List<Instruction *> *code)
+{
+  Emit("# standard Decaf preamble (x86-64)");
+  Emit(".text");
+  Emit(".globl __decaf_main");
+  for (int i = 0; i < code->NumElements(); i++) {
+    Instruction *instr = code->Nth(i);
+    Location *ops[3];
+    for (int n = instr->GetOperands(ops) - 1; n >= 0; n--)
+      NoteGlobal(ops[n]);
+    EmitInstruction(instr);
+  }
+
+  if (strings.NumStrings() != 0) {
+    Emit(".data\t\t\t# string constants");
+    for (int i = 0; i < strings.NumStrings(); i++) {
+      Emit("%s: .asciz %s", strings.NthLabel(i), strings.Nth(i));
+    }
+  }
+  if (globalBytes != 0)
+    Emit(".lcomm __decaf_globals, %d", globalBytes);
+  Emit(".section .note.GNU-stack,\"\",@progbits");
+}
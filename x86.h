@@ -0,0 +1,63 @@
+/* File: x86.h
+ * -----------
+ * The X86 class translates the Tac of a whole program into x86-64 GNU
+ * assembly (AT&T syntax, System V ABI), as the alternative to the Mips
+ * class when compiling with -target=x86-64. Like Mips it translates one
+ * Tac instruction at a time, loading operands from their stack or global
+ * slot into %eax/%ecx and storing the result straight back.
+ *
+ * Decaf values stay 4 bytes wide, so frames and objects are laid out
+ * exactly as for MIPS and every pointer a program handles must fit in 32
+ * bits: the output is linked without PIE and the runtime allocates the
+ * heap below 2GB. Calls between Decaf functions keep the Decaf
+ * convention (4-byte parameters pushed on the stack, result in %eax);
+ * the built-in routines are provided by runtime/x86_64.c, which adapts
+ * them to C. To get an executable:
+ *
+ *     dcc -target=x86-64 < prog.decaf > prog.s
+ *     cc -no-pie -o prog prog.s runtime/x86_64.c
+ */
+
+#ifndef _H_x86
+#define _H_x86
+
+#include "tac.h"
+#include "list.h"
+#include "hashtable.h"
+#include "strpool.h"
+
+class X86 {
+  public:
+    X86();
+
+    // Translates the whole program, runtime entry point included.
+    void EmitProgram(List<Instruction *> *code);
+
+  private:
+    StringPool strings;
+    int globalBytes; // size of the gp-relative segment
+
+    static void Emit(const char *fmt, ...);
+    const char *StringLabel(const char *str);
+    const char *Symbol(const char *label);
+    const char *Address(Location *var);
+    void NoteGlobal(Location *var);
+
+    void EmitInstruction(Instruction *instr);
+    void EmitLoadConstant(Location *dst, int val);
+    void EmitLoadLabel(Location *dst, const char *label);
+    void EmitCopy(Location *dst, Location *src);
+    void EmitLoad(Location *dst, Location *reference, int offset);
+    void EmitStore(Location *reference, Location *value, int offset);
+    void EmitBinaryOp(BinaryOp::OpCode code, Location *dst, Location *op1,
+                      Location *op2, int imm);
+    void EmitBranch(const char *jump, Location *test, const char *label);
+    void EmitBeginFunction(int frameSize);
+    void EmitReturn(Location *returnVal);
+    void EmitParam(Location *arg);
+    void EmitCall(Location *result, const char *fn);
+    void EmitVTable(const char *label, List<const char *> *methodLabels);
+    void EmitErrorStub(const char *label, const char *message);
+};
+
+#endif